@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "configuration.hpp"
+#include "id_generator.hpp"
+#include "logger.hpp"
+#include "protocol.hpp"
+#include "simulator.hpp"
+
+using namespace std;
+
+/*
+ * Drives Protocol::sendData over every combination of payload size, fragment
+ * count, window size and loss probability, and writes the results as JSON.
+ *
+ * Runs use the simulator by default, so they are deterministic for a seed and
+ * do not wait for real latency. "--real_time" uses the threaded network.
+ * "--segmented" sends each run as a single payload, which the protocol splits
+ * into segments of the payload size.
+ * Options not listed here are forwarded to the configuration.
+ */
+
+namespace {
+    struct Options {
+        vector<size_t> payload_sizes = {16, 1024};
+        vector<size_t> fragment_counts = {20, 200};
+        vector<unsigned int> window_sizes = {1, 8, 32};
+        vector<float> loss_probabilities = {0, 0.05};
+        string output_path = "benchmark.json";
+        unsigned int seed = 42;
+        bool real_time = false;
+        bool segmented = false;
+    };
+
+    struct Scenario {
+        size_t payload_size;
+        size_t fragment_count;
+        unsigned int window_size;
+        float loss_probability;
+    };
+
+    struct Result {
+        Scenario scenario;
+        bool completed;
+        size_t delivered_fragments;
+        double elapsed_seconds;  // Simulated or real, as the run was
+        double wall_clock_seconds;
+        Network::Statistics statistics;
+        PoolResource::Statistics pool_statistics;
+        vector<double> latencies;  // Milliseconds, sorted
+    };
+
+    template <typename Number>
+    bool parseNumber(string text, Number &number) {
+        istringstream stream(text);
+        return (stream >> number) && stream.eof();
+    }
+
+    // Comma-separated values, such as "1,8,32"
+    template <typename Number>
+    bool parseList(string text, vector<Number> &list) {
+        list.clear();
+        stringstream stream(text);
+        string item;
+        while (getline(stream, item, ',')) {
+            Number number;
+            if (!parseNumber(item, number)) return false;
+            list.push_back(number);
+        }
+        return !list.empty();
+    }
+
+    // Nearest-rank percentile of sorted values
+    double getPercentile(const vector<double> &values, double percentile) {
+        if (values.empty()) return 0;
+        size_t rank = static_cast<size_t>(
+            ceil(percentile / 100 * static_cast<double>(values.size())));
+        return values[clamp<size_t>(rank, 1, values.size()) - 1];
+    }
+
+    double getRate(double amount, double seconds) {
+        return seconds > 0 ? amount / seconds : 0;
+    }
+
+    Result runScenario(const Scenario &scenario, const Options &options,
+                       const Configuration &base_configuration,
+                       shared_ptr<IdGenerator> id_generator) {
+        auto configuration = make_shared<Configuration>(base_configuration);
+        // The window starts at its largest, so congestion control can only
+        // shrink it
+        configuration->set("connection_buffer_size",
+                           to_string(scenario.window_size), "benchmark");
+        configuration->set("maximum_congestion_window",
+                           to_string(scenario.window_size), "benchmark");
+        configuration->set("packet_loss_probability",
+                           to_string(scenario.loss_probability), "benchmark");
+        configuration->set("segment_size", to_string(scenario.payload_size),
+                           "benchmark");
+
+        srand(options.seed);
+        shared_ptr<Simulator> simulator =
+            options.real_time ? nullptr : make_shared<Simulator>();
+
+        Result result{scenario, false, 0, 0, 0, {}, {}, {}};
+        mutex latencies_mutex;
+        auto wall_clock_start = chrono::steady_clock::now();
+        {
+            Protocol protocol(id_generator, "Benchmark", configuration,
+                              simulator);
+            protocol.onMessageDelivered(
+                [&](uuids::uuid, Connection::Timeout latency) {
+                    lock_guard<mutex> lock(latencies_mutex);
+                    result.latencies.push_back(
+                        chrono::duration<double, milli>(latency).count());
+                });
+
+            ostringstream output_stream;
+            uuids::uuid source = protocol.createEntity("Source", output_stream);
+            uuids::uuid target = protocol.createEntity("Target", output_stream);
+
+            auto start = simulator != nullptr ? simulator->now()
+                                              : chrono::steady_clock::now();
+            if (options.segmented)
+                result.completed = protocol.sendPayload(
+                    source, target,
+                    string(scenario.payload_size * scenario.fragment_count,
+                           'x'),
+                    output_stream);
+            else
+                result.completed = protocol.sendData(
+                    source, target,
+                    deque<string>(scenario.fragment_count,
+                                  string(scenario.payload_size, 'x')),
+                    output_stream);
+            auto end = simulator != nullptr ? simulator->now()
+                                            : chrono::steady_clock::now();
+
+            result.elapsed_seconds =
+                chrono::duration<double>(end - start).count();
+            result.statistics = protocol.getNetworkStatistics();
+            result.pool_statistics = protocol.getNetworkPoolStatistics();
+        }
+        result.wall_clock_seconds =
+            chrono::duration<double>(chrono::steady_clock::now() -
+                                     wall_clock_start)
+                .count();
+
+        lock_guard<mutex> lock(latencies_mutex);
+        sort(result.latencies.begin(), result.latencies.end());
+        result.delivered_fragments = result.latencies.size();
+        return result;
+    }
+
+    void writeResult(ostream &output, const Result &result) {
+        const Scenario &scenario = result.scenario;
+        double delivered = static_cast<double>(result.delivered_fragments);
+        double delivered_bytes =
+            delivered * static_cast<double>(scenario.payload_size);
+
+        output << "    {\n"
+               << "      \"payload_size\": " << scenario.payload_size << ",\n"
+               << "      \"fragment_count\": " << scenario.fragment_count
+               << ",\n"
+               << "      \"window_size\": " << scenario.window_size << ",\n"
+               << "      \"loss_probability\": " << scenario.loss_probability
+               << ",\n"
+               << "      \"completed\": "
+               << (result.completed ? "true" : "false") << ",\n"
+               << "      \"delivered_fragments\": "
+               << result.delivered_fragments << ",\n"
+               << "      \"elapsed_seconds\": " << result.elapsed_seconds
+               << ",\n"
+               << "      \"wall_clock_seconds\": " << result.wall_clock_seconds
+               << ",\n"
+               << "      \"messages_per_second\": "
+               << getRate(delivered, result.elapsed_seconds) << ",\n"
+               << "      \"bytes_per_second\": "
+               << getRate(delivered_bytes, result.elapsed_seconds) << ",\n"
+               << "      \"wall_clock_messages_per_second\": "
+               << getRate(delivered, result.wall_clock_seconds) << ",\n"
+               << "      \"transmissions\": "
+               << result.statistics.transmissions << ",\n"
+               << "      \"transmitted_bytes\": "
+               << result.statistics.transmitted_bytes << ",\n"
+               << "      \"retransmissions\": "
+               << result.statistics.retransmissions << ",\n"
+               << "      \"fast_retransmissions\": "
+               << result.statistics.fast_retransmissions << ",\n"
+               << "      \"lost_packages\": "
+               << result.statistics.lost_packages << ",\n"
+               << "      \"retransmissions_per_delivered_fragment\": "
+               << (delivered > 0 ? static_cast<double>(
+                                       result.statistics.retransmissions) /
+                                       delivered
+                                 : 0)
+               << ",\n"
+               << "      \"pool\": {\"allocations\": "
+               << result.pool_statistics.allocations
+               << ", \"reused_blocks\": "
+               << result.pool_statistics.reused_blocks
+               << ", \"upstream_allocations\": "
+               << result.pool_statistics.upstream_allocations
+               << ", \"peak_bytes_in_use\": "
+               << result.pool_statistics.peak_bytes_in_use
+               << ", \"reserved_bytes\": "
+               << result.pool_statistics.reserved_bytes << "},\n"
+               << "      \"latency_ms\": {\"p50\": "
+               << getPercentile(result.latencies, 50)
+               << ", \"p99\": " << getPercentile(result.latencies, 99)
+               << ", \"p999\": " << getPercentile(result.latencies, 99.9)
+               << "}\n"
+               << "    }";
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options,
+                      Configuration &configuration) {
+        bool is_valid = true;
+        for (int i = 1; i < argc; i++) {
+            string argument = argv[i];
+            if (argument == "--real_time") {
+                options.real_time = true;
+                continue;
+            }
+            if (argument == "--segmented") {
+                options.segmented = true;
+                continue;
+            }
+
+            size_t separator = argument.find('=');
+            if (!argument.starts_with("--") || separator == string::npos) {
+                cerr << "Unknown argument \"" << argument << "\"" << endl;
+                is_valid = false;
+                continue;
+            }
+            string key = argument.substr(2, separator - 2);
+            string value = argument.substr(separator + 1);
+
+            bool is_valid_option = true;
+            if (key == "payload_sizes")
+                is_valid_option = parseList(value, options.payload_sizes);
+            else if (key == "fragment_counts")
+                is_valid_option = parseList(value, options.fragment_counts);
+            else if (key == "window_sizes")
+                is_valid_option = parseList(value, options.window_sizes);
+            else if (key == "loss_probabilities")
+                is_valid_option =
+                    parseList(value, options.loss_probabilities);
+            else if (key == "output")
+                options.output_path = value;
+            else if (key == "seed")
+                is_valid_option = parseNumber(value, options.seed);
+            else if (key == "configuration")
+                is_valid_option = configuration.loadFile(value);
+            else
+                is_valid_option =
+                    configuration.set(key, value, "argument " + to_string(i));
+
+            if (!is_valid_option) {
+                cerr << "Invalid value \"" << value << "\" for \"" << key
+                     << "\"" << endl;
+                is_valid = false;
+            }
+        }
+        return is_valid;
+    }
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    Configuration configuration;
+    // Printing every package would dominate the measurements
+    configuration.set("debug_information", "false");
+    configuration.set("packet_corruption_probability", "0");
+    configuration.set("send_data_timeout", "3600s");
+    // 1 Mbit/s, so payload sizes make a difference in the simulation too
+    configuration.set("network_bandwidth", "125000");
+
+    Options options;
+    if (!parseOptions(argc, argv, options, configuration)) {
+        for (const auto &error : configuration.getErrors())
+            cerr << error << endl;
+        return 1;
+    }
+
+    auto id_generator = make_shared<IdGenerator>();
+
+    vector<Result> results;
+    for (size_t payload_size : options.payload_sizes)
+        for (size_t fragment_count : options.fragment_counts)
+            for (unsigned int window_size : options.window_sizes)
+                for (float loss_probability : options.loss_probabilities) {
+                    Scenario scenario{payload_size, fragment_count,
+                                      window_size, loss_probability};
+                    results.push_back(runScenario(scenario, options,
+                                                  configuration, id_generator));
+                    Logger::getInstance().flush();
+
+                    const Result &result = results.back();
+                    cout << "payload " << payload_size << " B, "
+                         << fragment_count << " fragments, window "
+                         << window_size << ", loss " << loss_probability
+                         << ": " << result.delivered_fragments
+                         << " delivered in " << result.elapsed_seconds << " s"
+                         << endl;
+                }
+
+    ofstream output(options.output_path);
+    if (!output.is_open()) {
+        cerr << "Could not open \"" << options.output_path << "\"" << endl;
+        return 1;
+    }
+    output << "{\n"
+           << "  \"mode\": \""
+           << (options.real_time ? "real_time" : "simulation") << "\",\n"
+           << "  \"segmented\": " << (options.segmented ? "true" : "false")
+           << ",\n"
+           << "  \"seed\": " << options.seed << ",\n"
+           << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        writeResult(output, results[i]);
+        output << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    output << "  ]\n"
+           << "}\n";
+
+    cout << "Results written to " << options.output_path << endl;
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "chunked_storage.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Construction */
+
+ChunkedStorage::ChunkedStorage(size_t chunk_size)
+    : chunk_size(max<size_t>(chunk_size, 1)),
+      size(0),
+      is_writing_fragment(false),
+      fragment_size(0),
+      fragment_written_size(0) {}
+
+/* Getters */
+
+size_t ChunkedStorage::getSize() const { return this->size; }
+
+size_t ChunkedStorage::getFragmentsCount() const {
+    return this->fragments.size();
+}
+
+string_view ChunkedStorage::getFragment(size_t index) const {
+    return this->fragments.at(index);
+}
+
+bool ChunkedStorage::empty() const { return this->fragments.empty(); }
+
+/* Methods */
+
+bool ChunkedStorage::beginFragment(size_t fragment_size) {
+    if (this->is_writing_fragment) return false;
+
+    // The whole fragment is reserved, so it stays contiguous
+    if (this->chunks.empty() ||
+        this->chunks.back().capacity - this->chunks.back().size <
+            fragment_size) {
+        size_t capacity = max(this->chunk_size, fragment_size);
+        this->chunks.push_back(
+            {make_unique_for_overwrite<char[]>(capacity), capacity, 0});
+    }
+    this->is_writing_fragment = true;
+    this->fragment_size = fragment_size;
+    this->fragment_written_size = 0;
+    return this->appendToFragment("");  // Completes an empty fragment
+}
+
+bool ChunkedStorage::appendToFragment(string_view part) {
+    if (!this->is_writing_fragment) return part.empty();
+    if (part.size() > this->fragment_size - this->fragment_written_size)
+        return false;
+
+    Chunk &chunk = this->chunks.back();
+    copy(part.begin(), part.end(), chunk.data.get() + chunk.size);
+    chunk.size += part.size();
+    this->fragment_written_size += part.size();
+    if (this->fragment_written_size < this->fragment_size) return true;
+
+    // Only complete fragments are visited
+    this->fragments.emplace_back(
+        chunk.data.get() + chunk.size - this->fragment_size,
+        this->fragment_size);
+    this->size += this->fragment_size;
+    this->is_writing_fragment = false;
+    return true;
+}
+
+void ChunkedStorage::discardFragment() {
+    if (!this->is_writing_fragment) return;
+    this->chunks.back().size -= this->fragment_written_size;
+    this->is_writing_fragment = false;
+}
+
+void ChunkedStorage::forEach(
+    function<void(string_view part, bool is_fragment_end)> visit) const {
+    // Fragments are already in memory, so each one is visited whole
+    for (string_view fragment : this->fragments) visit(fragment, true);
+}
+
+void ChunkedStorage::clear() {
+    this->fragments.clear();
+    this->chunks.clear();
+    this->size = 0;
+    this->is_writing_fragment = false;
+    this->fragment_size = 0;
+    this->fragment_written_size = 0;
+}
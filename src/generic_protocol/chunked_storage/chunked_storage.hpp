@@ -0,0 +1,59 @@
+#ifndef CHUNKED_STORAGE_HPP_
+#define CHUNKED_STORAGE_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+#include "generic_protocol_constants.hpp"
+#include "storage.hpp"
+
+using namespace std;
+
+/*
+ * Append-only storage of received fragments in memory.
+ * Fragments are copied into chunks that never move once allocated, so an
+ * append is O(1) and earlier data is never copied again. Each fragment stays
+ * contiguous: one that does not fit in the rest of the current chunk starts a
+ * new chunk, and one larger than a chunk gets a chunk of its own.
+ */
+class ChunkedStorage : public Storage {
+   private:
+    struct Chunk {
+        unique_ptr<char[]> data;
+        size_t capacity;
+        size_t size;
+    };
+
+    size_t chunk_size;
+    deque<Chunk> chunks;
+    deque<string_view> fragments;  // Point into the chunks
+    size_t size;
+    bool is_writing_fragment;
+    size_t fragment_size;  // Of the fragment being written
+    size_t fragment_written_size;
+
+   public:
+    /* Construction */
+    explicit ChunkedStorage(
+        size_t chunk_size = GenericProtocolConstants::storage_chunk_size);
+
+    /* Getters */
+    size_t getSize() const override;
+    size_t getFragmentsCount() const override;
+    // Valid while the storage exists and is not cleared
+    string_view getFragment(size_t index) const;
+    bool empty() const;
+
+    /* Methods */
+    bool beginFragment(size_t fragment_size) override;
+    bool appendToFragment(string_view part) override;
+    void discardFragment() override;
+    void forEach(function<void(string_view part, bool is_fragment_end)> visit)
+        const override;
+    void clear();
+};
+
+#endif  // CHUNKED_STORAGE_HPP_
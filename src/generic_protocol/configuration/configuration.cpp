@@ -0,0 +1,514 @@
+#include "configuration.hpp"
+
+#include <charconv>
+#include <fstream>
+
+#include "generic_protocol_constants.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+namespace {
+    string trim(string text) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == string::npos) return "";
+        size_t last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    }
+
+    template <typename Number>
+    optional<Number> parseNumber(string text) {
+        Number number;
+        auto [end, error] =
+            from_chars(text.data(), text.data() + text.size(), number);
+        if (error != errc() || end != text.data() + text.size())
+            return nullopt;
+        return number;
+    }
+
+    optional<bool> parseBool(string text) {
+        if (text == "true" || text == "TRUE" || text == "1") return true;
+        if (text == "false" || text == "FALSE" || text == "0") return false;
+        return nullopt;
+    }
+
+    optional<float> parseProbability(string text) {
+        auto probability = parseNumber<float>(text);
+        if (!probability.has_value()) return nullopt;
+        if (probability.value() < 0 || probability.value() > 1) return nullopt;
+        return probability;
+    }
+
+    optional<chrono::milliseconds> parseDuration(string text) {
+        long long multiplier = 1;
+        if (text.ends_with("ms")) {
+            text.resize(text.size() - 2);
+        } else if (text.ends_with("s")) {
+            text.resize(text.size() - 1);
+            multiplier = 1000;
+        }
+        auto duration = parseNumber<long long>(text);
+        if (!duration.has_value() || duration.value() < 0) return nullopt;
+        return chrono::milliseconds(duration.value() * multiplier);
+    }
+
+    // Reads a name followed by a '.', quoted when the name has dots itself
+    optional<string> parseEntityName(const string &text, size_t &position) {
+        size_t end;
+        string name;
+        if (position < text.size() && text[position] == '"') {
+            end = text.find('"', position + 1);
+            if (end == string::npos) return nullopt;
+            name = text.substr(position + 1, end - position - 1);
+            end++;
+        } else {
+            end = text.find('.', position);
+            if (end == string::npos) return nullopt;
+            name = text.substr(position, end - position);
+        }
+        if (end >= text.size() || text[end] != '.') return nullopt;
+        position = end + 1;
+        return name;
+    }
+
+    template <typename Value>
+    bool assign(optional<Value> parsed, Value &value) {
+        if (!parsed.has_value()) return false;
+        value = parsed.value();
+        return true;
+    }
+}  // namespace
+
+/* Construction */
+
+Configuration::Configuration()
+    : debug_information(GenericProtocolConstants::debug_information),
+      packet_loss_probability(
+          GenericProtocolConstants::packet_loss_probability),
+      packet_corruption_probability(
+          GenericProtocolConstants::packet_corruption_probability),
+      network_latency(GenericProtocolConstants::network_latency),
+      network_bandwidth(GenericProtocolConstants::network_bandwidth),
+      processing_workers_count(
+          GenericProtocolConstants::processing_workers_count),
+      retransmission_timer_tick(
+          GenericProtocolConstants::retransmission_timer_tick),
+      retransmission_timer_slots(
+          GenericProtocolConstants::retransmission_timer_slots),
+      adaptive_resend_timeout(
+          GenericProtocolConstants::adaptive_resend_timeout),
+      minimum_resend_timeout(
+          GenericProtocolConstants::minimum_resend_timeout),
+      maximum_resend_timeout(
+          GenericProtocolConstants::maximum_resend_timeout),
+      connection_timeout(GenericProtocolConstants::connection_timeout),
+      send_data_timeout(GenericProtocolConstants::send_data_timeout),
+      metrics_format(Metrics::Format::PROMETHEUS),
+      metrics_export_interval(
+          GenericProtocolConstants::metrics_export_interval),
+      storage_settings{FileStorage::Durability::BATCH,
+                       GenericProtocolConstants::storage_mapping_size,
+                       GenericProtocolConstants::storage_flush_interval},
+      connection_settings{
+          GenericProtocolConstants::connection_buffer_size,
+          Connection::ArqStrategy::GO_BACK_N,
+          GenericProtocolConstants::max_attempts_to_send_package,
+          GenericProtocolConstants::resend_timeout,
+          GenericProtocolConstants::congestion_control,
+          GenericProtocolConstants::maximum_congestion_window,
+          GenericProtocolConstants::segment_size,
+          GenericProtocolConstants::acknowledgement_frequency,
+          GenericProtocolConstants::acknowledgement_delay,
+          GenericProtocolConstants::fast_retransmit_threshold} {}
+
+/* Getters */
+
+bool Configuration::isDebugInformation() const {
+    return this->debug_information;
+}
+
+float Configuration::getPacketLossProbability() const {
+    return this->packet_loss_probability;
+}
+
+float Configuration::getPacketCorruptionProbability() const {
+    return this->packet_corruption_probability;
+}
+
+chrono::milliseconds Configuration::getNetworkLatency() const {
+    return this->network_latency;
+}
+
+size_t Configuration::getNetworkBandwidth() const {
+    return this->network_bandwidth;
+}
+
+unsigned int Configuration::getProcessingWorkersCount() const {
+    return this->processing_workers_count;
+}
+
+chrono::milliseconds Configuration::getRetransmissionTimerTick() const {
+    return this->retransmission_timer_tick;
+}
+
+size_t Configuration::getRetransmissionTimerSlots() const {
+    return this->retransmission_timer_slots;
+}
+
+bool Configuration::isAdaptiveResendTimeout() const {
+    return this->adaptive_resend_timeout;
+}
+
+chrono::milliseconds Configuration::getMinimumResendTimeout() const {
+    return this->minimum_resend_timeout;
+}
+
+chrono::milliseconds Configuration::getMaximumResendTimeout() const {
+    return this->maximum_resend_timeout;
+}
+
+chrono::milliseconds Configuration::getConnectionTimeout() const {
+    return this->connection_timeout;
+}
+
+chrono::milliseconds Configuration::getSendDataTimeout() const {
+    return this->send_data_timeout;
+}
+
+Configuration::ConnectionSettings Configuration::getConnectionSettings(
+    const string &first_entity_name, const string &second_entity_name) const {
+    if (this->connection_overrides.empty()) return this->connection_settings;
+
+    auto it = this->connection_overrides.find(
+        makeEntitiesNames(first_entity_name, second_entity_name));
+    if (it == this->connection_overrides.end())
+        return this->connection_settings;
+
+    ConnectionSettings settings = this->connection_settings;
+    applyOverrides(settings, it->second);
+    return settings;
+}
+
+string Configuration::getMetricsFile() const { return this->metrics_file; }
+
+Metrics::Format Configuration::getMetricsFormat() const {
+    return this->metrics_format;
+}
+
+chrono::milliseconds Configuration::getMetricsExportInterval() const {
+    return this->metrics_export_interval;
+}
+
+string Configuration::getStorageDirectory() const {
+    return this->storage_directory;
+}
+
+FileStorage::Settings Configuration::getStorageSettings() const {
+    return this->storage_settings;
+}
+
+const vector<string> &Configuration::getErrors() const { return this->errors; }
+
+/* Methods */
+
+bool Configuration::set(string key, string value, string origin) {
+    key = trim(key);
+    value = trim(value);
+
+    // connection.<first entity name>.<second entity name>.<key>
+    if (key.starts_with("connection.")) {
+        size_t position = string("connection.").size();
+        auto first_entity_name = parseEntityName(key, position);
+        auto second_entity_name = first_entity_name.has_value()
+                                      ? parseEntityName(key, position)
+                                      : nullopt;
+        if (!second_entity_name.has_value()) {
+            this->addError(origin, "Invalid connection key \"" + key + "\"");
+            return false;
+        }
+
+        ConnectionOverrides overrides;
+        EntitiesNames entities_names = makeEntitiesNames(
+            first_entity_name.value(), second_entity_name.value());
+        auto it = this->connection_overrides.find(entities_names);
+        if (it != this->connection_overrides.end()) overrides = it->second;
+
+        if (!this->setConnectionSetting(
+                overrides, key.substr(position), value, origin))
+            return false;
+        this->connection_overrides[entities_names] = overrides;
+        return true;
+    }
+
+    bool is_valid;
+    if (key == "debug_information") {
+        is_valid = assign(parseBool(value), this->debug_information);
+    } else if (key == "packet_loss_probability") {
+        is_valid =
+            assign(parseProbability(value), this->packet_loss_probability);
+    } else if (key == "packet_corruption_probability") {
+        is_valid = assign(parseProbability(value),
+                          this->packet_corruption_probability);
+    } else if (key == "network_latency") {
+        is_valid = assign(parseDuration(value), this->network_latency);
+    } else if (key == "network_bandwidth") {
+        is_valid =
+            assign(parseNumber<size_t>(value), this->network_bandwidth);
+    } else if (key == "processing_workers_count") {
+        is_valid = assign(parseNumber<unsigned int>(value),
+                          this->processing_workers_count) &&
+                   this->processing_workers_count > 0;
+    } else if (key == "retransmission_timer_tick") {
+        is_valid =
+            assign(parseDuration(value), this->retransmission_timer_tick) &&
+            this->retransmission_timer_tick.count() > 0;
+    } else if (key == "retransmission_timer_slots") {
+        is_valid = assign(parseNumber<size_t>(value),
+                          this->retransmission_timer_slots) &&
+                   this->retransmission_timer_slots > 0;
+    } else if (key == "adaptive_resend_timeout") {
+        is_valid = assign(parseBool(value), this->adaptive_resend_timeout);
+    } else if (key == "minimum_resend_timeout") {
+        is_valid = assign(parseDuration(value), this->minimum_resend_timeout);
+    } else if (key == "maximum_resend_timeout") {
+        is_valid = assign(parseDuration(value), this->maximum_resend_timeout);
+    } else if (key == "connection_timeout") {
+        is_valid = assign(parseDuration(value), this->connection_timeout);
+    } else if (key == "send_data_timeout") {
+        is_valid = assign(parseDuration(value), this->send_data_timeout);
+    } else if (key == "metrics_file") {
+        this->metrics_file = value;
+        is_valid = true;
+    } else if (key == "metrics_format") {
+        is_valid =
+            assign(Metrics::formatFromString(value), this->metrics_format);
+    } else if (key == "metrics_export_interval") {
+        is_valid =
+            assign(parseDuration(value), this->metrics_export_interval) &&
+            this->metrics_export_interval.count() > 0;
+    } else if (key == "storage_directory") {
+        this->storage_directory = value;
+        is_valid = true;
+    } else if (key == "storage_durability") {
+        is_valid = assign(FileStorage::durabilityFromString(value),
+                          this->storage_settings.durability);
+    } else if (key == "storage_mapping_size") {
+        is_valid = assign(parseNumber<size_t>(value),
+                          this->storage_settings.mapping_size) &&
+                   this->storage_settings.mapping_size > 0;
+    } else if (key == "storage_flush_interval") {
+        is_valid = assign(parseNumber<size_t>(value),
+                          this->storage_settings.flush_interval);
+    } else {
+        // Connection settings without names change every connection
+        ConnectionOverrides overrides;
+        if (!this->setConnectionSetting(overrides, key, value, origin))
+            return false;
+        applyOverrides(this->connection_settings, overrides);
+        return true;
+    }
+
+    if (!is_valid)
+        this->addError(origin,
+                       "Invalid value \"" + value + "\" for \"" + key + "\"");
+    return is_valid;
+}
+
+bool Configuration::loadFile(string path) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        this->addError(path, "Could not open the file");
+        return false;
+    }
+
+    bool is_valid = true;
+    string line;
+    for (int line_number = 1; getline(file, line); line_number++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        string origin = path + ":" + to_string(line_number);
+        size_t separator = line.find('=');
+        if (separator == string::npos) {
+            this->addError(origin, "Expected \"key = value\"");
+            is_valid = false;
+            continue;
+        }
+        is_valid &= this->set(line.substr(0, separator),
+                              line.substr(separator + 1), origin);
+    }
+    return is_valid;
+}
+
+bool Configuration::loadArguments(int argc, char *argv[]) {
+    bool is_valid = true;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        size_t separator = argument.find('=');
+        if (!argument.starts_with("--") || separator == string::npos)
+            continue;
+
+        string key = argument.substr(2, separator - 2);
+        string value = argument.substr(separator + 1);
+        if (key == "configuration")
+            is_valid &= this->loadFile(value);
+        else
+            is_valid &= this->set(key, value, "argument " + to_string(i));
+    }
+    return is_valid;
+}
+
+void Configuration::print(function<void(string)> print_information) const {
+    print_information("Debug information: " +
+                      Util::getFormattedBool(this->debug_information));
+    print_information("Packet loss probability: " +
+                      to_string(this->packet_loss_probability));
+    print_information("Packet corruption probability: " +
+                      to_string(this->packet_corruption_probability));
+    print_information("Network latency: " +
+                      to_string(this->network_latency.count()) + " ms");
+    print_information("Network bandwidth: " +
+                      (this->network_bandwidth > 0
+                           ? to_string(this->network_bandwidth) + " bytes/s"
+                           : string("unlimited")));
+    print_information("Processing workers: " +
+                      to_string(this->processing_workers_count));
+    print_information(
+        "Connection buffer size: " +
+        to_string(this->connection_settings.buffer_size));
+    print_information(
+        "ARQ strategy: " + Connection::arqStrategyToString(
+                               this->connection_settings.arq_strategy));
+    print_information(
+        "Max attempts to send package: " +
+        to_string(this->connection_settings.max_attempts_to_send_package));
+    print_information(
+        "Resend timeout: " +
+        to_string(this->connection_settings.resend_timeout.count()) + " ms" +
+        (this->adaptive_resend_timeout ? " (initial, adaptive)" : ""));
+    print_information("Congestion control: " +
+                      CongestionControl::algorithmToString(
+                          this->connection_settings.congestion_control) +
+                      ", up to " +
+                      to_string(this->connection_settings
+                                    .maximum_congestion_window) +
+                      " packages");
+    print_information("Segment size: " +
+                      to_string(this->connection_settings.segment_size) +
+                      " bytes");
+    print_information(
+        "Acknowledgements: every " +
+        to_string(this->connection_settings.acknowledgement_frequency) +
+        " packages, or after " +
+        to_string(this->connection_settings.acknowledgement_delay.count()) +
+        " ms");
+    print_information(
+        "Fast retransmit: " +
+        (this->connection_settings.fast_retransmit_threshold > 0
+             ? "after " +
+                   to_string(
+                       this->connection_settings.fast_retransmit_threshold) +
+                   " duplicate acknowledgements"
+             : string("off")));
+    if (!this->metrics_file.empty())
+        print_information("Metrics file: " + this->metrics_file);
+    if (!this->storage_directory.empty())
+        print_information(
+            "Storage directory: " + this->storage_directory + " (" +
+            FileStorage::durabilityToString(this->storage_settings.durability) +
+            " durability)");
+    for (const auto &[entities_names, overrides] : this->connection_overrides)
+        print_information("Overridden connection: " + entities_names.first +
+                          " <-> " + entities_names.second);
+}
+
+/* Auxiliary */
+
+Configuration::EntitiesNames Configuration::makeEntitiesNames(
+    const string &first_entity_name, const string &second_entity_name) {
+    if (second_entity_name < first_entity_name)
+        return {second_entity_name, first_entity_name};
+    return {first_entity_name, second_entity_name};
+}
+
+void Configuration::applyOverrides(ConnectionSettings &settings,
+                                   const ConnectionOverrides &overrides) {
+    settings.buffer_size = overrides.buffer_size.value_or(settings.buffer_size);
+    settings.arq_strategy =
+        overrides.arq_strategy.value_or(settings.arq_strategy);
+    settings.max_attempts_to_send_package =
+        overrides.max_attempts_to_send_package.value_or(
+            settings.max_attempts_to_send_package);
+    settings.resend_timeout =
+        overrides.resend_timeout.value_or(settings.resend_timeout);
+    settings.congestion_control =
+        overrides.congestion_control.value_or(settings.congestion_control);
+    settings.maximum_congestion_window =
+        overrides.maximum_congestion_window.value_or(
+            settings.maximum_congestion_window);
+    settings.segment_size =
+        overrides.segment_size.value_or(settings.segment_size);
+    settings.acknowledgement_frequency =
+        overrides.acknowledgement_frequency.value_or(
+            settings.acknowledgement_frequency);
+    settings.acknowledgement_delay = overrides.acknowledgement_delay.value_or(
+        settings.acknowledgement_delay);
+    settings.fast_retransmit_threshold =
+        overrides.fast_retransmit_threshold.value_or(
+            settings.fast_retransmit_threshold);
+}
+
+bool Configuration::setConnectionSetting(ConnectionOverrides &overrides,
+                                         string key, string value,
+                                         string origin) {
+    bool is_valid;
+    if (key == "connection_buffer_size") {
+        auto buffer_size = parseNumber<unsigned int>(value);
+        is_valid = buffer_size.has_value() && buffer_size.value() > 0;
+        if (is_valid) overrides.buffer_size = buffer_size;
+    } else if (key == "arq_strategy") {
+        overrides.arq_strategy = Connection::arqStrategyFromString(value);
+        is_valid = overrides.arq_strategy.has_value();
+    } else if (key == "max_attempts_to_send_package") {
+        auto max_attempts = parseNumber<int>(value);
+        is_valid = max_attempts.has_value() && max_attempts.value() > 0;
+        if (is_valid) overrides.max_attempts_to_send_package = max_attempts;
+    } else if (key == "resend_timeout") {
+        overrides.resend_timeout = parseDuration(value);
+        is_valid = overrides.resend_timeout.has_value();
+    } else if (key == "congestion_control") {
+        overrides.congestion_control =
+            CongestionControl::algorithmFromString(value);
+        is_valid = overrides.congestion_control.has_value();
+    } else if (key == "maximum_congestion_window") {
+        auto maximum_window = parseNumber<unsigned int>(value);
+        is_valid = maximum_window.has_value() && maximum_window.value() > 0;
+        if (is_valid) overrides.maximum_congestion_window = maximum_window;
+    } else if (key == "segment_size") {
+        auto segment_size = parseNumber<size_t>(value);
+        is_valid = segment_size.has_value() && segment_size.value() > 0;
+        if (is_valid) overrides.segment_size = segment_size;
+    } else if (key == "acknowledgement_frequency") {
+        auto frequency = parseNumber<unsigned int>(value);
+        is_valid = frequency.has_value() && frequency.value() > 0;
+        if (is_valid) overrides.acknowledgement_frequency = frequency;
+    } else if (key == "acknowledgement_delay") {
+        overrides.acknowledgement_delay = parseDuration(value);
+        is_valid = overrides.acknowledgement_delay.has_value();
+    } else if (key == "fast_retransmit_threshold") {
+        overrides.fast_retransmit_threshold = parseNumber<unsigned int>(value);
+        is_valid = overrides.fast_retransmit_threshold.has_value();
+    } else {
+        this->addError(origin, "Unknown key \"" + key + "\"");
+        return false;
+    }
+
+    if (!is_valid)
+        this->addError(origin,
+                       "Invalid value \"" + value + "\" for \"" + key + "\"");
+    return is_valid;
+}
+
+void Configuration::addError(string origin, string error) {
+    this->errors.push_back(origin + ": " + error);
+}
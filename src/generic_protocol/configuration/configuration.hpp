@@ -0,0 +1,134 @@
+#ifndef CONFIGURATION_HPP_
+#define CONFIGURATION_HPP_
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "connection.hpp"
+#include "file_storage.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+
+/*
+ * Protocol settings, loaded at runtime instead of being compiled in.
+ * Defaults come from GenericProtocolConstants and are overridden, in order,
+ * by files of "key = value" lines and by "--key=value" arguments.
+ *
+ * Connection settings can be overridden for a pair of entity names with
+ * "connection.<first entity name>.<second entity name>.<key>"; the order of
+ * the names does not matter, and a name with dots is written in quotes.
+ * Names need not be unique, so an override applies to every pair of entities
+ * with those names. Durations are in milliseconds, unless they end with "s".
+ */
+class Configuration {
+   public:
+    // Settings that may differ between connections
+    struct ConnectionSettings {
+        unsigned int buffer_size;
+        Connection::ArqStrategy arq_strategy;
+        int max_attempts_to_send_package;
+        chrono::milliseconds resend_timeout;
+        CongestionControl::Algorithm congestion_control;
+        unsigned int maximum_congestion_window;
+        size_t segment_size;
+        unsigned int acknowledgement_frequency;  // 1 sends every one
+        chrono::milliseconds acknowledgement_delay;
+        unsigned int fast_retransmit_threshold;  // 0 turns it off
+    };
+
+   private:
+    struct ConnectionOverrides {
+        optional<unsigned int> buffer_size;
+        optional<Connection::ArqStrategy> arq_strategy;
+        optional<int> max_attempts_to_send_package;
+        optional<chrono::milliseconds> resend_timeout;
+        optional<CongestionControl::Algorithm> congestion_control;
+        optional<unsigned int> maximum_congestion_window;
+        optional<size_t> segment_size;
+        optional<unsigned int> acknowledgement_frequency;
+        optional<chrono::milliseconds> acknowledgement_delay;
+        optional<unsigned int> fast_retransmit_threshold;
+    };
+
+    using EntitiesNames = pair<string, string>;
+
+    bool debug_information;
+    float packet_loss_probability;
+    float packet_corruption_probability;
+    chrono::milliseconds network_latency;
+    size_t network_bandwidth;  // Bytes per second, 0 when unlimited
+    unsigned int processing_workers_count;
+    chrono::milliseconds retransmission_timer_tick;
+    size_t retransmission_timer_slots;
+    bool adaptive_resend_timeout;
+    chrono::milliseconds minimum_resend_timeout;
+    chrono::milliseconds maximum_resend_timeout;
+    chrono::milliseconds connection_timeout;
+    chrono::milliseconds send_data_timeout;
+    string metrics_file;  // Empty when metrics are not exported
+    Metrics::Format metrics_format;
+    chrono::milliseconds metrics_export_interval;
+    string storage_directory;  // Empty when data is kept in memory
+    FileStorage::Settings storage_settings;
+
+    ConnectionSettings connection_settings;
+    map<EntitiesNames, ConnectionOverrides> connection_overrides;
+
+    vector<string> errors;
+
+    static EntitiesNames makeEntitiesNames(const string &first_entity_name,
+                                           const string &second_entity_name);
+    static void applyOverrides(ConnectionSettings &settings,
+                               const ConnectionOverrides &overrides);
+    bool setConnectionSetting(ConnectionOverrides &overrides, string key,
+                              string value, string origin);
+    void addError(string origin, string error);
+
+   public:
+    /* Construction */
+    Configuration();
+    ~Configuration() {}
+
+    /* Getters */
+    bool isDebugInformation() const;
+    float getPacketLossProbability() const;
+    float getPacketCorruptionProbability() const;
+    chrono::milliseconds getNetworkLatency() const;
+    size_t getNetworkBandwidth() const;
+    unsigned int getProcessingWorkersCount() const;
+    chrono::milliseconds getRetransmissionTimerTick() const;
+    size_t getRetransmissionTimerSlots() const;
+    bool isAdaptiveResendTimeout() const;
+    chrono::milliseconds getMinimumResendTimeout() const;
+    chrono::milliseconds getMaximumResendTimeout() const;
+    chrono::milliseconds getConnectionTimeout() const;
+    chrono::milliseconds getSendDataTimeout() const;
+    string getMetricsFile() const;
+    Metrics::Format getMetricsFormat() const;
+    chrono::milliseconds getMetricsExportInterval() const;
+    string getStorageDirectory() const;
+    FileStorage::Settings getStorageSettings() const;
+    // Meant to be resolved once for each connection or flow, and kept
+    ConnectionSettings getConnectionSettings(
+        const string &first_entity_name,
+        const string &second_entity_name) const;
+    const vector<string> &getErrors() const;
+
+    /* Methods */
+    // Each one returns false and records the error if something is invalid
+    bool set(string key, string value, string origin = "configuration");
+    bool loadFile(string path);
+    // Reads "--key=value" and "--configuration=<path>" arguments, skipping
+    // any other one, so the caller can handle its own flags
+    bool loadArguments(int argc, char *argv[]);
+
+    void print(function<void(string)> print_information) const;
+};
+
+#endif  // CONFIGURATION_HPP_
@@ -0,0 +1,107 @@
+#include "congestion_control.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+string CongestionControl::algorithmToString(Algorithm algorithm) {
+    switch (algorithm) {
+        case Algorithm::FIXED:
+            return "FIXED";
+        case Algorithm::AIMD:
+            return "AIMD";
+        case Algorithm::DELAY_BASED:
+            return "DELAY_BASED";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+optional<CongestionControl::Algorithm> CongestionControl::algorithmFromString(
+    string algorithm) {
+    for (auto candidate :
+         {Algorithm::FIXED, Algorithm::AIMD, Algorithm::DELAY_BASED})
+        if (algorithmToString(candidate) == algorithm) return candidate;
+    return nullopt;
+}
+
+/* Construction */
+
+CongestionControl::CongestionControl(Algorithm algorithm,
+                                     unsigned int initial_window,
+                                     unsigned int maximum_window)
+    : algorithm(algorithm),
+      maximum_window(max(1u, maximum_window)),
+      recovery_sequence_number(0),
+      base_round_trip_time(nullopt) {
+    if (algorithm == Algorithm::FIXED) this->maximum_window = initial_window;
+    this->window = clamp<double>(initial_window, 1, this->maximum_window);
+    this->slow_start_threshold = this->maximum_window;
+}
+
+/* Getters */
+
+CongestionControl::Algorithm CongestionControl::getAlgorithm() const {
+    return this->algorithm;
+}
+
+unsigned int CongestionControl::getWindow() const {
+    return max(1u, static_cast<unsigned int>(floor(this->window)));
+}
+
+bool CongestionControl::isInSlowStart() const {
+    return this->window < this->slow_start_threshold;
+}
+
+/* Methods */
+
+void CongestionControl::onAcknowledged(optional<Duration> round_trip_time) {
+    if (this->algorithm == Algorithm::FIXED) return;
+    this->increase(round_trip_time);
+    this->window = clamp<double>(this->window, 1, this->maximum_window);
+}
+
+void CongestionControl::onLost(unsigned int sequence_number,
+                               unsigned int next_sequence_number) {
+    if (this->algorithm == Algorithm::FIXED) return;
+    if (sequence_number < this->recovery_sequence_number) return;
+
+    this->slow_start_threshold =
+        min<double>(max(this->window / 2, 2.0), this->maximum_window);
+    this->window = this->slow_start_threshold;
+    this->recovery_sequence_number = next_sequence_number;
+}
+
+/* Auxiliary */
+
+void CongestionControl::increase(optional<Duration> round_trip_time) {
+    if (this->algorithm != Algorithm::DELAY_BASED ||
+        !round_trip_time.has_value() ||
+        round_trip_time.value() <= Duration::zero()) {
+        this->window += this->isInSlowStart() ? 1 : 1 / this->window;
+        return;
+    }
+
+    if (!this->base_round_trip_time.has_value() ||
+        round_trip_time.value() < this->base_round_trip_time.value())
+        this->base_round_trip_time = round_trip_time;
+
+    // Packages sent beyond what the lowest round-trip time would carry are
+    // waiting in some queue
+    double queued_packages =
+        this->window *
+        (1 - chrono::duration<double>(this->base_round_trip_time.value()) /
+                 chrono::duration<double>(round_trip_time.value()));
+
+    if (this->isInSlowStart()) {
+        if (queued_packages > minimum_queued_packages)
+            this->slow_start_threshold = this->window;
+        else
+            this->window += 1;
+    } else if (queued_packages < minimum_queued_packages) {
+        this->window += 1 / this->window;
+    } else if (queued_packages > maximum_queued_packages) {
+        this->window -= 1 / this->window;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef CONGESTION_CONTROL_HPP_
+#define CONGESTION_CONTROL_HPP_
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+using namespace std;
+
+/*
+ * Congestion window of a connection, in packages.
+ *
+ * The window starts in slow start, growing by one package for each one
+ * acknowledged, and then grows by one package per window (additive increase).
+ * A loss halves it (multiplicative decrease), once per window of packages:
+ * losses of packages sent before the last decrease are already accounted for.
+ * The delay-based variant also stops growing, and then shrinks, as the
+ * round-trip time rises above the lowest one seen, before packages are lost.
+ */
+class CongestionControl {
+   public:
+    enum class Algorithm { FIXED, AIMD, DELAY_BASED };
+
+    using Duration = chrono::steady_clock::duration;
+
+    static string algorithmToString(Algorithm algorithm);
+    static optional<Algorithm> algorithmFromString(string algorithm);
+
+   private:
+    // Packages estimated to be queued in the network by the delay-based
+    // variant, below which it grows and above which it shrinks
+    static constexpr double minimum_queued_packages = 2;
+    static constexpr double maximum_queued_packages = 4;
+
+    Algorithm algorithm;
+    double window;
+    double slow_start_threshold;
+    unsigned int maximum_window;
+    unsigned int recovery_sequence_number;
+    optional<Duration> base_round_trip_time;
+
+    void increase(optional<Duration> round_trip_time);
+
+   public:
+    /* Construction */
+    CongestionControl(Algorithm algorithm, unsigned int initial_window,
+                      unsigned int maximum_window);
+
+    /* Getters */
+    Algorithm getAlgorithm() const;
+    unsigned int getWindow() const;
+    bool isInSlowStart() const;
+
+    /* Methods */
+    // The round-trip time is only known for packages sent once
+    void onAcknowledged(optional<Duration> round_trip_time);
+    // The next sequence number marks the end of the packages already sent
+    void onLost(unsigned int sequence_number,
+                unsigned int next_sequence_number);
+};
+
+#endif  // CONGESTION_CONTROL_HPP_
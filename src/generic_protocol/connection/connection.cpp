@@ -1,5 +1,6 @@
 #include "connection.hpp"
 
+#include <algorithm>
 #include <memory>
 
 #include "entity.hpp"
@@ -8,215 +9,399 @@
 
 using namespace std;
 
-bool Connection::isConnectedAtStep(ConnectionStep step) {
+string Connection::arqStrategyToString(ArqStrategy arq_strategy) {
+    switch (arq_strategy) {
+        case ArqStrategy::STOP_AND_WAIT:
+            return "STOP_AND_WAIT";
+        case ArqStrategy::GO_BACK_N:
+            return "GO_BACK_N";
+        case ArqStrategy::SELECTIVE_REPEAT:
+            return "SELECTIVE_REPEAT";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+optional<Connection::ArqStrategy> Connection::arqStrategyFromString(
+    string arq_strategy) {
+    for (auto candidate :
+         {ArqStrategy::STOP_AND_WAIT, ArqStrategy::GO_BACK_N,
+          ArqStrategy::SELECTIVE_REPEAT})
+        if (arqStrategyToString(candidate) == arq_strategy) return candidate;
+    return nullopt;
+}
+
+/* Auxiliary */
+
+bool Connection::isEstablished() const {
+    return this->ack_ack_syn_message_id.has_value();
+}
+
+unsigned int Connection::getWindowSize() const {
+    switch (this->arq_strategy) {
+        case ArqStrategy::STOP_AND_WAIT:
+            return 1;
+        case ArqStrategy::GO_BACK_N:
+        case ArqStrategy::SELECTIVE_REPEAT:
+        default:
+            return this->congestion_control.getWindow();
+    }
+}
+
+bool Connection::hasWindowSpace() const {
+    if (!this->isEstablished()) return false;
+    if (this->unconfirmed_sent_packages == nullptr) return false;
+    return this->unconfirmed_sent_packages->size() < this->getWindowSize();
+}
+
+deque<Connection::SentPackage>::iterator Connection::findSentPackage(
+    uuids::uuid message_id) {
+    return find_if(this->unconfirmed_sent_packages->begin(),
+                   this->unconfirmed_sent_packages->end(),
+                   [message_id](const SentPackage &sent_package) {
+                       return sent_package.message_id == message_id;
+                   });
+}
+
+deque<Connection::SentPackage>::const_iterator Connection::findSentPackage(
+    uuids::uuid message_id) const {
+    return find_if(this->unconfirmed_sent_packages->cbegin(),
+                   this->unconfirmed_sent_packages->cend(),
+                   [message_id](const SentPackage &sent_package) {
+                       return sent_package.message_id == message_id;
+                   });
+}
+
+bool Connection::isWaitingForConfirmation(uuids::uuid message_id) const {
+    if (this->unconfirmed_sent_packages == nullptr) return false;
+    return this->findSentPackage(message_id) !=
+           this->unconfirmed_sent_packages->cend();
+}
+
+vector<Message::SequenceRange> Connection::getAcknowledgedRanges() const {
+    vector<Message::SequenceRange> ranges;
+
+    // Everything delivered so far is acknowledged cumulatively
+    if (this->delivered_sequence_number > 0)
+        ranges.push_back({1, this->delivered_sequence_number});
+
+    // Packages received out of order are acknowledged selectively
+    for (const SentPackage &sent_package : *this->unconfirmed_sent_packages) {
+        if (!sent_package.is_received || sent_package.is_delivered) continue;
+        if (!ranges.empty() &&
+            ranges.back().last + 1 == sent_package.sequence_number)
+            ranges.back().last = sent_package.sequence_number;
+        else
+            ranges.push_back(
+                {sent_package.sequence_number, sent_package.sequence_number});
+    }
+
+    return ranges;
+}
+
+/* Getters */
+
+bool Connection::isConnectedAtStep(ConnectionStep step) const {
+    lock_guard<mutex> lock(this->queue_mutex);
     switch (step) {
         case ConnectionStep::SYN:
             return this->syn_message_id.has_value();
         case ConnectionStep::ACK_SYN:
             return this->ack_syn_message_id.has_value();
         case ConnectionStep::ACK_ACK_SYN:
-            return this->ack_ack_syn_message_id.has_value();
+            return this->isEstablished();
         default:
             return false;
     }
 }
 
-void Connection::connect(uuids::uuid message_id, ConnectionStep step) {
-    switch (step) {
-        case ConnectionStep::SYN:
-            this->syn_message_id = message_id;
-            break;
-        case ConnectionStep::ACK_SYN:
-            this->ack_syn_message_id = message_id;
-            break;
-        case ConnectionStep::ACK_ACK_SYN:
-            this->ack_ack_syn_message_id = message_id;
-            break;
+bool Connection::canSendPackage() const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    return this->hasWindowSpace();
+}
+
+bool Connection::canStoreData(uuids::uuid message_id) const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    if (!this->isEstablished()) return false;
+    if (this->unconfirmed_sent_packages == nullptr) return false;
+    if (this->unconfirmed_sent_packages->empty()) return false;
+
+    switch (this->arq_strategy) {
+        case ArqStrategy::STOP_AND_WAIT:
+        case ArqStrategy::GO_BACK_N:
+            // Only the oldest package is accepted, later ones are discarded
+            return this->unconfirmed_sent_packages->front().message_id ==
+                   message_id;
+        case ArqStrategy::SELECTIVE_REPEAT: {
+            // Any package in the window is accepted, once
+            auto it = this->findSentPackage(message_id);
+            return it != this->unconfirmed_sent_packages->cend() &&
+                   !it->is_received;
+        }
         default:
-            break;
+            return false;
     }
 }
 
-void Connection::removeConnection() {
-    this->syn_message_id = nullopt;
-    this->ack_syn_message_id = nullopt;
-    this->ack_ack_syn_message_id = nullopt;
-    while (!this->unconfirmed_sent_packages->empty())
-        this->unconfirmed_sent_packages->pop();
+Connection::ArqStrategy Connection::getArqStrategy() const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    return this->arq_strategy;
 }
 
-bool Connection::canSendPackage() {
-    if (!this->isConnectedAtStep(ConnectionStep::ACK_ACK_SYN)) return false;
-    // this->queue_mutex.lock();
-    if (this->unconfirmed_sent_packages == nullptr) return false;
-    bool can_send_package =
-        this->unconfirmed_sent_packages->size() < this->buffer_size;
-    // this->queue_mutex.unlock();
-    return can_send_package;
+bool Connection::hasWindowSpaceAvailable() const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    return this->hasWindowSpace();
 }
 
-bool Connection::canStoreData(uuids::uuid message_id) {
-    if (!this->isConnectedAtStep(ConnectionStep::ACK_ACK_SYN)) return false;
-    // this->queue_mutex.lock();
-    if (this->unconfirmed_sent_packages == nullptr) return false;
-    if (this->unconfirmed_sent_packages->empty()) return false;
-    auto front = this->unconfirmed_sent_packages->front();
-    bool can_store_data = front == message_id;
-    // this->queue_mutex.unlock();
-    return can_store_data;
+size_t Connection::getUnconfirmedPackagesCount() const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    if (this->unconfirmed_sent_packages == nullptr) return 0;
+    return this->unconfirmed_sent_packages->size();
 }
 
-void Connection::enqueuePackage(uuids::uuid message_id) {
-    this->unconfirmed_sent_packages->push(message_id);
+unsigned int Connection::getCongestionWindow() const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    return this->congestion_control.getWindow();
 }
 
-void Connection::dequeuePackage(uuids::uuid message_id) {
-    if (this->unconfirmed_sent_packages == nullptr) return;
-    if (this->unconfirmed_sent_packages->empty()) return;
-    if (this->unconfirmed_sent_packages->front() != message_id) return;
-    this->unconfirmed_sent_packages->pop();
+vector<Message::SequenceRange> Connection::getReceivedRanges() const {
+    lock_guard<mutex> lock(this->queue_mutex);
+    if (this->unconfirmed_sent_packages == nullptr) return {};
+    return this->getAcknowledgedRanges();
 }
 
-void Connection::lockQueue() { this->queue_mutex.lock(); }
+/* Setters */
 
-void Connection::unlockQueue() { this->queue_mutex.unlock(); }
+bool Connection::setArqStrategy(ArqStrategy arq_strategy) {
+    lock_guard<mutex> lock(this->queue_mutex);
+    if (!this->unconfirmed_sent_packages->empty()) return false;
+    this->arq_strategy = arq_strategy;
+    return true;
+}
 
-/* Connections Map */
+/* Completion */
 
-void Connection::connect(
-    shared_ptr<ConnectionsMap> connections,
-    ConnectFunctionParameters connect_function_parameters) {
-    if (connections == nullptr) return;
+bool Connection::waitUntilEstablished(Timeout timeout) {
+    unique_lock<mutex> lock(this->queue_mutex);
+    return this->state_changed_cv.wait_for(
+        lock, timeout, [this]() { return this->isEstablished(); });
+}
 
-    tuple<uuids::uuid, uuids::uuid, uuids::uuid, ConnectionStep> parameters =
-        connect_function_parameters;
-    uuids::uuid source_entity_id = get<0>(parameters);
-    uuids::uuid target_entity_id = get<1>(parameters);
-    uuids::uuid message_id = get<2>(parameters);
-    ConnectionStep step = get<3>(parameters);
+bool Connection::waitForWindowSpace(Timeout timeout) {
+    unique_lock<mutex> lock(this->queue_mutex);
+    return this->state_changed_cv.wait_for(
+        lock, timeout, [this]() { return this->hasWindowSpace(); });
+}
 
-    auto &connections_obj = *connections;
-    pair<uuids::uuid, uuids::uuid> key = {source_entity_id, target_entity_id};
+bool Connection::waitUntilConfirmed(uuids::uuid message_id, Timeout timeout) {
+    unique_lock<mutex> lock(this->queue_mutex);
+    return this->state_changed_cv.wait_for(lock, timeout, [this, message_id]() {
+        return !this->isWaitingForConfirmation(message_id);
+    });
+}
 
-    if (connections_obj.find(key) == connections_obj.end()) {
-        auto connection = make_shared<Connection>(
-            GenericProtocolConstants::connection_buffer_size);
-        connection->connect(message_id, step);
-        connections_obj.insert({key, connection});
+bool Connection::waitUntilAllConfirmed(Timeout timeout) {
+    unique_lock<mutex> lock(this->queue_mutex);
+    return this->state_changed_cv.wait_for(lock, timeout, [this]() {
+        return this->unconfirmed_sent_packages == nullptr ||
+               this->unconfirmed_sent_packages->empty();
+    });
+}
 
-    } else {
-        auto connection = connections_obj[key];
-        connection->connect(message_id, step);
+void Connection::onEstablished(function<void()> callback) {
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        if (!this->isEstablished()) {
+            this->established_callbacks.push_back(callback);
+            return;
+        }
     }
+    callback();
 }
 
-void Connection::removeConnection(
-    shared_ptr<ConnectionsMap> connections,
-    RemoveConnectionFunctionParameters remove_connection_function_parameters) {
-    if (connections == nullptr) return;
+void Connection::onMessageConfirmed(function<void(uuids::uuid)> callback) {
+    lock_guard<mutex> lock(this->queue_mutex);
+    this->message_confirmed_callbacks.push_back(callback);
+}
 
-    tuple<uuids::uuid, uuids::uuid> parameters =
-        remove_connection_function_parameters;
-    uuids::uuid source_entity_id = get<0>(parameters);
-    uuids::uuid target_entity_id = get<1>(parameters);
+/* Methods */
 
-    auto &connections_obj = *connections;
-    pair<uuids::uuid, uuids::uuid> key = {source_entity_id, target_entity_id};
+void Connection::connect(uuids::uuid message_id, ConnectionStep step) {
+    vector<function<void()>> callbacks;
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        switch (step) {
+            case ConnectionStep::SYN:
+                this->syn_message_id = message_id;
+                break;
+            case ConnectionStep::ACK_SYN:
+                this->ack_syn_message_id = message_id;
+                break;
+            case ConnectionStep::ACK_ACK_SYN:
+                this->ack_ack_syn_message_id = message_id;
+                callbacks.swap(this->established_callbacks);
+                break;
+            default:
+                break;
+        }
+    }
+    this->state_changed_cv.notify_all();
+    for (auto &callback : callbacks) callback();
+}
 
-    if (connections_obj.find(key) != connections_obj.end()) {
-        auto connection = connections_obj[key];
-        connection->removeConnection();
+void Connection::removeConnection() {
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        this->syn_message_id = nullopt;
+        this->ack_syn_message_id = nullopt;
+        this->ack_ack_syn_message_id = nullopt;
+        this->unconfirmed_sent_packages->clear();
     }
+    this->state_changed_cv.notify_all();
 }
 
-bool Connection::isConnectedAtStep(
-    shared_ptr<ConnectionsMap> connections,
-    IsConnectedAtStepFunctionParameters
-        is_connected_at_step_function_parameters) {
-    if (connections == nullptr) return false;
+unsigned int Connection::enqueuePackage(uuids::uuid message_id) {
+    lock_guard<mutex> lock(this->queue_mutex);
+    unsigned int sequence_number = this->next_sequence_number++;
+    this->unconfirmed_sent_packages->push_back(
+        {message_id, sequence_number, false, false});
+    return sequence_number;
+}
 
-    tuple<uuids::uuid, uuids::uuid, ConnectionStep> parameters =
-        is_connected_at_step_function_parameters;
-    uuids::uuid source_entity_id = get<0>(parameters);
-    uuids::uuid target_entity_id = get<1>(parameters);
-    ConnectionStep step = get<2>(parameters);
+AcceptedData Connection::acceptPackage(uuids::uuid message_id) {
+    lock_guard<mutex> lock(this->queue_mutex);
+    AcceptedData accepted_data;
+
+    auto it = this->findSentPackage(message_id);
+    if (it == this->unconfirmed_sent_packages->end()) return accepted_data;
+    it->is_received = true;
+
+    // Release the run of received packages at the start of the window
+    for (SentPackage &sent_package : *this->unconfirmed_sent_packages) {
+        if (sent_package.is_delivered) continue;
+        if (!sent_package.is_received) break;
+        sent_package.is_delivered = true;
+        this->delivered_sequence_number = sent_package.sequence_number;
+        accepted_data.deliverable_messages_ids.push_back(
+            sent_package.message_id);
+    }
 
-    auto &connections_obj = *connections;
-    pair<uuids::uuid, uuids::uuid> key = {source_entity_id, target_entity_id};
+    accepted_data.acknowledged_ranges = this->getAcknowledgedRanges();
+    return accepted_data;
+}
 
-    if (connections_obj.find(key) != connections_obj.end()) {
-        auto connection = connections_obj[key];
-        auto is_connected_at_step = connection->isConnectedAtStep(step);
-        return is_connected_at_step;
+void Connection::dequeuePackages() {
+    vector<uuids::uuid> dequeued_messages_ids;
+    vector<function<void(uuids::uuid)>> callbacks;
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        if (this->unconfirmed_sent_packages == nullptr) return;
+        while (!this->unconfirmed_sent_packages->empty() &&
+               this->unconfirmed_sent_packages->front().is_delivered) {
+            dequeued_messages_ids.push_back(
+                this->unconfirmed_sent_packages->front().message_id);
+            this->unconfirmed_sent_packages->pop_front();
+        }
+        if (dequeued_messages_ids.empty()) return;
+        callbacks = this->message_confirmed_callbacks;
     }
+    this->state_changed_cv.notify_all();
+    for (auto dequeued_message_id : dequeued_messages_ids)
+        for (auto &callback : callbacks) callback(dequeued_message_id);
+}
 
-    return false;
+void Connection::onPackageAcknowledged(
+    optional<CongestionControl::Duration> round_trip_time) {
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        this->congestion_control.onAcknowledged(round_trip_time);
+    }
+    this->state_changed_cv.notify_all();
 }
 
-bool Connection::canSendPackage(
-    shared_ptr<ConnectionsMap> connections,
-    CanSendPackageFunctionParameters can_send_data_function_parameters) {
-    if (connections == nullptr) return false;
+void Connection::onPackageLost(unsigned int sequence_number) {
+    lock_guard<mutex> lock(this->queue_mutex);
+    this->congestion_control.onLost(sequence_number,
+                                    this->next_sequence_number);
+}
 
-    tuple<uuids::uuid, uuids::uuid> parameters =
-        can_send_data_function_parameters;
-    uuids::uuid source_entity_id = get<0>(parameters);
-    uuids::uuid target_entity_id = get<1>(parameters);
+/* Connections map */
 
-    auto &connections_obj = *connections;
-    pair<uuids::uuid, uuids::uuid> key = {source_entity_id, target_entity_id};
+size_t ConnectionsMap::KeyHash::operator()(const Key &key) const {
+    size_t first_hash = hash<uuids::uuid>{}(key.first);
+    size_t second_hash = hash<uuids::uuid>{}(key.second);
+    return first_hash ^
+           (second_hash + 0x9e3779b97f4a7c15 + (first_hash << 6) +
+            (first_hash >> 2));
+}
 
-    if (connections_obj.find(key) != connections_obj.end()) {
-        auto connection = connections_obj[key];
-        auto can_send_data = connection->canSendPackage();
-        return can_send_data;
-    }
+ConnectionsMap::Key ConnectionsMap::makeKey(uuids::uuid first_entity_id,
+                                            uuids::uuid second_entity_id) {
+    if (second_entity_id < first_entity_id)
+        return {second_entity_id, first_entity_id};
+    return {first_entity_id, second_entity_id};
+}
 
-    return false;
+ConnectionsMap::Shard &ConnectionsMap::getShard(const Key &key) {
+    return this->shards[KeyHash{}(key) % shards_count];
 }
 
-bool Connection::canStoreData(
-    shared_ptr<ConnectionsMap> connections,
-    CanStoreDataFunctionParameters can_store_data_function_parameters) {
-    if (connections == nullptr) return false;
+const ConnectionsMap::Shard &ConnectionsMap::getShard(const Key &key) const {
+    return this->shards[KeyHash{}(key) % shards_count];
+}
 
-    tuple<uuids::uuid, uuids::uuid, uuids::uuid> parameters =
-        can_store_data_function_parameters;
-    uuids::uuid source_entity_id = get<0>(parameters);
-    uuids::uuid target_entity_id = get<1>(parameters);
-    uuids::uuid message_id = get<2>(parameters);
+shared_ptr<Connection> ConnectionsMap::find(
+    uuids::uuid first_entity_id, uuids::uuid second_entity_id) const {
+    Key key = makeKey(first_entity_id, second_entity_id);
+    const Shard &shard = this->getShard(key);
 
-    auto &connections_obj = *connections;
-    pair<uuids::uuid, uuids::uuid> key = {source_entity_id, target_entity_id};
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto it = shard.connections.find(key);
+    if (it == shard.connections.end()) return nullptr;
+    return it->second;
+}
 
-    if (connections_obj.find(key) != connections_obj.end()) {
-        auto connection = connections_obj[key];
-        auto is_fully_connected =
-            connection->isConnectedAtStep(ConnectionStep::ACK_ACK_SYN);
-        if (!is_fully_connected) return false;
-        auto can_store_data = connection->canStoreData(message_id);
-        return can_store_data;
+size_t ConnectionsMap::size() const {
+    size_t size = 0;
+    for (const Shard &shard : this->shards) {
+        shared_lock<shared_mutex> lock(shard.mutex);
+        size += shard.connections.size();
     }
-
-    return false;
+    return size;
 }
 
-void Connection::dequeuePackage(
-    shared_ptr<ConnectionsMap> connections,
-    DequeuePackageFunctionParameters dequeue_package_function_parameters) {
-    if (connections == nullptr) return;
+shared_ptr<Connection> ConnectionsMap::findOrCreate(
+    uuids::uuid first_entity_id, uuids::uuid second_entity_id) {
+    Key key = makeKey(first_entity_id, second_entity_id);
+    Shard &shard = this->getShard(key);
 
-    tuple<uuids::uuid, uuids::uuid, uuids::uuid> parameters =
-        dequeue_package_function_parameters;
-    uuids::uuid source_entity_id = get<0>(parameters);
-    uuids::uuid target_entity_id = get<1>(parameters);
-    uuids::uuid message_id = get<2>(parameters);
+    {
+        shared_lock<shared_mutex> lock(shard.mutex);
+        auto it = shard.connections.find(key);
+        if (it != shard.connections.end()) return it->second;
+    }
 
-    auto &connections_obj = *connections;
-    pair<uuids::uuid, uuids::uuid> key = {source_entity_id, target_entity_id};
+    unique_lock<shared_mutex> lock(shard.mutex);
+    auto [it, inserted] = shard.connections.try_emplace(key, nullptr);
+    if (inserted) {
+        Connection::Settings settings =
+            this->settings_provider != nullptr
+                ? this->settings_provider(first_entity_id, second_entity_id)
+                : Connection::Settings{
+                      GenericProtocolConstants::connection_buffer_size,
+                      Connection::ArqStrategy::GO_BACK_N,
+                      GenericProtocolConstants::congestion_control,
+                      GenericProtocolConstants::maximum_congestion_window};
+        it->second = make_shared<Connection>(
+            settings.buffer_size, settings.arq_strategy,
+            settings.congestion_control, settings.maximum_window);
+    }
+    return it->second;
+}
 
-    if (connections_obj.find(key) != connections_obj.end()) {
-        auto connection = connections_obj[key];
-        connection->dequeuePackage(message_id);
+void ConnectionsMap::clear() {
+    for (Shard &shard : this->shards) {
+        unique_lock<shared_mutex> lock(shard.mutex);
+        shard.connections.clear();
     }
-}
\ No newline at end of file
+}
@@ -1,84 +1,189 @@
 #ifndef CONNECTION_HPP_
 #define CONNECTION_HPP_
 
-#include <map>
-#include <queue>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "congestion_control.hpp"
 #include "entity.hpp"
+#include "generic_protocol_constants.hpp"
 
 using namespace std;
 
-class Connection;
+class ConnectionsMap;
 
-struct UuidPairComparator {
-    bool operator()(const pair<uuids::uuid, uuids::uuid>& lhs,
-                    const pair<uuids::uuid, uuids::uuid>& rhs) const {
-        // Compare the pairs regardless of the order of UUIDs
-        return (lhs.first < rhs.first && lhs.second < rhs.second) ||
-               (lhs.first < rhs.second && lhs.second < rhs.first);
-    }
-};
+class Connection {
+   public:
+    // Retransmission discipline used by the window
+    enum class ArqStrategy { STOP_AND_WAIT, GO_BACK_N, SELECTIVE_REPEAT };
 
-using ConnectionsMap = map<pair<uuids::uuid, uuids::uuid>,
-                           shared_ptr<Connection>, UuidPairComparator>;
+    static string arqStrategyToString(ArqStrategy arq_strategy);
+    static optional<ArqStrategy> arqStrategyFromString(string arq_strategy);
+
+    struct Settings {
+        unsigned int buffer_size;
+        ArqStrategy arq_strategy;
+        CongestionControl::Algorithm congestion_control;
+        unsigned int maximum_window;
+    };
 
-class Connection {
    private:
+    struct SentPackage {
+        uuids::uuid message_id;
+        unsigned int sequence_number;
+        bool is_received;
+        bool is_delivered;
+    };
+
     optional<uuids::uuid> syn_message_id;
     optional<uuids::uuid> ack_syn_message_id;
     optional<uuids::uuid> ack_ack_syn_message_id;
 
-    mutex queue_mutex;
-    unsigned int buffer_size;
-    shared_ptr<queue<uuids::uuid>> unconfirmed_sent_packages;
+    mutable mutex queue_mutex;
+    condition_variable state_changed_cv;  // Notified whenever the handshake
+                                          // advances or the window shrinks
+    ArqStrategy arq_strategy;
+    // Starts with the buffer size as its window
+    CongestionControl congestion_control;
+    unsigned int next_sequence_number;
+    unsigned int delivered_sequence_number;
+    shared_ptr<deque<SentPackage>> unconfirmed_sent_packages;
+
+    vector<function<void()>> established_callbacks;
+    vector<function<void(uuids::uuid)>> message_confirmed_callbacks;
+
+    /* Methods */
+    // Callers must hold queue_mutex
+    bool isEstablished() const;
+    unsigned int getWindowSize() const;
+    bool hasWindowSpace() const;
+    deque<SentPackage>::iterator findSentPackage(uuids::uuid message_id);
+    deque<SentPackage>::const_iterator findSentPackage(
+        uuids::uuid message_id) const;
+    bool isWaitingForConfirmation(uuids::uuid message_id) const;
+    vector<Message::SequenceRange> getAcknowledgedRanges() const;
 
    public:
+    using Timeout = chrono::steady_clock::duration;
+
     /* Construction */
-    Connection(unsigned int buffer_size)
+    Connection(unsigned int buffer_size,
+               ArqStrategy arq_strategy = ArqStrategy::GO_BACK_N,
+               CongestionControl::Algorithm congestion_control =
+                   GenericProtocolConstants::congestion_control,
+               unsigned int maximum_window =
+                   GenericProtocolConstants::maximum_congestion_window)
         : syn_message_id(nullopt),
           ack_syn_message_id(nullopt),
           ack_ack_syn_message_id(nullopt),
-          buffer_size(buffer_size),
-          unconfirmed_sent_packages(make_shared<queue<uuids::uuid>>()) {}
+          arq_strategy(arq_strategy),
+          congestion_control(congestion_control, buffer_size,
+                             max(buffer_size, maximum_window)),
+          next_sequence_number(1),
+          delivered_sequence_number(0),
+          unconfirmed_sent_packages(make_shared<deque<SentPackage>>()) {}
     ~Connection() {}
 
     /* Getters */
-    bool isConnectedAtStep(ConnectionStep step);
-    bool canSendPackage();
-    bool canStoreData(uuids::uuid message_id);
+    bool isConnectedAtStep(ConnectionStep step) const;
+    bool canSendPackage() const;
+    bool canStoreData(uuids::uuid message_id) const;
+    ArqStrategy getArqStrategy() const;
+    bool hasWindowSpaceAvailable() const;
+    size_t getUnconfirmedPackagesCount() const;
+    unsigned int getCongestionWindow() const;
+    // What the receiver has so far, to repeat for data it cannot store
+    vector<Message::SequenceRange> getReceivedRanges() const;
 
     /* Setters */
-    void setLastDataMessageId(uuids::uuid message_id);
+    // Only allowed while nothing is in flight
+    bool setArqStrategy(ArqStrategy arq_strategy);
+
+    /* Completion */
+    // Each wait returns as soon as its condition holds, or false on timeout
+    bool waitUntilEstablished(Timeout timeout);
+    bool waitForWindowSpace(Timeout timeout);
+    bool waitUntilConfirmed(uuids::uuid message_id, Timeout timeout);
+    bool waitUntilAllConfirmed(Timeout timeout);
+
+    // Continuations run on the thread that changes the state
+    void onEstablished(function<void()> callback);
+    void onMessageConfirmed(function<void(uuids::uuid)> callback);
 
     /* Methods */
     void connect(uuids::uuid message_id, ConnectionStep step);
     void removeConnection();
-    void enqueuePackage(uuids::uuid message_id);
-    void dequeuePackage(uuids::uuid message_id);
-    void lockQueue();
-    void unlockQueue();
-
-    /* Static Methods */
-    static void connect(shared_ptr<ConnectionsMap> connections_ptr,
-                        ConnectFunctionParameters connect_function_parameters);
-    static void removeConnection(shared_ptr<ConnectionsMap> connections_ptr,
-                                 RemoveConnectionFunctionParameters
-                                     remove_connection_function_parameters);
-    static bool isConnectedAtStep(shared_ptr<ConnectionsMap> connections_ptr,
-                                  IsConnectedAtStepFunctionParameters
-                                      is_connected_at_step_function_parameters);
-    static bool canSendPackage(
-        shared_ptr<ConnectionsMap> connections_ptr,
-        CanSendPackageFunctionParameters can_send_package_function_parameters);
-    static bool canStoreData(
-        shared_ptr<ConnectionsMap> connections_ptr,
-        CanStoreDataFunctionParameters can_store_data_function_parameters);
-    static void enqueuePackage(
-        shared_ptr<ConnectionsMap> connections_ptr,
-        EnqueuePackageFunctionParameters enqueue_package_function_parameters);
-    static void dequeuePackage(
-        shared_ptr<ConnectionsMap> connections_ptr,
-        DequeuePackageFunctionParameters dequeue_package_function_parameters);
+    // Returns the sequence number assigned to the package
+    unsigned int enqueuePackage(uuids::uuid message_id);
+    // Marks a package as received and releases the ones now in order
+    AcceptedData acceptPackage(uuids::uuid message_id);
+    // Pops the released packages, which frees room in the window
+    void dequeuePackages();
+    // Events seen by the sender, which resize the congestion window
+    void onPackageAcknowledged(
+        optional<CongestionControl::Duration> round_trip_time);
+    void onPackageLost(unsigned int sequence_number);
+};
+
+/*
+ * Connections indexed by the unordered pair of entities they link.
+ * Keys are normalized to (min, max), so both directions share a connection.
+ * The table is split into shards, each one guarded by its own lock.
+ */
+class ConnectionsMap {
+   public:
+    using Key = pair<uuids::uuid, uuids::uuid>;
+    // Tells how the connection between two entities is set up
+    using SettingsProvider =
+        function<Connection::Settings(uuids::uuid, uuids::uuid)>;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    // Both directions between two entities give the same key
+    static Key makeKey(uuids::uuid first_entity_id,
+                       uuids::uuid second_entity_id);
+
+   private:
+
+    struct Shard {
+        mutable shared_mutex mutex;
+        unordered_map<Key, shared_ptr<Connection>, KeyHash> connections;
+    };
+
+    static constexpr size_t shards_count = 16;
+    array<Shard, shards_count> shards;
+    SettingsProvider settings_provider;
+
+    Shard& getShard(const Key& key);
+    const Shard& getShard(const Key& key) const;
+
+   public:
+    /* Construction */
+    // Without a provider, every connection uses the default constants
+    ConnectionsMap(SettingsProvider settings_provider = nullptr)
+        : settings_provider(settings_provider) {}
+
+    /* Getters */
+    shared_ptr<Connection> find(uuids::uuid first_entity_id,
+                                uuids::uuid second_entity_id) const;
+    size_t size() const;
+
+    /* Methods */
+    shared_ptr<Connection> findOrCreate(uuids::uuid first_entity_id,
+                                        uuids::uuid second_entity_id);
+    void clear();
 };
 
 #endif  // CONNECTION_HPP_
@@ -1,6 +1,6 @@
 #include "entity.hpp"
 
-#include "generic_protocol_constants.hpp"
+#include "connection.hpp"
 #include "message.hpp"
 #include "package.hpp"
 #include "util.hpp"
@@ -19,62 +19,38 @@ void Entity::setName(string name) { this->name = name; }
 
 /* Connection */
 
-void Entity::connect(
-    InternalConnectFunctionParameters connect_function_parameters) {
-    ConnectFunctionParameters parameters = {
-        this->id, get<0>(connect_function_parameters),
-        get<1>(connect_function_parameters),
-        get<2>(connect_function_parameters)};
-    this->connect_function->operator()(parameters);
+shared_ptr<Connection> Entity::findConnection(
+    uuids::uuid target_entity_id) const {
+    if (this->connections == nullptr) return nullptr;
+    return this->connections->find(this->id, target_entity_id);
 }
 
-void Entity::removeConnection(InternalRemoveConnectionFunctionParameters
-                                  remove_connection_function_parameters) {
-    RemoveConnectionFunctionParameters parameters = {
-        this->id, get<0>(remove_connection_function_parameters)};
-    this->remove_connection_function->operator()(parameters);
+void Entity::connect(uuids::uuid target_entity_id, uuids::uuid message_id,
+                     ConnectionStep step) {
+    if (this->connections == nullptr) return;
+    this->connections->findOrCreate(this->id, target_entity_id)
+        ->connect(message_id, step);
 }
 
-bool Entity::isConnectedAtStep(
-    InternalIsConnectedAtStepFunctionParameters
-        is_connected_at_step_function_parameters) const {
-    IsConnectedAtStepFunctionParameters parameters = {
-        this->id, get<0>(is_connected_at_step_function_parameters),
-        get<1>(is_connected_at_step_function_parameters)};
-    auto is_connected_at_step =
-        this->is_connected_at_step_function->operator()(parameters);
-    return is_connected_at_step;
+void Entity::removeConnection(uuids::uuid target_entity_id) {
+    auto connection = this->findConnection(target_entity_id);
+    if (connection != nullptr) connection->removeConnection();
 }
 
-bool Entity::canSendPackage(InternalCanSendPackageFunctionParameters
-                                can_send_package_function_parameters) const {
-    CanSendPackageFunctionParameters parameters = {
-        this->id, get<0>(can_send_package_function_parameters)};
-    auto can_send_package =
-        this->can_send_package_function->operator()(parameters);
-    return can_send_package;
+bool Entity::isConnectedAtStep(uuids::uuid target_entity_id,
+                               ConnectionStep step) const {
+    auto connection = this->findConnection(target_entity_id);
+    return connection != nullptr && connection->isConnectedAtStep(step);
 }
 
-bool Entity::canStoreData(InternalCanStoreDataFunctionParameters
-                              can_store_data_function_parameters) const {
-    CanStoreDataFunctionParameters parameters = {
-        this->id, get<0>(can_store_data_function_parameters),
-        get<1>(can_store_data_function_parameters)};
-    auto can_store_data = this->can_store_data_function->operator()(parameters);
-    return can_store_data;
-}
-
-void Entity::dequeuePackage(InternalDequeuePackageFunctionParameters
-                                dequeue_package_function_parameters) {
-    DequeuePackageFunctionParameters parameters = {
-        this->id, get<0>(dequeue_package_function_parameters),
-        get<1>(dequeue_package_function_parameters)};
-    this->dequeue_package_function->operator()(parameters);
+bool Entity::canSendPackage(uuids::uuid target_entity_id) const {
+    auto connection = this->findConnection(target_entity_id);
+    return connection != nullptr && connection->canSendPackage();
 }
 
 /* Methods */
 
-bool Entity::sendMessage(Message message, bool should_be_confirmed) {
+bool Entity::sendMessage(const Message &message, bool should_be_confirmed) {
     // if (message.getCode() == Message::Code::DATA) {
     //     if (!this->canStoreData({message.getTargetEntityId(),
     //     message.getId()}))
@@ -83,42 +59,91 @@ bool Entity::sendMessage(Message message, bool should_be_confirmed) {
     return true;
 }
 
-void Entity::printInformation(string information, ostream &output_stream,
-                              PrettyConsole::Color color) const {
-    string header =
-        "Entity " + this->getName() + " [" + to_string(this->getId()) + "]";
-    PrettyConsole::Decoration header_decoration(PrettyConsole::Color::WHITE,
-                                                PrettyConsole::Color::CYAN,
-                                                PrettyConsole::Format::BOLD);
-    PrettyConsole::Decoration information_decoration(color);
-    Util::printInformation(header, information, output_stream,
-                           header_decoration, information_decoration);
-}
-
 void Entity::printStorage(function<void(string)> print_message) const {
     print_message("=== BEGIN ===");
-    istringstream content_stream(this->storage);
+    // Each line of a fragment is printed on its own, even when it spans
+    // several parts
     string line;
-    while (getline(content_stream, line)) {
-        print_message(line);
-    }
+    this->forEachStoredFragment([&print_message, &line](string_view part,
+                                                        bool is_fragment_end) {
+        size_t line_start = 0;
+        size_t line_end;
+        while ((line_end = part.find('\n', line_start)) != string_view::npos) {
+            line += part.substr(line_start, line_end - line_start);
+            print_message(move(line));
+            line.clear();
+            line_start = line_end + 1;
+        }
+        line += part.substr(line_start);
+        if (!is_fragment_end) return;
+        print_message(move(line));
+        line.clear();
+    });
     print_message("==== END ====");
 }
 
-void Entity::printPackageInformation(Package package, ostream &output_stream,
-                                     bool is_sending) const {
-    if (GenericProtocolConstants::debug_information) {
-        ostringstream package_content;
-        package.print([&package_content](string line) {
-            package_content << PrettyConsole::tab << line << endl;
-        });
-
-        string operation =
-            is_sending ? "Trying to send package\n" : "Received package\n";
-        string information = operation + package_content.str();
-
-        this->printInformation(information, cout,
-                               is_sending ? PrettyConsole::Color::YELLOW
-                                          : PrettyConsole::Color::MAGENTA);
+void Entity::forEachStoredFragment(
+    function<void(string_view part, bool is_fragment_end)> visit) const {
+    lock_guard<mutex> lock(this->receive_mutex);
+    this->storage->forEach(visit);
+}
+
+void Entity::logPackageInformation(const Package &package,
+                                   bool is_sending) const {
+    if (!Logger::getInstance().isEnabled(Logger::Level::DEBUG,
+                                         Logger::Category::ENTITY))
+        return;
+
+    const auto &message = package.getMessage();
+    auto code_variant = message.getCodeVariant();
+    string code = code_variant.has_value()
+                      ? Message::codeVariantToString(code_variant.value())
+                      : Message::codeToString(message.getCode());
+
+    this->log(Logger::Level::DEBUG,
+              is_sending ? PrettyConsole::Color::YELLOW
+                         : PrettyConsole::Color::MAGENTA,
+              "{} package\nID: {}\nSource entity ID: {}\n"
+              "Target entity ID: {}\nCode: {}\nSequence number: {}",
+              is_sending ? "Trying to send" : "Received", message.getId(),
+              message.getSourceEntityId(), message.getTargetEntityId(), code,
+              package.getSequenceNumber());
+}
+
+/* Entities registry */
+
+shared_ptr<Entity> EntitiesRegistry::find(uuids::uuid entity_id) const {
+    shared_lock<shared_mutex> lock(this->mutex);
+    auto it = this->entities.find(entity_id);
+    if (it == this->entities.end()) return nullptr;
+    return it->second;
+}
+
+size_t EntitiesRegistry::size() const {
+    shared_lock<shared_mutex> lock(this->mutex);
+    return this->entities.size();
+}
+
+bool EntitiesRegistry::insert(shared_ptr<Entity> entity) {
+    if (entity == nullptr) return false;
+    unique_lock<shared_mutex> lock(this->mutex);
+    auto [it, inserted] = this->entities.try_emplace(entity->getId(), entity);
+    if (inserted) this->ordered_entities.push_back(entity);
+    return inserted;
+}
+
+void EntitiesRegistry::forEach(
+    function<void(shared_ptr<Entity>)> visit) const {
+    vector<shared_ptr<Entity>> entities;
+    {
+        shared_lock<shared_mutex> lock(this->mutex);
+        entities = this->ordered_entities;
     }
+    for (auto entity : entities) visit(entity);
+}
+
+void EntitiesRegistry::clear() {
+    unique_lock<shared_mutex> lock(this->mutex);
+    this->entities.clear();
+    this->ordered_entities.clear();
 }
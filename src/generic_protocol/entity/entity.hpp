@@ -3,118 +3,121 @@
 
 #include <uuid.h>
 
+#include <deque>
 #include <functional>
-#include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <pretty_console.hpp>
-
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "chunked_storage.hpp"
+#include "id_generator.hpp"
+#include "logger.hpp"
 #include "package.hpp"
+#include "storage.hpp"
 
 using namespace std;
 
 enum class ConnectionStep { SYN, ACK_SYN, ACK_ACK_SYN };
 
-using InternalConnectFunctionParameters =
-    tuple<uuids::uuid, uuids::uuid, ConnectionStep>;
-using ConnectFunctionParameters =
-    tuple<uuids::uuid, uuids::uuid, uuids::uuid, ConnectionStep>;
-using ConnectFunction = shared_ptr<
-    function<void(ConnectFunctionParameters connect_function_parameters)>>;
-
-using InternalRemoveConnectionFunctionParameters = tuple<uuids::uuid>;
-using RemoveConnectionFunctionParameters = tuple<uuids::uuid, uuids::uuid>;
-using RemoveConnectionFunction = shared_ptr<function<void(
-    RemoveConnectionFunctionParameters remove_connection_function_parameters)>>;
-
-using InternalIsConnectedAtStepFunctionParameters =
-    tuple<uuids::uuid, ConnectionStep>;
-using IsConnectedAtStepFunctionParameters =
-    tuple<uuids::uuid, uuids::uuid, ConnectionStep>;
-using IsConnectedAtStepFunction =
-    shared_ptr<function<bool(IsConnectedAtStepFunctionParameters
-                                 is_connected_at_step_function_parameters)>>;
-
-using InternalCanSendPackageFunctionParameters = tuple<uuids::uuid>;
-using CanSendPackageFunctionParameters = tuple<uuids::uuid, uuids::uuid>;
-using CanSendPackageFunction = shared_ptr<function<bool(
-    CanSendPackageFunctionParameters can_send_package_function_parameters)>>;
-
-using InternalCanStoreDataFunctionParameters = tuple<uuids::uuid, uuids::uuid>;
-using CanStoreDataFunctionParameters =
-    tuple<uuids::uuid, uuids::uuid, uuids::uuid>;
-using CanStoreDataFunction = shared_ptr<function<bool(
-    CanStoreDataFunctionParameters can_store_data_function_parameters)>>;
-
-using EnqueuePackageFunctionParameters = tuple<uuids::uuid, uuids::uuid>;
-using EnqueuePackageFunction = shared_ptr<function<void(
-    EnqueuePackageFunctionParameters enqueue_package_function_parameters)>>;
-
-using InternalDequeuePackageFunctionParameters =
-    tuple<uuids::uuid, uuids::uuid>;
-using DequeuePackageFunctionParameters =
-    tuple<uuids::uuid, uuids::uuid, uuids::uuid>;
-using DequeuePackageFunction = shared_ptr<function<void(
-    DequeuePackageFunctionParameters dequeue_package_function_parameters)>>;
+// Outcome of accepting a DATA package on a connection
+struct AcceptedData {
+    // Messages that can be stored now, in sending order
+    vector<uuids::uuid> deliverable_messages_ids;
+    vector<Message::SequenceRange> acknowledged_ranges;
+};
+
+class Connection;
+class ConnectionsMap;
 
 class Entity {
    private:
+    // Payload whose segments are being stored
+    struct Reassembly {
+        uuids::uuid source_entity_id;
+        size_t payload_size;
+        size_t received_size;
+        string held_content;  // Received while another payload was written
+    };
+    using Reassemblies = unordered_map<uuids::uuid, Reassembly>;
+
     uuids::uuid id;
     string name;
-    string storage;
-
-    ConnectFunction connect_function;
-    RemoveConnectionFunction remove_connection_function;
-    IsConnectedAtStepFunction is_connected_at_step_function;
-    CanSendPackageFunction can_send_package_function;
-    CanStoreDataFunction can_store_data_function;
-    EnqueuePackageFunction enqueue_package_function;
-    DequeuePackageFunction dequeue_package_function;
+    unique_ptr<Storage> storage;  // One fragment for each message or payload
+    unordered_map<uuids::uuid, Message> pending_data;  // Received out of order
+    Reassemblies reassemblies;  // By payload ID
+    // Segments are written straight to the storage, one payload at a time;
+    // data received meanwhile is held, in order, until that one is complete
+    optional<uuids::uuid> written_payload_id;
+    deque<variant<string, uuids::uuid>> held_data;  // Fragments or payloads
+    size_t held_size;  // In bytes, including held payload content
+    mutable mutex receive_mutex;  // Serializes packages delivered to the entity
+
+    shared_ptr<ConnectionsMap> connections;
 
     /* Methods */
 
-    void printInformation(
-        string information, ostream &output_stream,
-        PrettyConsole::Color color = PrettyConsole::Color::DEFAULT) const;
+    template <typename... Arguments>
+    void log(Logger::Level level, PrettyConsole::Color color,
+             const char *format, const Arguments &...arguments) const {
+        Logger::getInstance().log(level, Logger::Category::ENTITY, this->name,
+                                  this->id, color, format, arguments...);
+    }
+
+    // Responses are built only once they are known to be sent, so no ID is
+    // generated for discarded ones
+    Package createNackPackage(shared_ptr<IdGenerator> id_generator,
+                              uuids::uuid target_entity_id,
+                              optional<Message::CodeVariant> code_variant,
+                              optional<uuids::uuid> acknowledged_id) const;
 
     optional<Package> receiveSynPackage(
-        const Package &package,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+        const Package &package, shared_ptr<IdGenerator> id_generator);
     optional<Package> receiveFinPackage(
-        const Package &package,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+        const Package &package, shared_ptr<IdGenerator> id_generator);
     optional<Package> receiveAckPackage(
-        const Package &package,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+        const Package &package, shared_ptr<IdGenerator> id_generator);
     optional<Package> receiveAckSynPackage(
         const Package &package, uuids::uuid sent_message_id,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+        shared_ptr<IdGenerator> id_generator);
     optional<Package> receiveAckAckSynPackage(
         const Package &package, uuids::uuid sent_message_id,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
-    optional<Package> receiveNackPackage(
-        const Package &package,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+        shared_ptr<IdGenerator> id_generator);
     optional<Package> receiveDataPackage(
-        const Package &package,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+        const Package &package, shared_ptr<IdGenerator> id_generator);
+    // Whether the data can be stored or held now, which is refused while too
+    // much is held already
+    bool canHoldData(const Message &message) const;
+    void storeData(const Message &message);
+    // Drops the unfinished payloads of the source, but the one given, since
+    // each source sends its data in order
+    void abandonPayloads(uuids::uuid source_entity_id,
+                         optional<uuids::uuid> kept_payload_id);
+    void abandonPayload(Reassemblies::iterator reassembly_iterator);
+    void startWritingPayload(Reassemblies::iterator reassembly_iterator);
+    // Finishes the payload once its last content is written
+    void writePayloadContent(Reassemblies::iterator reassembly_iterator,
+                             string_view content);
+    void storeHeldData();
+    void appendToStorage(string_view fragment);
 
    public:
     /* Construction */
-    Entity(uuids::uuid id, string name, ConnectFunction connect_function,
-           RemoveConnectionFunction remove_connection_function,
-           IsConnectedAtStepFunction is_connected_at_step_function,
-           CanSendPackageFunction can_send_package_function,
-           CanStoreDataFunction can_store_data_function,
-           DequeuePackageFunction dequeue_package_function)
+    Entity(uuids::uuid id, string name,
+           shared_ptr<ConnectionsMap> connections,
+           unique_ptr<Storage> storage = nullptr)
         : id(id),
           name(name),
-          storage(""),
-          connect_function(connect_function),
-          remove_connection_function(remove_connection_function),
-          is_connected_at_step_function(is_connected_at_step_function),
-          can_send_package_function(can_send_package_function),
-          can_store_data_function(can_store_data_function),
-          dequeue_package_function(dequeue_package_function) {}
+          storage(storage != nullptr ? move(storage)
+                                     : make_unique<ChunkedStorage>()),
+          held_size(0),
+          connections(connections) {}
 
     ~Entity() {}
 
@@ -128,29 +131,47 @@ class Entity {
     /* Methods */
     bool canSendMessage(uuids::uuid message_id) const;
 
-    bool sendMessage(Message message, bool should_be_confirmed);
-    optional<Package> receivePackage(
-        Package package,
-        shared_ptr<uuids::uuid_random_generator> uuid_generator);
+    bool sendMessage(const Message &message, bool should_be_confirmed);
+    optional<Package> receivePackage(const Package &package,
+                                     shared_ptr<IdGenerator> id_generator);
 
-    void printPackageInformation(Package package, ostream &output_stream,
-                                 bool is_sending) const;
+    void logPackageInformation(const Package &package, bool is_sending) const;
     void printStorage(function<void(string)> print_message) const;
+    // Visits the stored fragments, in order, while holding the entity
+    void forEachStoredFragment(
+        function<void(string_view part, bool is_fragment_end)> visit) const;
 
     /* Connection */
-    void connect(InternalConnectFunctionParameters connect_function_parameters);
-    void removeConnection(InternalRemoveConnectionFunctionParameters
-                              remove_connection_function_parameters);
-    bool isConnectedAtStep(InternalIsConnectedAtStepFunctionParameters
-                               is_connected_at_step_function_parameters) const;
-    bool canSendPackage(InternalCanSendPackageFunctionParameters
-                            can_send_package_function_parameters) const;
-    bool canStoreData(InternalCanStoreDataFunctionParameters
-                          can_store_data_function_parameters) const;
-    void dequeuePackage(InternalDequeuePackageFunctionParameters
-                            dequeue_package_function_parameters);
+    // Null when the entity is not connected to the target
+    shared_ptr<Connection> findConnection(uuids::uuid target_entity_id) const;
+    void connect(uuids::uuid target_entity_id, uuids::uuid message_id,
+                 ConnectionStep step);
+    void removeConnection(uuids::uuid target_entity_id);
+    bool isConnectedAtStep(uuids::uuid target_entity_id,
+                           ConnectionStep step) const;
+    bool canSendPackage(uuids::uuid target_entity_id) const;
 };
 
-using EntitiesList = list<shared_ptr<Entity>>;
+/*
+ * Entities indexed by their ID.
+ * Lookups only take a shared lock, so network threads can resolve entities
+ * concurrently. Insertion order is kept for printing.
+ */
+class EntitiesRegistry {
+   private:
+    mutable shared_mutex mutex;
+    unordered_map<uuids::uuid, shared_ptr<Entity>> entities;
+    vector<shared_ptr<Entity>> ordered_entities;
+
+   public:
+    /* Getters */
+    shared_ptr<Entity> find(uuids::uuid entity_id) const;
+    size_t size() const;
+
+    /* Methods */
+    bool insert(shared_ptr<Entity> entity);
+    void forEach(function<void(shared_ptr<Entity>)> visit) const;
+    void clear();
+};
 
 #endif  // _ENTITY_HPP
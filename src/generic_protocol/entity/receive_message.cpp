@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <iostream>
 #include <optional>
 
+#include "connection.hpp"
 #include "entity.hpp"
 #include "message.hpp"
 #include "package.hpp"
@@ -8,50 +10,61 @@
 using namespace std;
 
 optional<Package> Entity::receivePackage(
-    Package package, shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
+    const Package &package, shared_ptr<IdGenerator> id_generator) {
+    // Flows are processed in parallel, but an entity handles one at a time
+    lock_guard<mutex> lock(this->receive_mutex);
+    const auto &message = package.getMessage();
 
-    this->printPackageInformation(package, cout, false);
+    this->logPackageInformation(package, false);
 
-    Message error_message(uuid_generator, this->id, message.getSourceEntityId(),
-                          Message::Code::NACK, nullopt, nullopt);
-    Package error_package(error_message, false);
-
-    if (package.isCorrupted()) return error_package;
+    // The header is still readable, so the sender is told what to resend
+    if (package.isCorrupted())
+        return this->createNackPackage(
+            id_generator, message.getSourceEntityId(),
+            Message::CodeVariant::NACK_CORRUPTED, message.getId());
 
     switch (message.getCode()) {
         case Message::Code::SYN:
-            return this->receiveSynPackage(package, uuid_generator);
+            return this->receiveSynPackage(package, id_generator);
         case Message::Code::FIN:
-            return this->receiveFinPackage(package, uuid_generator);
+            return this->receiveFinPackage(package, id_generator);
         case Message::Code::ACK:
-            return this->receiveAckPackage(package, uuid_generator);
+            return this->receiveAckPackage(package, id_generator);
         case Message::Code::NACK:
-            return this->receiveNackPackage(package, uuid_generator);
+            // The network resends what it reports, so nothing is answered
+            return nullopt;
         case Message::Code::DATA:
-            return this->receiveDataPackage(package, uuid_generator);
+            return this->receiveDataPackage(package, id_generator);
     }
 
     // Received package successfully, but it cannot be processed
-    error_package.setIdFromMessageBeingAcknowledged(message.getId());
-    return error_package;
+    return this->createNackPackage(id_generator, message.getSourceEntityId(),
+                                   nullopt, message.getId());
+}
+
+Package Entity::createNackPackage(shared_ptr<IdGenerator> id_generator,
+                                  uuids::uuid target_entity_id,
+                                  optional<Message::CodeVariant> code_variant,
+                                  optional<uuids::uuid> acknowledged_id) const {
+    Message error_message(id_generator, this->id, target_entity_id,
+                          Message::Code::NACK, code_variant, acknowledged_id);
+    return Package(error_message, false);
 }
 
 optional<Package> Entity::receiveSynPackage(
-    const Package &package,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
-
-    if (!this->isConnectedAtStep(
-            // If there is no connection, create a new one
-            {message.getSourceEntityId(), ConnectionStep::SYN})) {
-        Message ack_syn_message(uuid_generator, this->id,
+    const Package &package, shared_ptr<IdGenerator> id_generator) {
+    const auto &message = package.getMessage();
+
+    // If there is no connection, create a new one
+    if (!this->isConnectedAtStep(message.getSourceEntityId(),
+                                 ConnectionStep::SYN)) {
+        Message ack_syn_message(id_generator, this->id,
                                 message.getSourceEntityId(), Message::Code::ACK,
                                 Message::CodeVariant::ACK_SYN, message.getId());
 
         // Still need to receive the ACK-ACK-SYN message
-        this->connect({message.getSourceEntityId(), message.getId(),
-                       ConnectionStep::SYN});
+        this->connect(message.getSourceEntityId(), message.getId(),
+                      ConnectionStep::SYN);
 
         return Package(ack_syn_message, true);
     }
@@ -62,145 +75,290 @@ optional<Package> Entity::receiveSynPackage(
     //         return error_response;
     // }
 
-    Message error_message(uuid_generator, this->id, message.getSourceEntityId(),
-                          Message::Code::NACK, Message::CodeVariant::NACK_SYN,
-                          message.getId());
-    Package error_package(error_message, false);
-    return error_package;
+    return this->createNackPackage(id_generator, message.getSourceEntityId(),
+                                   Message::CodeVariant::NACK_SYN,
+                                   message.getId());
 }
 
 // TODO: Implement 3-way handshake
 optional<Package> Entity::receiveFinPackage(
-    const Package &package,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
-    Message error_message(uuid_generator, this->id, message.getSourceEntityId(),
-                          Message::Code::NACK, Message::CodeVariant::NACK_FIN,
-                          message.getId());
-    Package error_package(error_message, false);
-
-    bool is_connected = this->isConnectedAtStep(
-        {message.getSourceEntityId(), ConnectionStep::SYN});
-
-    if (!is_connected) return error_package;
-
-    this->removeConnection({
-        message.getSourceEntityId(),
-    });
-
-    return Package(Message(uuid_generator, this->id,
-                           message.getSourceEntityId(), Message::Code::ACK,
-                           Message::CodeVariant::ACK_FIN, message.getId()),
+    const Package &package, shared_ptr<IdGenerator> id_generator) {
+    const auto &message = package.getMessage();
+
+    bool is_connected = this->isConnectedAtStep(message.getSourceEntityId(),
+                                                ConnectionStep::SYN);
+
+    if (!is_connected)
+        return this->createNackPackage(
+            id_generator, message.getSourceEntityId(),
+            Message::CodeVariant::NACK_FIN, message.getId());
+
+    this->removeConnection(message.getSourceEntityId());
+
+    return Package(Message(id_generator, this->id, message.getSourceEntityId(),
+                           Message::Code::ACK, Message::CodeVariant::ACK_FIN,
+                           message.getId()),
                    true);
 }
 
 optional<Package> Entity::receiveAckPackage(
-    const Package &package,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
+    const Package &package, shared_ptr<IdGenerator> id_generator) {
+    const auto &message = package.getMessage();
 
-    Message error_message(uuid_generator, this->id, message.getSourceEntityId(),
-                          Message::Code::NACK, nullopt, message.getId());
+    optional<Message::CodeVariant> error_variant = nullopt;
 
     auto variant = message.getCodeVariant();
 
     auto previously_sent_message_id =
         message.getIdFromMessageBeingAcknowledged();
 
-    if (variant.has_value()) {
-        if (previously_sent_message_id.has_value()) {
-            if (variant.value() == Message::CodeVariant::ACK_SYN)
-                return this->receiveAckSynPackage(
-                    package, previously_sent_message_id.value(),
-                    uuid_generator);
-
-            else if (variant.value() == Message::CodeVariant::ACK_ACK_SYN)
-                return this->receiveAckAckSynPackage(
-                    package, previously_sent_message_id.value(),
-                    uuid_generator);
-
-            else if (variant.value() == Message::CodeVariant::ACK_ACK_ACK_SYN)
-                return nullopt;
-
-        } else {  // Wrongfully received an ACK message
-            if (variant.value() == Message::CodeVariant::ACK_SYN)
-                error_message.setCodeVariant(
-                    Message::CodeVariant::NACK_ACK_SYN);
-
-            else if (variant.value() == Message::CodeVariant::ACK_ACK_SYN)
-                error_message.setCodeVariant(
-                    Message::CodeVariant::NACK_ACK_ACK_SYN);
-        }
+    // Acknowledgements of data are handled by the network when they arrive
+    if (!variant.has_value()) return nullopt;
+
+    if (previously_sent_message_id.has_value()) {
+        if (variant.value() == Message::CodeVariant::ACK_SYN)
+            return this->receiveAckSynPackage(
+                package, previously_sent_message_id.value(), id_generator);
+
+        else if (variant.value() == Message::CodeVariant::ACK_ACK_SYN)
+            return this->receiveAckAckSynPackage(
+                package, previously_sent_message_id.value(), id_generator);
+
+        else if (variant.value() == Message::CodeVariant::ACK_ACK_ACK_SYN)
+            return nullopt;
+
+    } else {  // Wrongfully received an ACK message
+        if (variant.value() == Message::CodeVariant::ACK_SYN)
+            error_variant = Message::CodeVariant::NACK_ACK_SYN;
+
+        else if (variant.value() == Message::CodeVariant::ACK_ACK_SYN)
+            error_variant = Message::CodeVariant::NACK_ACK_ACK_SYN;
     }
 
-    return Package(error_message, false);
+    return this->createNackPackage(id_generator, message.getSourceEntityId(),
+                                   error_variant, message.getId());
 }
 
 optional<Package> Entity::receiveAckSynPackage(
     const Package &package, uuids::uuid sent_message_id,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
+    shared_ptr<IdGenerator> id_generator) {
+    const auto &message = package.getMessage();
     Message ack_ack_syn_message(
-        uuid_generator, this->id, message.getSourceEntityId(),
-        Message::Code::ACK, Message::CodeVariant::ACK_ACK_SYN, message.getId());
+        id_generator, this->id, message.getSourceEntityId(), Message::Code::ACK,
+        Message::CodeVariant::ACK_ACK_SYN, message.getId());
 
-    this->connect({message.getSourceEntityId(), message.getId(),
-                   ConnectionStep::ACK_SYN});
+    this->connect(message.getSourceEntityId(), message.getId(),
+                  ConnectionStep::ACK_SYN);
 
     return Package(ack_ack_syn_message, true);
 }
 
 optional<Package> Entity::receiveAckAckSynPackage(
     const Package &package, uuids::uuid sent_message_id,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
+    shared_ptr<IdGenerator> id_generator) {
+    const auto &message = package.getMessage();
 
-    if (this->isConnectedAtStep(
-            {message.getSourceEntityId(), ConnectionStep::ACK_SYN})) {
+    if (this->isConnectedAtStep(message.getSourceEntityId(),
+                                ConnectionStep::ACK_SYN)) {
         // Update connection
-        this->connect({message.getSourceEntityId(), message.getId(),
-                       ConnectionStep::ACK_ACK_SYN});
+        this->connect(message.getSourceEntityId(), message.getId(),
+                      ConnectionStep::ACK_ACK_SYN);
 
-        Message ack_message(uuid_generator, this->id,
+        Message ack_message(id_generator, this->id,
                             message.getSourceEntityId(), Message::Code::ACK,
                             Message::CodeVariant::ACK_ACK_ACK_SYN,
                             message.getId());
         return Package(ack_message, false);
     }
 
-    Message error_message(uuid_generator, this->id, message.getSourceEntityId(),
-                          Message::Code::NACK,
-                          Message::CodeVariant::NACK_ACK_ACK_SYN,
-                          message.getId());
-    return Package(error_message, false);
-}
-
-// TODO: Split confirmation from received and from processed
-optional<Package> Entity::receiveNackPackage(
-    const Package &package,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    return nullopt;
+    return this->createNackPackage(id_generator, message.getSourceEntityId(),
+                                   Message::CodeVariant::NACK_ACK_ACK_SYN,
+                                   message.getId());
 }
 
 optional<Package> Entity::receiveDataPackage(
-    const Package &package,
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
-    auto message = package.getMessage();
-
-    Message error_message(uuid_generator, this->id, message.getSourceEntityId(),
-                          Message::Code::NACK, nullopt, nullopt);
-
-    if (this->canStoreData({message.getSourceEntityId(), message.getId()})) {
-        this->dequeuePackage({message.getSourceEntityId(), message.getId()});
+    const Package &package, shared_ptr<IdGenerator> id_generator) {
+    const auto &message = package.getMessage();
+
+    // Looked up once for the whole package
+    auto connection = this->findConnection(message.getSourceEntityId());
+    if (connection != nullptr && connection->canStoreData(message.getId()) &&
+        this->canHoldData(message)) {
+        this->pending_data.insert({message.getId(), message});
+        auto accepted_data = connection->acceptPackage(message.getId());
+
+        // Store every package that is now in order
+        for (auto deliverable_message_id :
+             accepted_data.deliverable_messages_ids) {
+            auto it = this->pending_data.find(deliverable_message_id);
+            if (it == this->pending_data.end()) continue;
+            this->storeData(it->second);
+            this->pending_data.erase(it);
+        }
 
-        this->storage += message.getContent() + "\n";
+        // Dequeuing signals the sender, so the data must be stored already
+        connection->dequeuePackages();
 
-        Message ack_message(uuid_generator, this->id,
+        Message ack_message(id_generator, this->id,
                             message.getSourceEntityId(), Message::Code::ACK,
                             nullopt, message.getId());
+        ack_message.setAcknowledgedRanges(
+            move(accepted_data.acknowledged_ranges));
 
         return Package(ack_message, false);
     }
 
-    return Package(error_message, false);
+    // Data out of order, or received before, repeats the acknowledgements so
+    // far without acknowledging itself, which the sender counts as duplicate
+    if (connection != nullptr) {
+        auto received_ranges = connection->getReceivedRanges();
+        if (!received_ranges.empty()) {
+            Message ack_message(id_generator, this->id,
+                                message.getSourceEntityId(),
+                                Message::Code::ACK, nullopt, nullopt);
+            ack_message.setAcknowledgedRanges(move(received_ranges));
+            return Package(ack_message, false);
+        }
+    }
+
+    return this->createNackPackage(id_generator, message.getSourceEntityId(),
+                                   nullopt, nullopt);
+}
+
+bool Entity::canHoldData(const Message &message) const {
+    if (!this->written_payload_id.has_value() ||
+        this->held_size < GenericProtocolConstants::maximum_held_data_size)
+        return true;
+
+    // Data from the source of the written payload either continues it or
+    // abandons it, so it never waits for it
+    auto it = this->reassemblies.find(this->written_payload_id.value());
+    return it == this->reassemblies.end() ||
+           it->second.source_entity_id == message.getSourceEntityId();
+}
+
+void Entity::storeData(const Message &message) {
+    auto segment = message.getSegment();
+    this->abandonPayloads(message.getSourceEntityId(),
+                          segment.has_value()
+                              ? optional<uuids::uuid>(segment->payload_id)
+                              : nullopt);
+
+    if (!segment.has_value()) {
+        if (this->written_payload_id.has_value()) {
+            this->held_data.emplace_back(string(message.getContent()));
+            this->held_size += message.getContent().size();
+        } else {
+            this->appendToStorage(message.getContent());
+        }
+        return;
+    }
+
+    auto [it, inserted] = this->reassemblies.try_emplace(
+        segment->payload_id,
+        Reassembly{message.getSourceEntityId(), segment->payload_size, 0, ""});
+    Reassembly &reassembly = it->second;
+
+    // Segments are stored in sending order, so each one follows the last
+    string_view content = message.getContent();
+    if (segment->offset != reassembly.received_size ||
+        content.size() > reassembly.payload_size - reassembly.received_size) {
+        this->log(Logger::Level::WARNING, PrettyConsole::Color::RED,
+                  "Segment [{}] does not fit its payload [{}]!",
+                  message.getId(), segment->payload_id);
+        this->abandonPayload(it);
+        return;
+    }
+    reassembly.received_size += content.size();
+
+    if (!this->written_payload_id.has_value()) {
+        this->startWritingPayload(it);
+    } else if (this->written_payload_id.value() != segment->payload_id) {
+        if (inserted) this->held_data.emplace_back(segment->payload_id);
+        reassembly.held_content += content;
+        this->held_size += content.size();
+        return;
+    }
+
+    this->writePayloadContent(it, content);
+    if (!this->written_payload_id.has_value()) this->storeHeldData();
+}
+
+void Entity::abandonPayloads(uuids::uuid source_entity_id,
+                             optional<uuids::uuid> kept_payload_id) {
+    for (auto it = this->reassemblies.begin();
+         it != this->reassemblies.end();) {
+        auto next_it = next(it);
+        if (it->second.source_entity_id == source_entity_id &&
+            it->first != kept_payload_id)
+            this->abandonPayload(it);
+        it = next_it;
+    }
+}
+
+void Entity::abandonPayload(Reassemblies::iterator reassembly_iterator) {
+    this->log(Logger::Level::WARNING, PrettyConsole::Color::RED,
+              "Payload [{}] has been abandoned after {} of {} bytes!",
+              reassembly_iterator->first,
+              reassembly_iterator->second.received_size,
+              reassembly_iterator->second.payload_size);
+
+    bool was_written = reassembly_iterator->first == this->written_payload_id;
+    this->held_size -= reassembly_iterator->second.held_content.size();
+    this->reassemblies.erase(reassembly_iterator);
+    if (!was_written) return;
+
+    // Whatever it held back can be stored now
+    this->storage->discardFragment();
+    this->written_payload_id = nullopt;
+    this->storeHeldData();
+}
+
+void Entity::startWritingPayload(Reassemblies::iterator reassembly_iterator) {
+    this->written_payload_id = reassembly_iterator->first;
+    if (!this->storage->beginFragment(reassembly_iterator->second.payload_size))
+        this->log(Logger::Level::ERROR, PrettyConsole::Color::RED,
+                  "Could not store {} bytes!",
+                  reassembly_iterator->second.payload_size);
+}
+
+void Entity::writePayloadContent(Reassemblies::iterator reassembly_iterator,
+                                 string_view content) {
+    const Reassembly &reassembly = reassembly_iterator->second;
+    if (!this->storage->appendToFragment(content))
+        this->log(Logger::Level::ERROR, PrettyConsole::Color::RED,
+                  "Could not store {} bytes!", content.size());
+    if (reassembly.received_size < reassembly.payload_size) return;
+
+    this->log(Logger::Level::INFO, PrettyConsole::Color::GREEN,
+              "Payload [{}] has been reassembled ({} bytes)",
+              reassembly_iterator->first, reassembly.payload_size);
+    this->reassemblies.erase(reassembly_iterator);
+    this->written_payload_id = nullopt;
+}
+
+void Entity::storeHeldData() {
+    while (!this->held_data.empty() && !this->written_payload_id.has_value()) {
+        auto held = move(this->held_data.front());
+        this->held_data.pop_front();
+        if (auto fragment = get_if<string>(&held)) {
+            this->held_size -= fragment->size();
+            this->appendToStorage(*fragment);
+            continue;
+        }
+
+        // Abandoned payloads are no longer reassembled
+        auto it = this->reassemblies.find(get<uuids::uuid>(held));
+        if (it == this->reassemblies.end()) continue;
+        this->startWritingPayload(it);
+        string held_content = move(it->second.held_content);
+        this->held_size -= held_content.size();
+        this->writePayloadContent(it, held_content);
+    }
+}
+
+void Entity::appendToStorage(string_view fragment) {
+    if (!this->storage->append(fragment))
+        this->log(Logger::Level::ERROR, PrettyConsole::Color::RED,
+                  "Could not store {} bytes!", fragment.size());
 }
@@ -0,0 +1,275 @@
+#include "file_storage.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+    size_t getPageSize() {
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        return page_size;
+    }
+
+    bool readAt(int descriptor, char *data, size_t data_size,
+                uint64_t offset) {
+        while (data_size > 0) {
+            ssize_t count = pread(descriptor, data, data_size, offset);
+            if (count <= 0) return false;
+            data += count;
+            data_size -= count;
+            offset += count;
+        }
+        return true;
+    }
+}  // namespace
+
+string FileStorage::durabilityToString(Durability durability) {
+    switch (durability) {
+        case Durability::NONE:
+            return "NONE";
+        case Durability::BATCH:
+            return "BATCH";
+        case Durability::FRAGMENT:
+            return "FRAGMENT";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+optional<FileStorage::Durability> FileStorage::durabilityFromString(
+    string durability) {
+    for (auto candidate :
+         {Durability::NONE, Durability::BATCH, Durability::FRAGMENT})
+        if (durabilityToString(candidate) == durability) return candidate;
+    return nullopt;
+}
+
+/* Construction */
+
+FileStorage::FileStorage(string path, int descriptor, Settings settings)
+    : path(path),
+      descriptor(descriptor),
+      settings(settings),
+      mapping(nullptr),
+      mapping_offset(0),
+      written_size(0),
+      complete_size(0),
+      fragment_remaining_size(0),
+      flushed_size(0),
+      fragments_count(0),
+      size(0),
+      has_failed(false) {
+    size_t page_size = getPageSize();
+    this->settings.mapping_size =
+        max<size_t>(1, (settings.mapping_size + page_size - 1) / page_size) *
+        page_size;
+}
+
+unique_ptr<FileStorage> FileStorage::open(string path, Settings settings) {
+    int descriptor =
+        ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0) return nullptr;
+    return unique_ptr<FileStorage>(
+        new FileStorage(path, descriptor, settings));
+}
+
+FileStorage::~FileStorage() {
+    this->unmapWindow();
+    // Drops the unused end of the last window, and any partial fragment
+    if (ftruncate(this->descriptor, this->complete_size) == 0 &&
+        this->settings.durability != Durability::NONE)
+        fdatasync(this->descriptor);
+    close(this->descriptor);
+}
+
+/* Getters */
+
+string FileStorage::getPath() const { return this->path; }
+
+size_t FileStorage::getSize() const { return this->size; }
+
+size_t FileStorage::getFragmentsCount() const {
+    return this->fragments_count;
+}
+
+bool FileStorage::hasFailed() const { return this->has_failed; }
+
+/* Methods */
+
+bool FileStorage::beginFragment(size_t fragment_size) {
+    if (this->has_failed || this->written_size != this->complete_size)
+        return false;
+
+    FragmentSize size_prefix = fragment_size;
+    if (!this->write(reinterpret_cast<const char *>(&size_prefix),
+                     sizeof(size_prefix)))
+        return this->fail();
+    this->fragment_remaining_size = fragment_size;
+    return this->appendToFragment("");  // Completes an empty fragment
+}
+
+bool FileStorage::appendToFragment(string_view part) {
+    if (this->has_failed) return false;
+    if (this->written_size == this->complete_size) return part.empty();
+    if (part.size() > this->fragment_remaining_size) return false;
+
+    if (!this->write(part.data(), part.size())) return this->fail();
+    this->fragment_remaining_size -= part.size();
+    if (this->fragment_remaining_size > 0) return true;
+
+    this->fragments_count++;
+    this->size += this->written_size - this->complete_size -
+                  sizeof(FragmentSize);
+    this->complete_size = this->written_size;
+
+    switch (this->settings.durability) {
+        case Durability::FRAGMENT:
+            return this->flush();
+        case Durability::BATCH:
+            if (this->written_size - this->flushed_size >=
+                this->settings.flush_interval)
+                return this->flush();
+            return true;
+        default:
+            return true;
+    }
+}
+
+void FileStorage::discardFragment() {
+    if (this->has_failed || this->written_size == this->complete_size) return;
+
+    // The next fragment is written over it, from a window mapped again if
+    // it started in an earlier one
+    this->written_size = this->complete_size;
+    this->flushed_size = min(this->flushed_size, this->written_size);
+    if (this->written_size < this->mapping_offset) this->unmapWindow();
+}
+
+void FileStorage::forEach(
+    function<void(string_view part, bool is_fragment_end)> visit) const {
+    // Parts are as large as a window, so reading is bounded like writing
+    readFragments(this->descriptor, this->complete_size,
+                  this->settings.mapping_size, visit);
+}
+
+bool FileStorage::flush() {
+    if (this->written_size <= this->flushed_size) return true;
+
+    bool is_flushed = true;
+    // Windows unmapped without being synchronized are only in the page cache
+    if (this->flushed_size < this->mapping_offset)
+        is_flushed = fdatasync(this->descriptor) == 0;
+    if (this->mapping != nullptr) {
+        size_t page_size = getPageSize();
+        uint64_t start = max(this->flushed_size, this->mapping_offset) -
+                         this->mapping_offset;
+        start -= start % page_size;
+        is_flushed &= msync(this->mapping + start,
+                            this->written_size - this->mapping_offset - start,
+                            MS_SYNC) == 0;
+    }
+
+    if (!is_flushed) return false;
+    this->flushed_size = this->written_size;
+    return true;
+}
+
+bool FileStorage::read(
+    string path, function<void(string_view part, bool is_fragment_end)> visit,
+    size_t part_size) {
+    int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) return false;
+
+    struct stat status;
+    bool is_read = fstat(descriptor, &status) == 0 &&
+                   readFragments(descriptor, status.st_size,
+                                 max<size_t>(part_size, 1), visit);
+    close(descriptor);
+    return is_read;
+}
+
+/* Auxiliary */
+
+bool FileStorage::fail() {
+    // The partial fragment is cut off when the file is closed
+    this->written_size = this->complete_size;
+    this->has_failed = true;
+    return false;
+}
+
+bool FileStorage::write(const char *data, size_t data_size) {
+    while (data_size > 0) {
+        uint64_t mapping_end =
+            this->mapping_offset + this->settings.mapping_size;
+        if (this->mapping == nullptr || this->written_size == mapping_end) {
+            if (!this->mapNextWindow()) return false;
+            mapping_end = this->mapping_offset + this->settings.mapping_size;
+        }
+
+        size_t count =
+            min<uint64_t>(data_size, mapping_end - this->written_size);
+        memcpy(this->mapping + (this->written_size - this->mapping_offset),
+               data, count);
+        this->written_size += count;
+        data += count;
+        data_size -= count;
+    }
+    return true;
+}
+
+bool FileStorage::mapNextWindow() {
+    // Windows are replaced once full, so the next one is page aligned, unless
+    // a discarded fragment moved back into an earlier one
+    uint64_t offset = this->written_size - this->written_size % getPageSize();
+    this->unmapWindow();
+
+    if (ftruncate(this->descriptor, offset + this->settings.mapping_size) != 0)
+        return false;
+    void *memory = mmap(nullptr, this->settings.mapping_size,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, this->descriptor,
+                        offset);
+    if (memory == MAP_FAILED) return false;
+
+    this->mapping = static_cast<char *>(memory);
+    this->mapping_offset = offset;
+    return true;
+}
+
+void FileStorage::unmapWindow() {
+    if (this->mapping == nullptr) return;
+    if (this->settings.durability != Durability::NONE) this->flush();
+    munmap(this->mapping, this->settings.mapping_size);
+    this->mapping = nullptr;
+}
+
+bool FileStorage::readFragments(
+    int descriptor, uint64_t end, size_t part_size,
+    function<void(string_view part, bool is_fragment_end)> visit) {
+    string part;  // Reused, so at most one part is held
+    uint64_t offset = 0;
+    while (end - offset >= sizeof(FragmentSize)) {
+        FragmentSize fragment_size;
+        if (!readAt(descriptor, reinterpret_cast<char *>(&fragment_size),
+                    sizeof(fragment_size), offset))
+            return false;
+        offset += sizeof(fragment_size);
+        if (fragment_size > end - offset) return false;
+
+        // An empty fragment is still visited, as one empty part
+        uint64_t fragment_end = offset + fragment_size;
+        do {
+            part.resize(min<uint64_t>(part_size, fragment_end - offset));
+            if (!readAt(descriptor, part.data(), part.size(), offset))
+                return false;
+            offset += part.size();
+            visit(part, offset == fragment_end);
+        } while (offset < fragment_end);
+    }
+    return offset == end;
+}
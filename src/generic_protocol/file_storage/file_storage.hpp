@@ -0,0 +1,95 @@
+#ifndef FILE_STORAGE_HPP_
+#define FILE_STORAGE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "storage.hpp"
+
+using namespace std;
+
+/*
+ * Append-only storage of received fragments in a file.
+ *
+ * Only a window of the file is mapped at a time. Fragments are copied into
+ * it and, once it is full, the next window is mapped in its place, so memory
+ * use is bounded by the window size however much is stored. Each fragment is
+ * preceded by its size, as a 64-bit integer, and is read back from the file.
+ * The durability decides when written data is synchronized to the disk: only
+ * when asked to, after every batch of bytes, or after each fragment.
+ */
+class FileStorage : public Storage {
+   public:
+    enum class Durability { NONE, BATCH, FRAGMENT };
+
+    struct Settings {
+        Durability durability;
+        size_t mapping_size;    // Rounded up to whole pages
+        size_t flush_interval;  // Bytes written between batches
+    };
+
+    static string durabilityToString(Durability durability);
+    static optional<Durability> durabilityFromString(string durability);
+
+   private:
+    using FragmentSize = uint64_t;
+
+    string path;
+    int descriptor;
+    Settings settings;
+    char *mapping;  // Null when no window is mapped
+    uint64_t mapping_offset;
+    uint64_t written_size;  // Including the sizes before fragments
+    uint64_t complete_size;  // Up to the end of the last complete fragment
+    uint64_t fragment_remaining_size;  // Of the fragment being written
+    uint64_t flushed_size;
+    size_t fragments_count;
+    size_t size;
+    bool has_failed;  // Nothing else is appended after a failure
+
+    FileStorage(string path, int descriptor, Settings settings);
+
+    bool write(const char *data, size_t data_size);
+    bool fail();
+    bool mapNextWindow();
+    void unmapWindow();
+    static bool readFragments(
+        int descriptor, uint64_t end, size_t part_size,
+        function<void(string_view part, bool is_fragment_end)> visit);
+
+   public:
+    /* Construction */
+    // Creates or truncates the file, returning null if it cannot be opened
+    static unique_ptr<FileStorage> open(string path, Settings settings);
+    ~FileStorage();
+    FileStorage(const FileStorage &) = delete;
+    FileStorage &operator=(const FileStorage &) = delete;
+
+    /* Getters */
+    string getPath() const;
+    size_t getSize() const override;
+    size_t getFragmentsCount() const override;
+    bool hasFailed() const;
+
+    /* Methods */
+    bool beginFragment(size_t fragment_size) override;
+    bool appendToFragment(string_view part) override;
+    void discardFragment() override;
+    void forEach(function<void(string_view part, bool is_fragment_end)> visit)
+        const override;
+    bool flush() override;
+
+    // Reads back the fragments of a file written by a storage, in parts of
+    // at most the given size
+    static bool read(
+        string path,
+        function<void(string_view part, bool is_fragment_end)> visit,
+        size_t part_size = 1024 * 1024);
+};
+
+#endif  // FILE_STORAGE_HPP_
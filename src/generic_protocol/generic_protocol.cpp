@@ -1,24 +1,30 @@
 #include "generic_protocol.hpp"
 
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <pretty_console.hpp>
 #include <sstream>
 
+#include "logger.hpp"
 #include "protocol.hpp"
+#include "simulator.hpp"
 #include "uuid.h"
 
 using namespace std;
 
-void GenericProtocol::run(
-    shared_ptr<uuids::uuid_random_generator> uuid_generator) {
+void GenericProtocol::run(shared_ptr<IdGenerator> id_generator,
+                          shared_ptr<const Configuration> configuration,
+                          bool simulate) {
     ostringstream output_stream;
 
     output_stream << "01. GENERIC PROTOCOL" << endl << endl;
     cout << output_stream.str();
     output_stream.str("");
 
-    Protocol protocol(uuid_generator, "Zircônia");
+    shared_ptr<Simulator> simulator =
+        simulate ? make_shared<Simulator>() : nullptr;
+    Protocol protocol(id_generator, "Zircônia", configuration, simulator);
 
     output_stream << "Creating entities" << endl;
     uuids::uuid entity_a = protocol.createEntity("Aroeira", output_stream);
@@ -45,6 +51,18 @@ void GenericProtocol::run(
     output_stream << "Sending messages" << endl;
     protocol.sendData(entity_a, entity_b, data_fragments, output_stream);
 
+    if (simulator != nullptr) {
+        auto simulated_time = chrono::duration_cast<chrono::milliseconds>(
+            simulator->now().time_since_epoch());
+        output_stream << "Simulated time: " << simulated_time.count()
+                      << " ms (" << simulator->getProcessedEventsCount()
+                      << " events)" << endl
+                      << endl;
+    }
+
+    // Logged events are written asynchronously, so let them finish first
+    Logger::getInstance().flush();
+
     protocol.printEntitiesStorage(output_stream);
     output_stream << endl;
     cout << output_stream.str();
@@ -1,15 +1,19 @@
 #ifndef _GENERIC_PROTOCOL_HPP
 #define _GENERIC_PROTOCOL_HPP
 
-#include <uuid.h>
-
 #include <memory>
 
+#include "configuration.hpp"
+#include "id_generator.hpp"
+
 using namespace std;
 
 class GenericProtocol {
    public:
-    static void run(shared_ptr<uuids::uuid_random_generator> uuid_generator);
+    // Simulation runs on a virtual clock instead of waiting in real time
+    static void run(shared_ptr<IdGenerator> id_generator,
+                    shared_ptr<const Configuration> configuration,
+                    bool simulate = false);
 };
 
 #endif  // _GENERIC_PROTOCOL_HPP
@@ -2,6 +2,9 @@
 #define _GENERIC_PROTOCOL_CONSTANTS_HPP
 
 #include <chrono>
+#include <cstddef>
+
+#include "congestion_control.hpp"
 
 using namespace std;
 
@@ -11,17 +14,57 @@ namespace GenericProtocolConstants {
     constexpr float packet_loss_probability = 0.5;
     constexpr float packet_corruption_probability = 0.5;
     constexpr int network_latency = 500;
+    // Bytes per second a link carries, so larger packages take longer to
+    // arrive; 0 leaves only the latency
+    constexpr size_t network_bandwidth = 0;
+
+    constexpr unsigned int processing_workers_count = 4;
+    // Most packages a worker takes from its queue at once
+    constexpr size_t processing_batch_size = 64;
+    // Packages a worker queue holds before spilling into a locked list
+    constexpr size_t processing_queue_capacity = 1024;
 
     constexpr unsigned int connection_buffer_size = 5;
+    constexpr auto congestion_control = CongestionControl::Algorithm::AIMD;
+    // The buffer size is only the initial window under congestion control
+    constexpr unsigned int maximum_congestion_window = 64;
     constexpr int max_attempts_to_send_package = 100;
     static constexpr auto resend_timeout = chrono::seconds(1);
-    constexpr int interval_to_check_unconfirmed_packages = 100;
+    // The resend timeout above is only the initial one when it is adaptive
+    constexpr bool adaptive_resend_timeout = true;
+    // Bounds of the adaptive resend timeout, which doubles up to the maximum
+    // on every expiry
+    constexpr auto minimum_resend_timeout = chrono::milliseconds(200);
+    constexpr auto maximum_resend_timeout = chrono::seconds(60);
+    // Content bytes of each package when a payload is segmented
+    constexpr size_t segment_size = 1024;
+    // Acknowledgements of data are sent for every this many packages, or
+    // once the delay has passed since the first one held back
+    constexpr unsigned int acknowledgement_frequency = 2;
+    constexpr auto acknowledgement_delay = chrono::milliseconds(40);
+    // Duplicate acknowledgements after which a package is retransmitted
+    // before its resend timeout expires
+    constexpr unsigned int fast_retransmit_threshold = 3;
+    constexpr auto retransmission_timer_tick = chrono::milliseconds(1);
+    constexpr size_t retransmission_timer_slots = 4096;
+
+    // Received data is kept in chunks of this many bytes
+    constexpr size_t storage_chunk_size = 64 * 1024;
+    // Stored in files instead, when there is a storage directory, of which
+    // a window of this many bytes is mapped at a time
+    constexpr size_t storage_mapping_size = 1024 * 1024;
+    // Bytes written between synchronizations in batches
+    constexpr size_t storage_flush_interval = 256 * 1024;
+    // Bytes an entity holds in memory while a payload is written; data from
+    // other sources is refused beyond them, until the payload is complete
+    constexpr size_t maximum_held_data_size = 16 * 1024 * 1024;
 
-    constexpr auto interval_to_check_connections = chrono::seconds(1);
-    constexpr unsigned int max_attempts_to_connect = 100;
+    // Waits without progress before giving up, long enough for a few resend
+    // timeouts backed off to the maximum, as in RFC 1122 (R2)
+    constexpr auto connection_timeout = chrono::seconds(180);
+    constexpr auto send_data_timeout = chrono::seconds(900);
 
-    constexpr auto interval_to_send_data = chrono::seconds(1);
-    constexpr unsigned int max_attempts_to_send_data = 100;
+    constexpr auto metrics_export_interval = chrono::seconds(1);
 }  // namespace GenericProtocolConstants
 
 #endif  // _GENERIC_PROTOCOL_CONSTANTS_HPP
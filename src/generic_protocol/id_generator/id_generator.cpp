@@ -0,0 +1,64 @@
+#include "id_generator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+atomic<uint64_t> IdGenerator::next_sequence_block{0};
+
+/* Auxiliary */
+
+IdGenerator::ThreadState::ThreadState()
+    : next_sequence(0), sequence_block_end(0), last_timestamp(0) {}
+
+IdGenerator::ThreadState &IdGenerator::getThreadState() {
+    thread_local ThreadState state;
+    return state;
+}
+
+uint64_t IdGenerator::getProcessSalt() {
+    static const uint64_t salt = []() {
+        random_device random_device;
+        return (static_cast<uint64_t>(random_device()) << 32 |
+                random_device()) &
+               ((1ull << 22) - 1);
+    }();
+    return salt;
+}
+
+uint64_t IdGenerator::reserveSequence(ThreadState &state) {
+    if (state.next_sequence == state.sequence_block_end) {
+        uint64_t block = next_sequence_block.fetch_add(1, memory_order_relaxed);
+        state.next_sequence = block * sequence_block_size;
+        state.sequence_block_end = state.next_sequence + sequence_block_size;
+    }
+    return state.next_sequence++;
+}
+
+/* Methods */
+
+uuids::uuid IdGenerator::generate() {
+    ThreadState &state = getThreadState();
+
+    uint64_t timestamp = chrono::duration_cast<chrono::milliseconds>(
+                             chrono::system_clock::now().time_since_epoch())
+                             .count();
+    state.last_timestamp = max(timestamp, state.last_timestamp);
+    uint64_t sequence = reserveSequence(state) & ((1ull << 52) - 1);
+
+    // The sequence follows the timestamp, so it orders IDs of the same
+    // millisecond
+    uint64_t high = (state.last_timestamp & ((1ull << 48) - 1)) << 16 |
+                    0x7000 | sequence >> 40;
+    uint64_t low = 0x8000000000000000ull |
+                   (sequence & ((1ull << 40) - 1)) << 22 | getProcessSalt();
+
+    array<uint8_t, 16> bytes;
+    for (size_t i = 0; i < 8; i++) {
+        bytes[i] = static_cast<uint8_t>(high >> (56 - 8 * i));
+        bytes[8 + i] = static_cast<uint8_t>(low >> (56 - 8 * i));
+    }
+    return uuids::uuid(bytes.begin(), bytes.end());
+}
@@ -0,0 +1,57 @@
+#ifndef ID_GENERATOR_HPP_
+#define ID_GENERATOR_HPP_
+
+#include <uuid.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+/*
+ * Thread-safe source of time-ordered message IDs, laid out like UUIDv7 with
+ * a counter in place of the random bits (RFC 9562, method 1):
+ *
+ *   48 bits  Unix time in milliseconds
+ *    4 bits  version (7)
+ *   12 bits  sequence number, high bits
+ *    2 bits  variant
+ *   40 bits  sequence number, low bits
+ *   22 bits  random, fixed for the process
+ *
+ * Each thread reserves sequence numbers in blocks, so only one atomic
+ * increment is shared per block. IDs of a thread always increase, even
+ * inside the same millisecond or if the clock goes back; IDs of different
+ * threads are ordered by their millisecond.
+ */
+class IdGenerator {
+   public:
+    static constexpr uint64_t sequence_block_size = 1024;
+
+   private:
+    struct ThreadState {
+        uint64_t next_sequence;
+        uint64_t sequence_block_end;
+        uint64_t last_timestamp;
+
+        ThreadState();
+    };
+
+    static atomic<uint64_t> next_sequence_block;
+
+    static ThreadState &getThreadState();
+    static uint64_t getProcessSalt();
+    static uint64_t reserveSequence(ThreadState &state);
+
+   public:
+    /* Construction */
+    IdGenerator() {}
+    ~IdGenerator() {}
+
+    /* Methods */
+    uuids::uuid generate();
+    uuids::uuid operator()() { return this->generate(); }
+};
+
+#endif  // ID_GENERATOR_HPP_
@@ -0,0 +1,323 @@
+#include "logger.hpp"
+
+#include <iostream>
+
+#include "generic_protocol_constants.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+/* Short text */
+
+Logger::ShortText::ShortText(string_view text) {
+    size_t text_length = min(text.size(), short_text_size);
+    // Do not split a multi-byte character
+    if (text_length < text.size())
+        while (text_length > 0 &&
+               (static_cast<uint8_t>(text[text_length]) & 0xC0) == 0x80)
+            text_length--;
+
+    copy_n(text.begin(), text_length, this->characters.begin());
+    this->length = text_length;
+}
+
+string_view Logger::ShortText::getView() const {
+    return string_view(this->characters.data(), this->length);
+}
+
+/* Construction */
+
+Logger::Logger()
+    : minimum_level(static_cast<int>(GenericProtocolConstants::debug_information
+                                         ? Level::DEBUG
+                                         : Level::WARNING)),
+      dropped_records_count(0),
+      removed_records_count(0),
+      can_stop_writing_thread(false),
+      pushed_records_count(0),
+      written_records_count(0),
+      reported_dropped_records_count(0) {
+    for (auto &is_enabled : this->enabled_categories) is_enabled = true;
+}
+
+Logger::~Logger() {
+    this->can_stop_writing_thread = true;
+    this->pushed_records_count++;
+    this->pushed_records_count.notify_one();
+    if (this->writing_thread.joinable()) this->writing_thread.join();
+}
+
+Logger::RingHolder::~RingHolder() {
+    if (this->ring != nullptr) this->ring->is_abandoned = true;
+}
+
+Logger &Logger::getInstance() {
+    static Logger logger;
+    return logger;
+}
+
+/* Getters */
+
+bool Logger::isEnabled(Level level, Category category) const {
+    if (static_cast<int>(level) <
+        this->minimum_level.load(memory_order_relaxed))
+        return false;
+    return this->enabled_categories[static_cast<size_t>(category)].load(
+        memory_order_relaxed);
+}
+
+uint64_t Logger::getDroppedRecordsCount() const {
+    return this->dropped_records_count.load(memory_order_relaxed);
+}
+
+/* Setters */
+
+void Logger::setMinimumLevel(Level level) {
+    this->minimum_level.store(static_cast<int>(level), memory_order_relaxed);
+}
+
+void Logger::setCategoryEnabled(Category category, bool is_enabled) {
+    this->enabled_categories[static_cast<size_t>(category)].store(
+        is_enabled, memory_order_relaxed);
+}
+
+/* Methods */
+
+Logger::Ring &Logger::getThreadRing() {
+    thread_local RingHolder holder;
+    if (holder.ring == nullptr) {
+        holder.ring = make_shared<Ring>();
+        lock_guard<mutex> lock(this->rings_mutex);
+        this->rings.push_back(holder.ring);
+    }
+    return *holder.ring;
+}
+
+void Logger::push(const Record &record) {
+    call_once(this->writing_thread_started, [this]() {
+        this->writing_thread = thread([this]() { this->writingThreadJob(); });
+    });
+    Ring &ring = this->getThreadRing();
+
+    uint64_t tail = ring.tail.load(memory_order_relaxed);
+    if (tail - ring.head.load(memory_order_acquire) == ring_capacity) {
+        this->dropped_records_count.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    (*ring.records)[tail % ring_capacity] = record;
+    ring.tail.store(tail + 1, memory_order_release);
+
+    this->pushed_records_count++;
+    this->pushed_records_count.notify_one();
+}
+
+void Logger::flush() {
+    uint64_t pushed_records_count;
+    {
+        lock_guard<mutex> lock(this->rings_mutex);
+        pushed_records_count = this->removed_records_count;
+        for (const auto &ring : this->rings)
+            pushed_records_count += ring->tail.load(memory_order_acquire);
+    }
+
+    unique_lock<mutex> lock(this->written_mutex);
+    this->records_written_cv.wait(lock, [this, pushed_records_count]() {
+        return this->written_records_count >= pushed_records_count;
+    });
+}
+
+size_t Logger::drainRings(vector<Record> &records) {
+    lock_guard<mutex> lock(this->rings_mutex);
+
+    size_t first_record = records.size();
+    for (const auto &ring : this->rings) {
+        uint64_t head = ring->head.load(memory_order_relaxed);
+        uint64_t tail = ring->tail.load(memory_order_acquire);
+        for (; head < tail; head++)
+            records.push_back((*ring->records)[head % ring_capacity]);
+        ring->head.store(head, memory_order_release);
+    }
+
+    // Rings of finished threads are dropped once nothing is left in them
+    erase_if(this->rings, [this](const shared_ptr<Ring> &ring) {
+        if (!ring->is_abandoned ||
+            ring->head.load(memory_order_relaxed) !=
+                ring->tail.load(memory_order_acquire))
+            return false;
+        this->removed_records_count += ring->tail.load(memory_order_relaxed);
+        return true;
+    });
+
+    // Each ring is already in order, so a stable sort merges them by time
+    stable_sort(records.begin() + first_record, records.end(),
+                [](const Record &lhs, const Record &rhs) {
+                    return lhs.time < rhs.time;
+                });
+    return records.size() - first_record;
+}
+
+void Logger::writingThreadJob() {
+    vector<Record> records;
+    while (true) {
+        // Read before draining, so a push that comes after it ends the wait
+        uint64_t pushed_records_count = this->pushed_records_count.load();
+        bool can_stop = this->can_stop_writing_thread.load();
+
+        records.clear();
+        size_t drained_records_count = this->drainRings(records);
+        for (const Record &record : records) this->writeRecord(record);
+        this->reportDroppedRecords();
+
+        if (drained_records_count > 0) {
+            {
+                lock_guard<mutex> lock(this->written_mutex);
+                this->written_records_count += drained_records_count;
+            }
+            this->records_written_cv.notify_all();
+        }
+
+        // Stopping only after a full pass writes what was pushed before it
+        if (can_stop) break;
+        if (drained_records_count == 0)
+            this->pushed_records_count.wait(pushed_records_count);
+    }
+}
+
+void Logger::writeRecord(const Record &record) const {
+    string header;
+    PrettyConsole::Decoration header_decoration;
+    switch (record.category) {
+        case Category::NETWORK:
+            header = "Network ";
+            header_decoration = {PrettyConsole::Color::BLACK,
+                                 PrettyConsole::Color::YELLOW,
+                                 PrettyConsole::Format::BOLD};
+            break;
+        case Category::ENTITY:
+            header = "Entity ";
+            header_decoration = {PrettyConsole::Color::WHITE,
+                                 PrettyConsole::Color::CYAN,
+                                 PrettyConsole::Format::BOLD};
+            break;
+        case Category::CONNECTION:
+            header = "Connection ";
+            header_decoration = {PrettyConsole::Color::WHITE,
+                                 PrettyConsole::Color::BLUE,
+                                 PrettyConsole::Format::BOLD};
+            break;
+        case Category::PROTOCOL:
+            header = "Protocol ";
+            header_decoration = {PrettyConsole::Color::WHITE,
+                                 PrettyConsole::Color::MAGENTA,
+                                 PrettyConsole::Format::BOLD};
+            break;
+    }
+    header += record.header_name.getView();
+    if (record.header_id.has_value())
+        header += " [" + uuids::to_string(record.header_id.value()) + "]";
+
+    ostream &output_stream = record.level == Level::ERROR ? cerr : cout;
+    Util::printInformation(header, formatRecord(record), output_stream,
+                           header_decoration,
+                           PrettyConsole::Decoration(record.color));
+}
+
+void Logger::reportDroppedRecords() {
+    uint64_t dropped_records_count = this->getDroppedRecordsCount();
+    if (dropped_records_count == this->reported_dropped_records_count) return;
+
+    Util::printInformation(
+        "Logger",
+        to_string(dropped_records_count -
+                  this->reported_dropped_records_count) +
+            " records have been dropped, since their ring was full",
+        cerr,
+        {PrettyConsole::Color::WHITE, PrettyConsole::Color::RED,
+         PrettyConsole::Format::BOLD},
+        PrettyConsole::Decoration(PrettyConsole::Color::RED));
+    this->reported_dropped_records_count = dropped_records_count;
+}
+
+/* Auxiliary */
+
+Logger::Argument Logger::makeArgument(uuids::uuid argument) {
+    return argument;
+}
+
+Logger::Argument Logger::makeArgument(string_view argument) {
+    return ShortText(argument);
+}
+
+Logger::Argument Logger::makeArgument(const string &argument) {
+    return ShortText(argument);
+}
+
+Logger::Argument Logger::makeArgument(const char *argument) {
+    return ShortText(argument);
+}
+
+Logger::Argument Logger::makeArgument(bool argument) {
+    return ShortText(Util::getFormattedBool(argument));
+}
+
+string Logger::formatArgument(const Argument &argument) {
+    if (auto id = get_if<uuids::uuid>(&argument))
+        return uuids::to_string(*id);
+    if (auto number = get_if<int64_t>(&argument)) return to_string(*number);
+    if (auto text = get_if<ShortText>(&argument))
+        return string(text->getView());
+    return "";
+}
+
+string Logger::formatRecord(const Record &record) {
+    string formatted;
+    string_view format(record.format);
+    size_t argument_index = 0;
+
+    size_t position = 0;
+    while (true) {
+        size_t placeholder = format.find("{}", position);
+        if (placeholder == string_view::npos ||
+            argument_index == max_arguments) {
+            formatted += format.substr(position);
+            break;
+        }
+        formatted += format.substr(position, placeholder - position);
+        formatted += formatArgument(record.arguments[argument_index++]);
+        position = placeholder + 2;
+    }
+    return formatted;
+}
+
+/* Static methods */
+
+string Logger::levelToString(Level level) {
+    switch (level) {
+        case Level::DEBUG:
+            return "DEBUG";
+        case Level::INFO:
+            return "INFO";
+        case Level::WARNING:
+            return "WARNING";
+        case Level::ERROR:
+            return "ERROR";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+string Logger::categoryToString(Category category) {
+    switch (category) {
+        case Category::NETWORK:
+            return "NETWORK";
+        case Category::ENTITY:
+            return "ENTITY";
+        case Category::CONNECTION:
+            return "CONNECTION";
+        case Category::PROTOCOL:
+            return "PROTOCOL";
+        default:
+            return "UNKNOWN";
+    }
+}
@@ -0,0 +1,173 @@
+#ifndef LOGGER_HPP_
+#define LOGGER_HPP_
+
+#include <uuid.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <pretty_console.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Asynchronous structured logger.
+ *
+ * Producers copy a compact record, made of a format literal and its raw
+ * arguments, into a ring owned by their thread. A background thread drains
+ * every ring and does the formatting and console output. Records that do not
+ * fit in a full ring are dropped and counted, so producers never block. The
+ * background thread starts with the first record and sleeps while there is
+ * nothing to write.
+ */
+class Logger {
+   public:
+    enum class Level { DEBUG, INFO, WARNING, ERROR };
+    enum class Category { NETWORK, ENTITY, CONNECTION, PROTOCOL };
+
+    static constexpr size_t categories_count = 4;
+    static constexpr size_t ring_capacity = 2048;
+    static constexpr size_t max_arguments = 6;
+    static constexpr size_t short_text_size = 40;
+
+    // Text copied into a record, truncated to a whole UTF-8 character
+    struct ShortText {
+        array<char, short_text_size> characters;
+        uint8_t length;
+
+        ShortText(string_view text = "");
+        string_view getView() const;
+    };
+
+    using Argument = variant<monostate, uuids::uuid, int64_t, ShortText>;
+
+    struct Record {
+        chrono::steady_clock::time_point time;
+        Level level;
+        Category category;
+        PrettyConsole::Color color;
+        ShortText header_name;
+        optional<uuids::uuid> header_id;
+        const char *format;  // Must be a literal, since only the pointer is
+                             // kept; each {} takes the next argument
+        array<Argument, max_arguments> arguments;
+    };
+
+   private:
+    // Single producer, single consumer
+    struct Ring {
+        unique_ptr<array<Record, ring_capacity>> records;
+        atomic<uint64_t> head;  // Next record to be read
+        atomic<uint64_t> tail;  // Next record to be written
+        atomic<bool> is_abandoned;
+
+        Ring()
+            : records(make_unique<array<Record, ring_capacity>>()),
+              head(0),
+              tail(0),
+              is_abandoned(false) {}
+    };
+
+    // Marks the ring of a finished thread, so it is removed once drained
+    struct RingHolder {
+        shared_ptr<Ring> ring;
+        ~RingHolder();
+    };
+
+    atomic<int> minimum_level;
+    array<atomic<bool>, categories_count> enabled_categories;
+    atomic<uint64_t> dropped_records_count;
+
+    mutex rings_mutex;
+    vector<shared_ptr<Ring>> rings;
+    uint64_t removed_records_count;  // Written records of removed rings
+
+    once_flag writing_thread_started;
+    thread writing_thread;
+    atomic<bool> can_stop_writing_thread;
+    atomic<uint64_t> pushed_records_count;  // Waited on by the writing thread
+    mutex written_mutex;
+    condition_variable records_written_cv;
+    uint64_t written_records_count;
+    uint64_t reported_dropped_records_count;
+
+    /* Construction */
+    Logger();
+
+    /* Methods */
+    Ring &getThreadRing();
+    void push(const Record &record);
+    void writingThreadJob();
+    size_t drainRings(vector<Record> &records);
+    void writeRecord(const Record &record) const;
+    void reportDroppedRecords();
+
+    static Argument makeArgument(uuids::uuid argument);
+    static Argument makeArgument(string_view argument);
+    static Argument makeArgument(const string &argument);
+    static Argument makeArgument(const char *argument);
+    static Argument makeArgument(bool argument);
+    template <typename Integer>
+        requires is_integral_v<Integer>
+    static Argument makeArgument(Integer argument) {
+        return static_cast<int64_t>(argument);
+    }
+
+    static string formatArgument(const Argument &argument);
+    static string formatRecord(const Record &record);
+
+   public:
+    ~Logger();
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    static Logger &getInstance();
+
+    /* Getters */
+    bool isEnabled(Level level, Category category) const;
+    uint64_t getDroppedRecordsCount() const;
+
+    /* Setters */
+    void setMinimumLevel(Level level);
+    void setCategoryEnabled(Category category, bool is_enabled);
+
+    /* Methods */
+    template <typename... Arguments>
+    void log(Level level, Category category, string_view header_name,
+             optional<uuids::uuid> header_id, PrettyConsole::Color color,
+             const char *format, const Arguments &...arguments) {
+        static_assert(sizeof...(Arguments) <= max_arguments,
+                      "Too many arguments for a log record");
+        if (!this->isEnabled(level, category)) return;
+
+        Record record{chrono::steady_clock::now(),
+                      level,
+                      category,
+                      color,
+                      ShortText(header_name),
+                      header_id,
+                      format,
+                      {makeArgument(arguments)...}};
+        this->push(record);
+    }
+
+    // Blocks until every record pushed so far has been written
+    void flush();
+
+    /* Static methods */
+    static string levelToString(Level level);
+    static string categoryToString(Category category);
+};
+
+#endif  // LOGGER_HPP_
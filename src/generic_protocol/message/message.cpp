@@ -45,6 +45,8 @@ string Message::codeVariantToString(Message::CodeVariant code_variant) {
             return "NACK_ACK_ACK_SYN";
         case Message::CodeVariant::NACK_FIN:
             return "NACK_FIN";
+        case Message::CodeVariant::NACK_CORRUPTED:
+            return "NACK_CORRUPTED";
         default:
             return "UNKNOWN";
     }
@@ -72,7 +74,19 @@ optional<uuids::uuid> Message::getIdFromMessageBeingAcknowledged() const {
     return this->id_from_message_being_acknowledged;
 }
 
-string Message::getContent() const { return this->content; }
+const vector<Message::SequenceRange> &Message::getAcknowledgedRanges() const {
+    static const vector<SequenceRange> no_acknowledged_ranges;
+    return this->acknowledged_ranges != nullptr ? *this->acknowledged_ranges
+                                                : no_acknowledged_ranges;
+}
+
+optional<Message::Segment> Message::getSegment() const {
+    return this->segment;
+}
+
+const Payload &Message::getPayload() const { return this->content; }
+
+string_view Message::getContent() const { return this->content.getView(); }
 
 /* Setters */
 
@@ -84,6 +98,21 @@ void Message::setIdFromMessageBeingAcknowledged(uuids::uuid id_from_message) {
     this->id_from_message_being_acknowledged = id_from_message;
 }
 
+void Message::setAcknowledgedRanges(
+    vector<SequenceRange> acknowledged_ranges) {
+    this->acknowledged_ranges =
+        acknowledged_ranges.empty()
+            ? nullptr
+            : make_shared<const vector<SequenceRange>>(
+                  move(acknowledged_ranges));
+}
+
+void Message::shareAcknowledgedRanges(const Message &message) {
+    this->acknowledged_ranges = message.acknowledged_ranges;
+}
+
+void Message::setSegment(Segment segment) { this->segment = segment; }
+
 /* Methods */
 
 void Message::print(std::function<void(std::string)> print_information) const {
@@ -103,8 +132,20 @@ void Message::print(std::function<void(std::string)> print_information) const {
              ? uuids::to_string(
                    this->getIdFromMessageBeingAcknowledged().value())
              : "NONE"));
+    if (!this->getAcknowledgedRanges().empty()) {
+        string ranges;
+        for (const auto &range : this->getAcknowledgedRanges())
+            ranges += " [" + to_string(range.first) + ", " +
+                      to_string(range.last) + "]";
+        print_information("Acknowledged ranges:" + ranges);
+    }
+    if (this->segment.has_value())
+        print_information(
+            "Segment: " + to_string(this->segment->offset) + " of " +
+            to_string(this->segment->payload_size) + " bytes of payload " +
+            uuids::to_string(this->segment->payload_id));
     print_information("=== BEGIN ===");
-    std::istringstream content_stream(this->getContent());
+    std::istringstream content_stream(this->content.toString());
     std::string line;
     while (std::getline(content_stream, line)) {
         print_information(line);
@@ -3,8 +3,16 @@
 
 #include <uuid.h>
 
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "id_generator.hpp"
+#include "payload.hpp"
 
 using namespace std;
 
@@ -23,6 +31,20 @@ class Message {
         NACK_ACK_SYN,
         NACK_ACK_ACK_SYN,
         NACK_FIN,
+        NACK_CORRUPTED,  // Asks for the acknowledged message again
+    };
+
+    // Inclusive range of sequence numbers acknowledged at once
+    struct SequenceRange {
+        unsigned int first;
+        unsigned int last;
+    };
+
+    // Part of a payload split by the sender, reassembled by the receiver
+    struct Segment {
+        uuids::uuid payload_id;
+        size_t offset;
+        size_t payload_size;
     };
 
     static string codeToString(Code code);
@@ -35,30 +57,44 @@ class Message {
     Code code;
     optional<CodeVariant> code_variant;
     optional<uuids::uuid> id_from_message_being_acknowledged;
-    string content;
+    // Shared by copies, like the content; null when there are none
+    shared_ptr<const vector<SequenceRange>> acknowledged_ranges;
+    optional<Segment> segment;
+    Payload content;
 
    public:
     /* Construction */
-    Message(shared_ptr<uuids::uuid_random_generator> uuid_generator,
-            uuids::uuid source_entity_id, uuids::uuid target_entity_id,
-            Code code, optional<CodeVariant> code_variant,
+    Message(uuids::uuid id, uuids::uuid source_entity_id,
+            uuids::uuid target_entity_id, Code code,
+            optional<CodeVariant> code_variant,
             optional<uuids::uuid> id_from_message_being_acknowledged,
-            string content)
-        : id(uuid_generator->operator()()),
+            Payload content)
+        : id(id),
           source_entity_id(source_entity_id),
           target_entity_id(target_entity_id),
           code(code),
           code_variant(code_variant),
           id_from_message_being_acknowledged(
               id_from_message_being_acknowledged),
+          segment(nullopt),
           content(content) {}
 
-    Message(shared_ptr<uuids::uuid_random_generator> uuid_generator,
-            uuids::uuid source_entity_id, uuids::uuid target_entity_id,
+    Message(shared_ptr<IdGenerator> id_generator, uuids::uuid source_entity_id,
+            uuids::uuid target_entity_id, Code code,
+            optional<CodeVariant> code_variant,
+            optional<uuids::uuid> id_from_message_being_acknowledged,
+            Payload content)
+        : Message(id_generator->generate(), source_entity_id,
+                  target_entity_id, code, code_variant,
+                  id_from_message_being_acknowledged, content) {}
+
+    Message(shared_ptr<IdGenerator> id_generator, uuids::uuid source_entity_id,
+            uuids::uuid target_entity_id,
             Code code, optional<CodeVariant> code_variant,
             optional<uuids::uuid> id_from_message_being_acknowledged)
-        : Message(uuid_generator, source_entity_id, target_entity_id, code,
-                  code_variant, id_from_message_being_acknowledged, "") {}
+        : Message(id_generator, source_entity_id, target_entity_id, code,
+                  code_variant, id_from_message_being_acknowledged,
+                  Payload()) {}
 
     ~Message() {}
 
@@ -69,11 +105,19 @@ class Message {
     Code getCode() const;
     optional<CodeVariant> getCodeVariant() const;
     optional<uuids::uuid> getIdFromMessageBeingAcknowledged() const;
-    string getContent() const;
+    const vector<SequenceRange> &getAcknowledgedRanges() const;
+    optional<Segment> getSegment() const;
+    const Payload &getPayload() const;
+    // Valid while the message, or any copy of its payload, exists
+    string_view getContent() const;
 
     /* Setters */
     void setCodeVariant(CodeVariant code_variant);
     void setIdFromMessageBeingAcknowledged(uuids::uuid id_from_message);
+    void setAcknowledgedRanges(vector<SequenceRange> acknowledged_ranges);
+    // Carries the ranges of the message without copying them
+    void shareAcknowledgedRanges(const Message &message);
+    void setSegment(Segment segment);
 
     /* Methods */
     void print(function<void(string)> print_message) const;
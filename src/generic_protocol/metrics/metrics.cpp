@@ -0,0 +1,355 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    // Spreads threads over the shards of every counter
+    size_t getThreadShard() {
+        static atomic<size_t> next_shard(0);
+        thread_local size_t shard =
+            next_shard.fetch_add(1, memory_order_relaxed) %
+            Metrics::counter_shards_count;
+        return shard;
+    }
+
+    string escape(string text) {
+        string escaped;
+        for (char character : text) {
+            if (character == '\\' || character == '"') escaped += '\\';
+            if (character == '\n') {
+                escaped += "\\n";
+                continue;
+            }
+            escaped += character;
+        }
+        return escaped;
+    }
+
+    string formatNumber(double number) {
+        ostringstream stream;
+        stream << number;
+        return stream.str();
+    }
+}  // namespace
+
+/* Counter */
+
+void Metrics::Counter::increment(uint64_t amount) {
+    this->shards[getThreadShard()].value.fetch_add(amount,
+                                                   memory_order_relaxed);
+}
+
+uint64_t Metrics::Counter::getValue() const {
+    uint64_t value = 0;
+    for (const auto &shard : this->shards)
+        value += shard.value.load(memory_order_relaxed);
+    return value;
+}
+
+/* Gauge */
+
+void Metrics::Gauge::set(int64_t value) {
+    this->value.store(value, memory_order_relaxed);
+}
+
+void Metrics::Gauge::add(int64_t amount) {
+    this->value.fetch_add(amount, memory_order_relaxed);
+}
+
+int64_t Metrics::Gauge::getValue() const {
+    return this->value.load(memory_order_relaxed);
+}
+
+/* Histogram */
+
+Metrics::Histogram::Histogram(vector<double> bounds)
+    : bounds(bounds),
+      buckets(make_unique<atomic<uint64_t>[]>(bounds.size() + 1)),
+      count(0),
+      sum(0) {
+    sort(this->bounds.begin(), this->bounds.end());
+    for (size_t i = 0; i <= this->bounds.size(); i++) this->buckets[i] = 0;
+}
+
+void Metrics::Histogram::observe(double value) {
+    size_t bucket =
+        lower_bound(this->bounds.begin(), this->bounds.end(), value) -
+        this->bounds.begin();
+    this->buckets[bucket].fetch_add(1, memory_order_relaxed);
+    this->count.fetch_add(1, memory_order_relaxed);
+    this->sum.fetch_add(value, memory_order_relaxed);
+}
+
+const vector<double> &Metrics::Histogram::getBounds() const {
+    return this->bounds;
+}
+
+vector<uint64_t> Metrics::Histogram::getBucketCounts() const {
+    vector<uint64_t> bucket_counts;
+    for (size_t i = 0; i <= this->bounds.size(); i++)
+        bucket_counts.push_back(this->buckets[i].load(memory_order_relaxed));
+    return bucket_counts;
+}
+
+uint64_t Metrics::Histogram::getCount() const {
+    return this->count.load(memory_order_relaxed);
+}
+
+double Metrics::Histogram::getSum() const {
+    return this->sum.load(memory_order_relaxed);
+}
+
+/* Construction */
+
+Metrics::Metrics(string prefix)
+    : prefix(prefix), can_stop_exporting_thread(false) {}
+
+Metrics::~Metrics() { this->stopPeriodicExport(); }
+
+/* Methods */
+
+Metrics::Counter &Metrics::getCounter(string name, string help,
+                                      Labels labels) {
+    Series &series =
+        this->findOrCreateSeries(name, help, Type::COUNTER, labels);
+    return *series.counter;
+}
+
+Metrics::Gauge &Metrics::getGauge(string name, string help, Labels labels) {
+    Series &series = this->findOrCreateSeries(name, help, Type::GAUGE, labels);
+    return *series.gauge;
+}
+
+Metrics::Histogram &Metrics::getHistogram(string name, string help,
+                                          vector<double> bounds,
+                                          Labels labels) {
+    Series &series =
+        this->findOrCreateSeries(name, help, Type::HISTOGRAM, labels, bounds);
+    return *series.histogram;
+}
+
+string Metrics::toPrometheus() const {
+    lock_guard<mutex> lock(this->families_mutex);
+
+    ostringstream output;
+    for (const auto &[family_name, family] : this->families) {
+        string name = this->prefix + "_" + family_name;
+        output << "# HELP " << name << " " << family.help << "\n"
+               << "# TYPE " << name << " " << typeToString(family.type)
+               << "\n";
+
+        for (const auto &[labels, series] : family.series) {
+            switch (family.type) {
+                case Type::COUNTER:
+                    output << name << formatLabels(labels) << " "
+                           << series.counter->getValue() << "\n";
+                    break;
+                case Type::GAUGE:
+                    output << name << formatLabels(labels) << " "
+                           << series.gauge->getValue() << "\n";
+                    break;
+                case Type::HISTOGRAM: {
+                    const auto &bounds = series.histogram->getBounds();
+                    auto bucket_counts = series.histogram->getBucketCounts();
+                    uint64_t cumulative_count = 0;
+                    for (size_t i = 0; i < bucket_counts.size(); i++) {
+                        cumulative_count += bucket_counts[i];
+                        string bound = i < bounds.size()
+                                           ? formatNumber(bounds[i])
+                                           : "+Inf";
+                        output << name << "_bucket"
+                               << formatLabels(labels, bound) << " "
+                               << cumulative_count << "\n";
+                    }
+                    output << name << "_sum" << formatLabels(labels) << " "
+                           << formatNumber(series.histogram->getSum()) << "\n"
+                           << name << "_count" << formatLabels(labels) << " "
+                           << series.histogram->getCount() << "\n";
+                    break;
+                }
+            }
+        }
+    }
+    return output.str();
+}
+
+string Metrics::toJson() const {
+    lock_guard<mutex> lock(this->families_mutex);
+
+    ostringstream output;
+    output << "{\"metrics\": [";
+    bool is_first_family = true;
+    for (const auto &[family_name, family] : this->families) {
+        string name = this->prefix + "_" + family_name;
+        output << (is_first_family ? "\n" : ",\n") << "  {\"name\": \""
+               << escape(name) << "\", \"type\": \""
+               << typeToString(family.type) << "\", \"help\": \""
+               << escape(family.help) << "\", \"series\": [";
+        is_first_family = false;
+
+        bool is_first_series = true;
+        for (const auto &[labels, series] : family.series) {
+            output << (is_first_series ? "\n" : ",\n") << "    {\"labels\": {";
+            is_first_series = false;
+            for (size_t i = 0; i < labels.size(); i++)
+                output << (i > 0 ? ", " : "") << "\"" << escape(labels[i].first)
+                       << "\": \"" << escape(labels[i].second) << "\"";
+            output << "}, ";
+
+            switch (family.type) {
+                case Type::COUNTER:
+                    output << "\"value\": " << series.counter->getValue();
+                    break;
+                case Type::GAUGE:
+                    output << "\"value\": " << series.gauge->getValue();
+                    break;
+                case Type::HISTOGRAM: {
+                    const auto &bounds = series.histogram->getBounds();
+                    auto bucket_counts = series.histogram->getBucketCounts();
+                    output << "\"buckets\": [";
+                    for (size_t i = 0; i < bucket_counts.size(); i++)
+                        output << (i > 0 ? ", " : "") << "{\"le\": "
+                               << (i < bounds.size()
+                                       ? formatNumber(bounds[i])
+                                       : "\"+Inf\"")
+                               << ", \"count\": " << bucket_counts[i] << "}";
+                    output << "], \"sum\": "
+                           << formatNumber(series.histogram->getSum())
+                           << ", \"count\": " << series.histogram->getCount();
+                    break;
+                }
+            }
+            output << "}";
+        }
+        output << (is_first_series ? "]}" : "\n  ]}");
+    }
+    output << (is_first_family ? "]}\n" : "\n]}\n");
+    return output.str();
+}
+
+string Metrics::format(Format format) const {
+    return format == Format::JSON ? this->toJson() : this->toPrometheus();
+}
+
+bool Metrics::writeSnapshot(string path, Format format) const {
+    string temporary_path = path + ".tmp";
+    {
+        ofstream file(temporary_path, ios::trunc);
+        if (!file.is_open()) return false;
+        file << this->format(format);
+        if (!file.good()) return false;
+    }
+    return rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+void Metrics::startPeriodicExport(string path, Format format,
+                                  chrono::milliseconds interval) {
+    this->stopPeriodicExport();
+    this->can_stop_exporting_thread = false;
+    this->exporting_thread = thread([this, path, format, interval]() {
+        this->exportingThreadJob(path, format, interval);
+    });
+}
+
+void Metrics::stopPeriodicExport() {
+    {
+        lock_guard<mutex> lock(this->exporting_mutex);
+        this->can_stop_exporting_thread = true;
+    }
+    this->exporting_cv.notify_all();
+    if (this->exporting_thread.joinable()) this->exporting_thread.join();
+}
+
+/* Auxiliary */
+
+Metrics::Series &Metrics::findOrCreateSeries(string name, string help,
+                                             Type type, Labels labels,
+                                             vector<double> bounds) {
+    lock_guard<mutex> lock(this->families_mutex);
+
+    auto [it, inserted] = this->families.insert({name, Family{type, help, {}}});
+    if (!inserted && it->second.type != type)
+        throw invalid_argument("Metric \"" + name +
+                               "\" is already registered with another type");
+
+    // Created under the lock, so exports never see a series without its
+    // metric and every caller gets the same one
+    auto [series_it, is_new_series] = it->second.series.try_emplace(labels);
+    Series &series = series_it->second;
+    if (is_new_series) {
+        switch (type) {
+            case Type::COUNTER:
+                series.counter = make_unique<Counter>();
+                break;
+            case Type::GAUGE:
+                series.gauge = make_unique<Gauge>();
+                break;
+            case Type::HISTOGRAM:
+                series.histogram = make_unique<Histogram>(bounds);
+                break;
+        }
+    }
+    return series;
+}
+
+void Metrics::exportingThreadJob(string path, Format format,
+                                 chrono::milliseconds interval) {
+    unique_lock<mutex> lock(this->exporting_mutex);
+    while (true) {
+        bool can_stop = this->exporting_cv.wait_for(lock, interval, [this]() {
+            return this->can_stop_exporting_thread;
+        });
+
+        lock.unlock();
+        this->writeSnapshot(path, format);
+        lock.lock();
+
+        if (can_stop) break;
+    }
+}
+
+string Metrics::typeToString(Type type) {
+    switch (type) {
+        case Type::COUNTER:
+            return "counter";
+        case Type::GAUGE:
+            return "gauge";
+        case Type::HISTOGRAM:
+            return "histogram";
+        default:
+            return "untyped";
+    }
+}
+
+string Metrics::formatLabels(const Labels &labels,
+                             optional<string> bucket_bound) {
+    if (labels.empty() && !bucket_bound.has_value()) return "";
+
+    string formatted = "{";
+    for (size_t i = 0; i < labels.size(); i++)
+        formatted += (i > 0 ? "," : "") + labels[i].first + "=\"" +
+                     escape(labels[i].second) + "\"";
+    if (bucket_bound.has_value())
+        formatted += string(labels.empty() ? "" : ",") + "le=\"" +
+                     bucket_bound.value() + "\"";
+    return formatted + "}";
+}
+
+/* Static methods */
+
+optional<Metrics::Format> Metrics::formatFromString(string format) {
+    if (format == "prometheus" || format == "PROMETHEUS")
+        return Format::PROMETHEUS;
+    if (format == "json" || format == "JSON") return Format::JSON;
+    return nullopt;
+}
+
+vector<double> Metrics::getDurationBounds() {
+    return {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+}
@@ -0,0 +1,144 @@
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Registry of named counters, gauges and histograms.
+ *
+ * Metrics are registered once and then updated through the returned reference,
+ * without touching the registry again. Counters are split into per-thread
+ * shards, which are only added together when a snapshot is taken.
+ * Exported names start with the prefix of the registry.
+ * Snapshots can be exported in the Prometheus text format or as JSON, either
+ * on demand or periodically to a file.
+ */
+class Metrics {
+   public:
+    enum class Format { PROMETHEUS, JSON };
+
+    using Labels = vector<pair<string, string>>;
+
+    static constexpr size_t counter_shards_count = 16;
+
+    class Counter {
+       private:
+        struct alignas(64) Shard {
+            atomic<uint64_t> value{0};
+        };
+
+        array<Shard, counter_shards_count> shards;
+
+       public:
+        void increment(uint64_t amount = 1);
+        uint64_t getValue() const;
+    };
+
+    class Gauge {
+       private:
+        atomic<int64_t> value{0};
+
+       public:
+        void set(int64_t value);
+        void add(int64_t amount);
+        int64_t getValue() const;
+    };
+
+    class Histogram {
+       private:
+        vector<double> bounds;  // Inclusive upper bounds, in ascending order
+        unique_ptr<atomic<uint64_t>[]> buckets;  // One more, for the rest
+        atomic<uint64_t> count;
+        atomic<double> sum;
+
+       public:
+        Histogram(vector<double> bounds);
+
+        void observe(double value);
+        const vector<double> &getBounds() const;
+        vector<uint64_t> getBucketCounts() const;  // Not cumulative
+        uint64_t getCount() const;
+        double getSum() const;
+    };
+
+   private:
+    enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Series {
+        unique_ptr<Counter> counter;
+        unique_ptr<Gauge> gauge;
+        unique_ptr<Histogram> histogram;
+    };
+
+    struct Family {
+        Type type;
+        string help;
+        map<Labels, Series> series;
+    };
+
+    string prefix;
+    mutable mutex families_mutex;
+    map<string, Family> families;
+
+    thread exporting_thread;
+    mutex exporting_mutex;
+    condition_variable exporting_cv;
+    bool can_stop_exporting_thread;
+
+    // Creates the metric of a new series too; bounds are for histograms
+    Series &findOrCreateSeries(string name, string help, Type type,
+                               Labels labels, vector<double> bounds = {});
+    void exportingThreadJob(string path, Format format,
+                            chrono::milliseconds interval);
+
+    static string typeToString(Type type);
+    static string formatLabels(const Labels &labels,
+                               optional<string> bucket_bound = nullopt);
+
+   public:
+    /* Construction */
+    Metrics(string prefix = "generic_protocol");
+    ~Metrics();
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    /* Methods */
+    // Return the metric with this name and labels, creating it if needed;
+    // a name must always be used with the same type
+    Counter &getCounter(string name, string help, Labels labels = {});
+    Gauge &getGauge(string name, string help, Labels labels = {});
+    Histogram &getHistogram(string name, string help, vector<double> bounds,
+                            Labels labels = {});
+
+    string toPrometheus() const;
+    string toJson() const;
+    string format(Format format) const;
+    // Replaces the file at once, so readers never see a partial snapshot
+    bool writeSnapshot(string path, Format format) const;
+
+    // Writes a snapshot every interval, and a last one when stopped
+    void startPeriodicExport(string path, Format format,
+                             chrono::milliseconds interval);
+    void stopPeriodicExport();
+
+    /* Static methods */
+    static optional<Format> formatFromString(string format);
+    // Bounds, in milliseconds, suited to round-trip times and handshakes
+    static vector<double> getDurationBounds();
+};
+
+#endif  // METRICS_HPP_
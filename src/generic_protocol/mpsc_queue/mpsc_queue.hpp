@@ -0,0 +1,224 @@
+#ifndef MPSC_QUEUE_HPP_
+#define MPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Unbounded queue with many producers and a single consumer.
+ *
+ * Values go through a fixed-size ring, where producers claim runs of cells
+ * with a compare-and-swap on the enqueue position and publish them through the
+ * sequence of each cell, so pushing takes no lock. When the ring is full,
+ * values spill into an overflow list guarded by a mutex, which has no limit,
+ * and later pushes follow them there until the consumer drains it, which
+ * keeps the order of each producer; producers never wait for the consumer,
+ * which may push into its own queue. The consumer only parks, on an atomic
+ * wait, when the queue is empty, and producers only wake it when it is
+ * parked.
+ */
+template <typename Value>
+class MpscQueue {
+   private:
+    static constexpr size_t cache_line_size = 64;
+
+    struct Cell {
+        atomic<size_t> sequence;
+        alignas(Value) byte storage[sizeof(Value)];
+
+        Value *getValue() {
+            return launder(reinterpret_cast<Value *>(this->storage));
+        }
+    };
+
+    size_t mask;
+    unique_ptr<Cell[]> cells;
+    // Written by producers and by the consumer, kept on their own lines
+    alignas(cache_line_size) atomic<size_t> enqueue_position;
+    alignas(cache_line_size) size_t dequeue_position;
+
+    alignas(cache_line_size) atomic<bool> is_consumer_waiting;
+    atomic<uint32_t> wake_sequence;
+    atomic<bool> is_closed;
+
+    mutex overflow_mutex;
+    deque<Value> overflow;
+    atomic<size_t> overflow_size;
+
+    // Claims a run of free cells for the first values with one
+    // compare-and-swap, and returns how many it has taken
+    size_t tryPushToRing(span<Value> values) {
+        size_t position = this->enqueue_position.load(memory_order_relaxed);
+        size_t count;
+        while (true) {
+            count = 0;
+            while (count < values.size() &&
+                   this->cells[(position + count) & this->mask].sequence.load(
+                       memory_order_acquire) == position + count)
+                count++;
+
+            if (count == 0) {
+                size_t sequence = this->cells[position & this->mask]
+                                      .sequence.load(memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) -
+                                      static_cast<intptr_t>(position);
+                if (difference < 0) return 0;  // Full
+                position = this->enqueue_position.load(memory_order_relaxed);
+            } else if (this->enqueue_position.compare_exchange_weak(
+                           position, position + count,
+                           memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            Cell &cell = this->cells[(position + i) & this->mask];
+            new (cell.storage) Value(move(values[i]));
+            cell.sequence.store(position + i + 1, memory_order_release);
+        }
+        return count;
+    }
+
+    bool tryPopFromRing(vector<Value> &values) {
+        Cell &cell = this->cells[this->dequeue_position & this->mask];
+        if (cell.sequence.load(memory_order_acquire) !=
+            this->dequeue_position + 1)
+            return false;  // Empty, or not published yet
+
+        Value *value = cell.getValue();
+        values.push_back(move(*value));
+        value->~Value();
+        cell.sequence.store(this->dequeue_position + this->mask + 1,
+                            memory_order_release);
+        this->dequeue_position++;
+        return true;
+    }
+
+    void wakeConsumer() {
+        // Pairs with the fence in waitForValues: either the consumer sees
+        // the value, or it is seen waiting here
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!this->is_consumer_waiting.load(memory_order_relaxed)) return;
+        this->wake_sequence.fetch_add(1, memory_order_release);
+        this->wake_sequence.notify_one();
+    }
+
+   public:
+    /* Construction */
+    // The capacity of the ring is rounded up to a power of two
+    explicit MpscQueue(size_t capacity)
+        : mask(bit_ceil(max<size_t>(capacity, 2)) - 1),
+          cells(make_unique<Cell[]>(this->mask + 1)),
+          enqueue_position(0),
+          dequeue_position(0),
+          is_consumer_waiting(false),
+          wake_sequence(0),
+          is_closed(false),
+          overflow_size(0) {
+        for (size_t i = 0; i <= this->mask; i++)
+            this->cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    ~MpscQueue() {
+        while (this->cells[this->dequeue_position & this->mask]
+                   .sequence.load(memory_order_acquire) ==
+               this->dequeue_position + 1) {
+            this->cells[this->dequeue_position & this->mask]
+                .getValue()
+                ->~Value();
+            this->dequeue_position++;
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    /* Getters */
+    size_t getCapacity() const { return this->mask + 1; }
+    bool isClosed() const { return this->is_closed.load(memory_order_acquire); }
+
+    /* Methods */
+    // Any thread
+    void push(Value value) { this->push(span<Value>(&value, 1)); }
+
+    // Any thread. Moves the values in, in order, taking the overflow lock
+    // at most once and waking the consumer once
+    void push(span<Value> values) {
+        if (values.empty()) return;
+
+        size_t count = 0;
+        if (this->overflow_size.load(memory_order_acquire) == 0)
+            count = this->tryPushToRing(values);
+        if (count < values.size()) {
+            lock_guard<mutex> lock(this->overflow_mutex);
+            for (size_t i = count; i < values.size(); i++)
+                this->overflow.push_back(move(values[i]));
+            this->overflow_size.fetch_add(values.size() - count,
+                                          memory_order_release);
+        }
+        this->wakeConsumer();
+    }
+
+    // Wakes the consumer for good, once it has taken what is left
+    void close() {
+        this->is_closed.store(true, memory_order_release);
+        atomic_thread_fence(memory_order_seq_cst);
+        this->wake_sequence.fetch_add(1, memory_order_release);
+        this->wake_sequence.notify_one();
+    }
+
+    // Consumer only. Appends up to the maximum count of values, in order,
+    // and returns how many have been taken
+    size_t pop(vector<Value> &values, size_t maximum_count) {
+        size_t count = 0;
+        while (count < maximum_count && this->tryPopFromRing(values)) count++;
+
+        // The overflow only holds values pushed after those in the ring, so
+        // it waits while a claimed cell is not published yet. Under the
+        // lock, no producer can follow a value it claims now into the
+        // overflow
+        if (count < maximum_count &&
+            this->overflow_size.load(memory_order_acquire) > 0) {
+            lock_guard<mutex> lock(this->overflow_mutex);
+            if (this->enqueue_position.load(memory_order_acquire) !=
+                this->dequeue_position)
+                return count;
+            while (count < maximum_count && !this->overflow.empty()) {
+                values.push_back(move(this->overflow.front()));
+                this->overflow.pop_front();
+                this->overflow_size.fetch_sub(1, memory_order_release);
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // Consumer only. Parks until a value is pushed or the queue is closed
+    void waitForValues() {
+        uint32_t wake_sequence =
+            this->wake_sequence.load(memory_order_acquire);
+        this->is_consumer_waiting.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        bool is_empty =
+            this->cells[this->dequeue_position & this->mask].sequence.load(
+                memory_order_acquire) != this->dequeue_position + 1 &&
+            this->overflow_size.load(memory_order_acquire) == 0;
+        if (is_empty && !this->isClosed())
+            this->wake_sequence.wait(wake_sequence, memory_order_acquire);
+
+        this->is_consumer_waiting.store(false, memory_order_relaxed);
+    }
+};
+
+#endif  // MPSC_QUEUE_HPP_
@@ -1,11 +1,14 @@
 #include "network.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <generic_protocol_constants.hpp>
 #include <iostream>
 #include <memory>
 #include <pretty_console.hpp>
+#include <unordered_set>
 
+#include "connection.hpp"
 #include "message.hpp"
 #include "util.hpp"
 
@@ -13,363 +16,990 @@ using namespace std;
 
 /* Construction */
 
-Network::Network(shared_ptr<uuids::uuid_random_generator> uuid_generator,
-                 string name,
-                 function<shared_ptr<Entity>(uuids::uuid)> get_entity_by_id) {
-    this->uuid_generator = uuid_generator;
+Network::Network(shared_ptr<IdGenerator> id_generator, string name,
+                 shared_ptr<EntitiesRegistry> entities,
+                 shared_ptr<const Configuration> configuration,
+                 shared_ptr<Metrics> metrics, shared_ptr<Simulator> simulator)
+    : retransmission_timers(configuration->getRetransmissionTimerTick(),
+                            configuration->getRetransmissionTimerSlots(),
+                            simulator != nullptr
+                                ? simulator->now()
+                                : chrono::steady_clock::now(),
+                            &this->in_flight_pool),
+      unconfirmed_sequence_numbers(&this->in_flight_pool) {
+    this->id_generator = id_generator;
     this->name = name;
-    this->get_entity_by_id = get_entity_by_id;
+    this->entities = entities;
+    this->configuration = configuration;
+    this->metrics = metrics;
+    this->simulator = simulator;
+    this->registerMetrics();
 
     this->unconfirmed_packages =
-        make_shared<map<uuids::uuid, PackageSending>>();
+        make_shared<pmr::map<uuids::uuid, PackageSending>>(
+            &this->in_flight_pool);
     this->sending_packages_count = 0;
     this->can_stop_sending_thread = false;
+
+    for (unsigned int i = 0;
+         i < max(1u, this->configuration->getProcessingWorkersCount()); i++)
+        this->processing_workers.push_back(make_unique<ProcessingWorker>());
+
+    // The simulator drives every event from the caller's thread
+    if (this->simulator != nullptr) return;
+
     this->package_sending_thread =
         thread([this]() { this->sendingThreadJob(); });
-
-    this->packages_to_process = make_shared<queue<Package>>();
-    this->processing_packages_count = 0;
-    this->can_stop_processing_thread = false;
-    this->processing_packages_thread =
-        thread([this]() { this->processingThreadJob(); });
+    for (auto &worker : this->processing_workers) {
+        ProcessingWorker &worker_ref = *worker;
+        worker->processing_packages_thread = thread(
+            [this, &worker_ref]() { this->processingThreadJob(worker_ref); });
+    }
 }
 
 Network::~Network() {
     this->joinThreads();
-    if (GenericProtocolConstants::debug_information) {
-        this->printInformation(
-            "Network " + this->getName() + " has been destroyed!", cout,
-            PrettyConsole::Color::YELLOW);
-    }
+    this->log(Logger::Level::DEBUG, PrettyConsole::Color::YELLOW,
+              "Network {} has been destroyed!", this->name);
 }
 
 /* Getters */
 
 string Network::getName() const { return name; }
 
-shared_ptr<Entity> Network::getEntityById(uuids::uuid entity_id) {
-    return this->get_entity_by_id(entity_id);
+Network::Statistics Network::getStatistics() const {
+    return {this->transmissions_counter->getValue(),
+            this->transmitted_bytes_counter->getValue(),
+            this->retransmissions_counter->getValue(),
+            this->fast_retransmissions_counter->getValue(),
+            this->lost_packages_counter->getValue(),
+            this->corrupted_packages_counter->getValue()};
+}
+
+PoolResource::Statistics Network::getPoolStatistics() const {
+    return this->in_flight_pool.getStatistics();
+}
+
+chrono::time_point<chrono::steady_clock> Network::now() const {
+    if (this->simulator != nullptr) return this->simulator->now();
+    return chrono::steady_clock::now();
 }
 
 /* Main */
 
 bool Network::receivePackage(Package package) {
-    return this->internalReceivePackage(package);
+    return this->internalReceivePackage(move(package));
 }
 
 bool Network::internalReceivePackage(Package package) {
-    if (GenericProtocolConstants::debug_information) {
-        this->printInformation(
-            "Package [" + to_string(package.getMessage().getId()) +
-                "] has been received in the network " + this->getName() + "!",
-            cout, PrettyConsole::Color::GREEN);
-    }
+    this->log(Logger::Level::DEBUG, PrettyConsole::Color::GREEN,
+              "Package [{}] has been received in the network {}!",
+              package.getMessage().getId(), this->name);
+
+    if (!this->resolveEntities(package)) return false;
+    this->received_packages_counter->increment();
 
+    if (package.getMessage().getCode() == Message::Code::DATA) {
+        lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+        this->piggybackAcknowledgement(package);
+    }
     this->registerPackage(package);
-    return this->preprocessPackage(package);
+    return this->preprocessPackage(move(package));
 }
 
-bool Network::preprocessPackage(Package package, int attempt) {
-    auto message = package.getMessage();
+vector<bool> Network::receivePackages(span<Package> packages) {
+    vector<bool> are_received(packages.size(), false);
+
+    for (size_t i = 0; i < packages.size(); i++) {
+        this->log(Logger::Level::DEBUG, PrettyConsole::Color::GREEN,
+                  "Package [{}] has been received in the network {}!",
+                  packages[i].getMessage().getId(), this->name);
+        are_received[i] = this->resolveEntities(packages[i]);
+        if (are_received[i]) this->received_packages_counter->increment();
+    }
+
+    {
+        lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+        for (size_t i = 0; i < packages.size(); i++) {
+            if (!are_received[i]) continue;
+            if (packages[i].getMessage().getCode() == Message::Code::DATA)
+                this->piggybackAcknowledgement(packages[i]);
+            packages[i].getSourceEntity()->logPackageInformation(packages[i],
+                                                                 true);
+            if (packages[i].shouldBeConfirmed())
+                this->registerUnconfirmedPackage(packages[i]);
+        }
+    }
+
+    // Grouped by worker, so each one is pushed to and woken once
+    vector<vector<Package>> packages_by_worker(this->processing_workers.size());
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!are_received[i]) continue;
+        are_received[i] = this->transmitPackage(packages[i], 1);
+        if (!are_received[i]) continue;
+        packages_by_worker[this->getProcessingWorkerIndex(packages[i])]
+            .push_back(move(packages[i]));
+    }
+    for (size_t i = 0; i < packages_by_worker.size(); i++)
+        this->enqueuePackages(*this->processing_workers[i],
+                              packages_by_worker[i]);
+
+    return are_received;
+}
+
+bool Network::resolveEntities(Package &package) {
+    if (package.hasResolvedEntities()) return true;
+
+    const auto &message = package.getMessage();
+
+    auto source_entity = this->entities->find(message.getSourceEntityId());
+    if (source_entity == nullptr) {
+        this->log(Logger::Level::ERROR, PrettyConsole::Color::RED,
+                  "Source entity [{}] is not connected to the network {}!",
+                  message.getSourceEntityId(), this->name);
+        return false;
+    }
 
-    if (GenericProtocolConstants::debug_information) {
-        this->printInformation(
-            "Attempt [" + to_string(attempt) + "] to send message [" +
-                to_string(message.getId()) + "] to the target [" +
-                to_string(message.getTargetEntityId()) + "]",
-            cout, PrettyConsole::Color::YELLOW);
+    auto target_entity = this->entities->find(message.getTargetEntityId());
+    if (target_entity == nullptr) {
+        this->log(Logger::Level::ERROR, PrettyConsole::Color::RED,
+                  "Target entity [{}] is not connected to the network {}!",
+                  message.getTargetEntityId(), this->name);
+        return false;
     }
 
-    if (this->hasPackageBeenLost(message.getId())) return false;
-    return this->insertPackageIntoProcessingQueue(package);
+    package.setEntities(source_entity, target_entity);
+    return true;
+}
+
+bool Network::preprocessPackage(Package package, int attempt) {
+    if (!this->transmitPackage(package, attempt)) return false;
+    return this->insertPackageIntoProcessingQueue(move(package));
+}
+
+bool Network::transmitPackage(const Package &package, int attempt) {
+    const auto &message = package.getMessage();
+
+    this->log(Logger::Level::DEBUG, PrettyConsole::Color::YELLOW,
+              "Attempt [{}] to send message [{}] to the target [{}]", attempt,
+              message.getId(), message.getTargetEntityId());
+
+    this->transmissions_counter->increment();
+    this->transmitted_bytes_counter->increment(
+        WireFormat::getEncodedSize(package));
+    if (attempt > 1) this->retransmissions_counter->increment();
+
+    return !this->hasPackageBeenLost(message.getId());
 }
 
 void Network::processPackage(Package package) {
-    this->simulateNetworkLatency();
+    this->simulateNetworkLatency(package);
+    this->deliverPackage(move(package));
+}
+
+void Network::deliverPackage(Package package) {
     this->simulatePacketCorruption(package);
 
     this->sendPackage(package);
-    this->finishPackageProcessing();
 }
 
 /* Operational */
 
 void Network::sendPackage(Package &package) {
-    auto message = package.getMessage();
+    const auto &message = package.getMessage();
     bool should_be_confirmed = package.shouldBeConfirmed();
 
-    auto target_entity = this->getEntityById(message.getTargetEntityId());
-    if (!target_entity) {
-        this->printInformation(
-            "Target entity [" + to_string(message.getTargetEntityId()) +
-                "] is not connected to the network " + this->getName() + "!",
-            cerr, PrettyConsole::Color::RED);
-        return;
-    }
-    auto source_entity = this->getEntityById(message.getSourceEntityId());
-    if (!source_entity) {
-        this->printInformation(
-            "Source entity [" + to_string(message.getSourceEntityId()) +
-                "] is not connected to the network " + this->getName() + "!",
-            cerr, PrettyConsole::Color::RED);
-    }
+    auto target_entity = package.getTargetEntity();
+    auto source_entity = package.getSourceEntity();
 
     bool can_send_message =
         source_entity->sendMessage(message, should_be_confirmed);
 
     if (!can_send_message) {
-        if (GenericProtocolConstants::debug_information) {
-            this->printInformation("Source entity " + source_entity->getName() +
-                                       " [" +
-                                       to_string(source_entity->getId()) +
-                                       "] cannot send the message " + "[" +
-                                       to_string(message.getId()) + "]!",
-                                   cout, PrettyConsole::Color::RED);
-        }
+        this->log(Logger::Level::DEBUG, PrettyConsole::Color::RED,
+                  "Source entity {} [{}] cannot send the message [{}]!",
+                  source_entity->getName(), source_entity->getId(),
+                  message.getId());
     } else {
-        if (GenericProtocolConstants::debug_information) {
-            this->printInformation("Message [" + to_string(message.getId()) +
-                                       "] has been sent to the target entity " +
-                                       target_entity->getName() + " [" +
-                                       to_string(target_entity->getId()) + "]!",
-                                   cout, PrettyConsole::Color::GREEN);
-        }
+        this->log(Logger::Level::DEBUG, PrettyConsole::Color::GREEN,
+                  "Message [{}] has been sent to the target entity {} [{}]!",
+                  message.getId(), target_entity->getName(),
+                  target_entity->getId());
+
+        // What a package acknowledges is only known once it arrives intact
+        if (!package.isCorrupted()) this->confirmAcknowledgedPackages(package);
 
         optional<Package> returned_package_container =
-            target_entity->receivePackage(package, this->uuid_generator);
+            target_entity->receivePackage(package, this->id_generator);
 
         if (!returned_package_container.has_value()) return;
 
-        auto returned_package = returned_package_container.value();
-
-        this->tryToConfirmSomePackage(
-            returned_package.getMessage().getIdFromMessageBeingAcknowledged());
-
-        if (GenericProtocolConstants::debug_information) {
-            this->printInformation("Response message [" +
-                                       to_string(message.getId()) +
-                                       "] has been received in the network " +
-                                       this->getName() + "!",
-                                   cout, PrettyConsole::Color::GREEN);
-        }
-
-        this->internalReceivePackage(returned_package);
+        Package returned_package = move(returned_package_container.value());
+
+        // Responses travel back to the sender, so reuse the resolved handles
+        const auto &returned_message = returned_package.getMessage();
+        if (returned_message.getSourceEntityId() == target_entity->getId() &&
+            returned_message.getTargetEntityId() == source_entity->getId())
+            returned_package.setEntities(target_entity, source_entity);
+
+        // Tells the sender which attempt to take a round-trip sample from
+        if (returned_message.getIdFromMessageBeingAcknowledged() ==
+            message.getId())
+            returned_package.setAcknowledgedAttempt(package.getAttempt());
+
+        this->log(Logger::Level::DEBUG, PrettyConsole::Color::GREEN,
+                  "Response message [{}] has been received in the network {}!",
+                  message.getId(), this->name);
+
+        // Duplicate acknowledgements, which acknowledge no package of their
+        // own, are sent right away to drive fast retransmission
+        if (returned_message.getCode() == Message::Code::ACK &&
+            !returned_message.getCodeVariant().has_value() &&
+            returned_message.getIdFromMessageBeingAcknowledged().has_value())
+            this->delayAcknowledgement(move(returned_package));
+        else
+            this->internalReceivePackage(move(returned_package));
     }
 }
 
-void Network::finishPackageProcessing() {
-    lock_guard<mutex> lock(this->packages_to_process_mutex);
-    this->processing_packages_count--;
-    if (processing_packages_count == 0) {
-        this->package_processed_cv.notify_all();  // Notify the destructor
-    }
+/* Auxiliary */
+
+size_t Network::getProcessingWorkerIndex(const Package &package) const {
+    const auto &message = package.getMessage();
+    // Both directions of a flow share a worker, which keeps them in order
+    auto key = ConnectionsMap::makeKey(message.getSourceEntityId(),
+                                       message.getTargetEntityId());
+    return ConnectionsMap::KeyHash{}(key) % this->processing_workers.size();
 }
 
-/* Auxiliary */
+Network::ProcessingWorker &Network::getProcessingWorker(
+    const Package &package) {
+    return *this->processing_workers[this->getProcessingWorkerIndex(package)];
+}
 
 bool Network::insertPackageIntoProcessingQueue(Package package) {
     try {
-        lock_guard<mutex> lock(this->packages_to_process_mutex);
-        this->packages_to_process->push(package);
-        this->processing_packages_count++;
-        this->package_processed_cv.notify_one();  // Notify the network thread
+        this->enqueuePackage(this->getProcessingWorker(package), move(package));
         return true;
     } catch (const exception &e) {
-        this->printInformation("Error while receiving message in the network " +
-                                   this->getName() + ": " + e.what(),
-                               cerr, PrettyConsole::Color::RED);
+        this->log(Logger::Level::ERROR, PrettyConsole::Color::RED,
+                  "Error while receiving message in the network {}: {}",
+                  this->name, e.what());
         return false;
     }
 }
 
+void Network::enqueuePackage(ProcessingWorker &worker, Package package) {
+    this->processing_queue_depth_gauge->add(1);
+
+    if (this->simulator != nullptr) {
+        // A package never overtakes an earlier one of the same worker, just
+        // like in its queue
+        lock_guard<mutex> lock(worker.available_time_mutex);
+        auto delivery_time =
+            max(this->simulator->now() + this->getSimulatedLatency(),
+                worker.available_time) +
+            this->getTransmissionDelay(package);
+        worker.available_time = delivery_time;
+        this->simulator->scheduleAt(
+            delivery_time, [this, package = move(package)]() mutable {
+                this->processing_queue_depth_gauge->add(-1);
+                this->deliverPackage(move(package));
+            });
+        return;
+    }
+
+    worker.packages_to_process.push(move(package));  // Wakes the worker
+}
+
+void Network::enqueuePackages(ProcessingWorker &worker,
+                              span<Package> packages) {
+    if (this->simulator != nullptr) {
+        for (auto &package : packages)
+            this->enqueuePackage(worker, move(package));
+        return;
+    }
+
+    this->processing_queue_depth_gauge->add(packages.size());
+    worker.packages_to_process.push(packages);  // Wakes the worker once
+}
+
 void Network::joinSendingThread() {
     if (this->package_sending_thread.joinable()) {
         this->package_sending_thread.join();
     }
 }
 
-void Network::joinProcessingThread() {
-    if (this->processing_packages_thread.joinable()) {
-        this->processing_packages_thread.join();
+void Network::joinProcessingThreads() {
+    for (auto &worker : this->processing_workers) {
+        worker->packages_to_process.close();
+        if (worker->processing_packages_thread.joinable()) {
+            worker->processing_packages_thread.join();
+        }
     }
 }
 
 void Network::joinThreads() {
+    if (this->simulator != nullptr) return;
     {
         lock_guard<mutex> lock_sending(this->unconfirmed_packages_mutex);
         this->can_stop_sending_thread = true;
         this->package_sent_cv.notify_all();
     }
     this->joinSendingThread();
-
-    {
-        lock_guard<mutex> lock_processing(this->packages_to_process_mutex);
-        this->can_stop_processing_thread = true;
-        this->package_processed_cv.notify_all();
-    }
-    this->joinProcessingThread();
+    this->joinProcessingThreads();
 }
 
-void Network::registerPackage(Package package) {
-    auto message = package.getMessage();
-    bool should_be_confirmed = package.shouldBeConfirmed();
+void Network::onPackageAcknowledged(PackageAcknowledgedCallback callback) {
+    lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+    this->package_acknowledged_callbacks.push_back(callback);
+}
 
-    auto source_entity = this->getEntityById(message.getSourceEntityId());
+void Network::onPackageLost(PackageLostCallback callback) {
+    lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+    this->package_lost_callbacks.push_back(callback);
+}
 
-    if (source_entity == nullptr) {
-        this->printInformation(
-            "Source entity [" + to_string(message.getSourceEntityId()) +
-                "] is not connected to the network " + this->getName() + "!",
-            cerr, PrettyConsole::Color::RED);
-        return;
-    }
+void Network::registerPackage(const Package &package) {
+    bool should_be_confirmed = package.shouldBeConfirmed();
 
-    source_entity->printPackageInformation(package, cout, true);
+    package.getSourceEntity()->logPackageInformation(package, true);
 
     if (!should_be_confirmed) return;
 
     lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
-    this->unconfirmed_packages->insert(
-        {message.getId(), PackageSending(package)});
+    this->registerUnconfirmedPackage(package);
+}
+
+void Network::registerUnconfirmedPackage(const Package &package) {
+    const auto &message = package.getMessage();
+    auto settings = this->getFlowSettings(package);
+    Flow flow = {message.getSourceEntityId(), message.getTargetEntityId()};
+    RetransmissionTimeout::Duration resend_timeout =
+        this->configuration->isAdaptiveResendTimeout()
+            ? this->getRetransmissionTimeout(flow, settings).getTimeout()
+            : settings.resend_timeout;
+    auto [it, inserted] = this->unconfirmed_packages->insert(
+        {message.getId(),
+         PackageSending(package, settings, resend_timeout, this->now())});
+    if (!inserted) return;
+    this->unconfirmed_packages_gauge->set(this->unconfirmed_packages->size());
+
+    // Sequenced packages can also be confirmed by acknowledged ranges
+    if (package.getSequenceNumber() > 0) {
+        this->unconfirmed_sequence_numbers[flow].insert(
+            {package.getSequenceNumber(), message.getId()});
+        this->updateWindowOccupancy(package);
+    }
+
+    this->armRetransmissionTimer(message.getId(), it->second);
 }
 
 bool Network::hasPackageBeenLost(uuids::uuid message_id) {
-    if (rand() % 100 <
-        GenericProtocolConstants::packet_loss_probability * 100) {
-        if (GenericProtocolConstants::debug_information) {
-            this->printInformation("Message [" + to_string(message_id) +
-                                       "] has been lost in the network " +
-                                       this->getName() + "!",
-                                   cout, PrettyConsole::Color::RED);
-        }
+    if (rand() % 100 < this->configuration->getPacketLossProbability() * 100) {
+        this->log(Logger::Level::DEBUG, PrettyConsole::Color::RED,
+                  "Message [{}] has been lost in the network {}!", message_id,
+                  this->name);
+        this->lost_packages_counter->increment();
         return true;
     }
     return false;
 }
 
-void Network::simulateNetworkLatency() {
-    chrono::milliseconds time_span(rand() %
-                                   GenericProtocolConstants::network_latency);
-    this_thread::sleep_for(time_span);
+chrono::milliseconds Network::getSimulatedLatency() {
+    auto network_latency = this->configuration->getNetworkLatency().count();
+    if (network_latency <= 0) return chrono::milliseconds(0);
+    return chrono::milliseconds(rand() % network_latency);
+}
+
+chrono::nanoseconds Network::getTransmissionDelay(
+    const Package &package) const {
+    auto network_bandwidth = this->configuration->getNetworkBandwidth();
+    if (network_bandwidth == 0) return chrono::nanoseconds(0);
+    return chrono::nanoseconds(WireFormat::getEncodedSize(package) *
+                               1'000'000'000 / network_bandwidth);
+}
+
+void Network::simulateNetworkLatency(const Package &package) {
+    this_thread::sleep_for(this->getSimulatedLatency() +
+                           this->getTransmissionDelay(package));
 }
 
 void Network::simulatePacketCorruption(Package &package) {
     if (rand() % 100 <
-        GenericProtocolConstants::packet_corruption_probability * 100) {
-        this->printInformation(
-            "Message [" + to_string(package.getMessage().getId()) +
-                "] has been corrupted in the network " + this->getName() + "!",
-            cout, PrettyConsole::Color::RED);
+        this->configuration->getPacketCorruptionProbability() * 100) {
+        this->log(Logger::Level::INFO, PrettyConsole::Color::RED,
+                  "Message [{}] has been corrupted in the network {}!",
+                  package.getMessage().getId(), this->name);
         package.setCorrupted(true);
+        this->corrupted_packages_counter->increment();
     }
 }
 
-void Network::printInformation(string information, ostream &output_stream,
-                               PrettyConsole::Color color) const {
-    string header = "Network " + this->getName();
-    PrettyConsole::Decoration header_decoration{PrettyConsole::Color::BLACK,
-                                                PrettyConsole::Color::YELLOW,
-                                                PrettyConsole::Format::BOLD};
-    PrettyConsole::Decoration information_decoration{
-        color, PrettyConsole::Color::DEFAULT, PrettyConsole::Format::NONE};
-    Util::printInformation(header, information, output_stream,
-                           header_decoration, information_decoration);
+void Network::confirmAcknowledgedPackages(const Package &package) {
+    const auto &message = package.getMessage();
+    auto acknowledged_id = message.getIdFromMessageBeingAcknowledged();
+    if (!acknowledged_id.has_value() &&
+        message.getAcknowledgedRanges().empty())
+        return;
+
+    unique_lock<mutex> lock(this->unconfirmed_packages_mutex);
+
+    // A package reported as corrupted is sent again right away
+    if (message.getCodeVariant() == Message::CodeVariant::NACK_CORRUPTED) {
+        if (acknowledged_id.has_value())
+            this->retransmitPackage(acknowledged_id.value(), lock,
+                                    RetransmissionCause::CORRUPTION);
+        return;
+    }
+
+    if (acknowledged_id.has_value())
+        this->confirmPackage(acknowledged_id.value(),
+                             package.getAcknowledgedAttempt());
+    // Data may carry the acknowledgements of the other direction too
+    this->confirmAcknowledgedRanges(message);
+
+    // Only pure acknowledgements count as duplicates, as in RFC 5681
+    if (message.getCode() != Message::Code::ACK) return;
+    auto missing_package_id = this->countDuplicateAcknowledgement(message);
+    if (!missing_package_id.has_value()) return;
+
+    // Under go-back-N the receiver dropped what followed the missing package,
+    // so it is resent as after a timeout, just without waiting for it
+    for (auto package_id :
+         this->getPackagesToRetransmit(missing_package_id.value()))
+        this->retransmitPackage(
+            package_id, lock, RetransmissionCause::DUPLICATE_ACKNOWLEDGEMENTS);
+}
+
+void Network::confirmAcknowledgedRanges(const Message &message) {
+    const auto &acknowledged_ranges = message.getAcknowledgedRanges();
+    if (acknowledged_ranges.empty()) return;
+
+    // Acknowledgements travel backwards, so their flow is the reverse one
+    auto flow_it = this->unconfirmed_sequence_numbers.find(
+        {message.getTargetEntityId(), message.getSourceEntityId()});
+    if (flow_it == this->unconfirmed_sequence_numbers.end()) return;
+
+    vector<uuids::uuid> acknowledged_packages_ids;
+    for (const auto &range : acknowledged_ranges) {
+        for (auto it = flow_it->second.lower_bound(range.first);
+             it != flow_it->second.end() && it->first <= range.last; it++)
+            acknowledged_packages_ids.push_back(it->second);
+    }
+    for (auto package_id : acknowledged_packages_ids)
+        this->confirmPackage(package_id);
 }
 
-void Network::tryToConfirmSomePackage(
-    optional<uuids::uuid> id_from_package_possibly_acknowledged) {
-    if (id_from_package_possibly_acknowledged)
-        this->removePackageFromUnconfirmedPackages(
-            id_from_package_possibly_acknowledged.value());
+optional<uuids::uuid> Network::countDuplicateAcknowledgement(
+    const Message &message) {
+    const auto &acknowledged_ranges = message.getAcknowledgedRanges();
+    if (acknowledged_ranges.empty()) return nullopt;
+
+    Flow flow = {message.getTargetEntityId(), message.getSourceEntityId()};
+    unsigned int cumulative_sequence_number =
+        acknowledged_ranges.front().first == 1
+            ? acknowledged_ranges.front().last
+            : 0;
+    auto [it, inserted] = this->duplicate_acknowledgements.insert(
+        {flow, {cumulative_sequence_number, 0}});
+    DuplicateAcknowledgements &duplicates = it->second;
+    if (inserted ||
+        duplicates.cumulative_sequence_number != cumulative_sequence_number) {
+        duplicates = {cumulative_sequence_number, 0};
+        return nullopt;
+    }
+    duplicates.count++;
+
+    // The first package after the cumulative point is the one missing
+    auto flow_it = this->unconfirmed_sequence_numbers.find(flow);
+    if (flow_it == this->unconfirmed_sequence_numbers.end()) return nullopt;
+    auto sequence_it = flow_it->second.find(cumulative_sequence_number + 1);
+    if (sequence_it == flow_it->second.end()) return nullopt;
+    auto package_it = this->unconfirmed_packages->find(sequence_it->second);
+    if (package_it == this->unconfirmed_packages->end()) return nullopt;
+
+    // Retransmitted once for each gap, the timeout covers a later loss
+    const Package &package = package_it->second.package;
+    auto settings = this->getFlowSettings(package);
+    if (settings.fast_retransmit_threshold == 0 ||
+        duplicates.count != settings.fast_retransmit_threshold)
+        return nullopt;
+    return sequence_it->second;
 }
 
 void Network::removePackageFromUnconfirmedPackages(uuids::uuid package_id) {
     lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+    this->confirmPackage(package_id);
+}
+
+// Callers must hold unconfirmed_packages_mutex
+void Network::confirmPackage(uuids::uuid package_id,
+                             optional<unsigned int> delivered_attempt) {
     auto it = this->unconfirmed_packages->find(package_id);
 
     if (it != this->unconfirmed_packages->end()) {
-        if (GenericProtocolConstants::debug_information) {
-            this->printInformation(
-                "Message [" + to_string(package_id) + "] has been confirmed!",
-                cout, PrettyConsole::Color::GREEN);
+        this->log(Logger::Level::DEBUG, PrettyConsole::Color::GREEN,
+                  "Message [{}] has been confirmed!", package_id);
+
+        const PackageSending &package_sending = it->second;
+        const auto &message = package_sending.package.getMessage();
+        Flow flow = {message.getSourceEntityId(), message.getTargetEntityId()};
+        auto timeout_it = this->retransmission_timeouts.find(flow);
+        this->confirmation_times[flow] = this->now();
+
+        // Only the last attempt has a known sending time, so a sample needs
+        // to know that it was the one delivered (Karn's rule)
+        optional<RetransmissionTimeout::Duration> round_trip_time = nullopt;
+        int last_attempt =
+            package_sending.max_attempts - package_sending.remaining_attempts;
+        if (delivered_attempt.has_value() &&
+            static_cast<int>(delivered_attempt.value()) == last_attempt) {
+            round_trip_time = this->now() - package_sending.last_attempt_time;
+            this->round_trip_time_histogram->observe(
+                chrono::duration<double, milli>(round_trip_time.value())
+                    .count());
         }
-        this->unconfirmed_packages->erase(it);
+
+        // Any delivery shows the connection works again, even when it cannot
+        // be timed, as with packages confirmed through ranges
+        bool was_backed_off = false;
+        if (timeout_it != this->retransmission_timeouts.end()) {
+            was_backed_off = timeout_it->second.getBackoffsCount() > 0;
+            if (round_trip_time.has_value())
+                timeout_it->second.addSample(round_trip_time.value());
+            else
+                timeout_it->second.resetBackoff();
+        }
+
+        if (package_sending.package.getSequenceNumber() > 0)
+            for (auto &callback : this->package_acknowledged_callbacks)
+                callback(package_sending.package, round_trip_time);
+
+        this->eraseUnconfirmedPackage(it);
+        if (was_backed_off)
+            this->shortenRetransmissionTimers(flow,
+                                              timeout_it->second.getTimeout());
+    }
+}
+
+// Callers must hold unconfirmed_packages_mutex
+void Network::shortenRetransmissionTimers(
+    Flow flow, RetransmissionTimeout::Duration resend_timeout) {
+    auto flow_it = this->unconfirmed_sequence_numbers.find(flow);
+    if (flow_it == this->unconfirmed_sequence_numbers.end()) return;
+
+    for (const auto &[sequence_number, package_id] : flow_it->second) {
+        auto it = this->unconfirmed_packages->find(package_id);
+        if (it == this->unconfirmed_packages->end() ||
+            it->second.resend_timeout <= resend_timeout)
+            continue;
+        it->second.resend_timeout = resend_timeout;
+        this->armRetransmissionTimer(package_id, it->second);
+    }
+}
+
+// Callers must hold unconfirmed_packages_mutex
+void Network::eraseUnconfirmedPackage(
+    pmr::map<uuids::uuid, PackageSending>::iterator package_iterator) {
+    const Package &package = package_iterator->second.package;
+    const auto &message = package.getMessage();
+
+    if (package.getSequenceNumber() > 0) {
+        auto flow_it = this->unconfirmed_sequence_numbers.find(
+            {message.getSourceEntityId(), message.getTargetEntityId()});
+        if (flow_it != this->unconfirmed_sequence_numbers.end()) {
+            flow_it->second.erase(package.getSequenceNumber());
+            if (flow_it->second.empty())
+                this->unconfirmed_sequence_numbers.erase(flow_it);
+        }
+        this->updateWindowOccupancy(package);
+    }
+
+    this->retransmission_timers.cancel(message.getId());
+    this->unconfirmed_packages->erase(package_iterator);
+    this->unconfirmed_packages_gauge->set(this->unconfirmed_packages->size());
+
+    if (this->unconfirmed_packages->empty())
+        this->package_sent_cv.notify_one();  // Notify the sending thread
+}
+
+void Network::retransmitPackage(uuids::uuid package_id,
+                                unique_lock<mutex> &unconfirmed_packages_lock,
+                                RetransmissionCause cause) {
+    auto it = this->unconfirmed_packages->find(package_id);
+    if (it == this->unconfirmed_packages->end()) return;
+
+    PackageSending &package_sending = it->second;
+
+    // Corruption says nothing about congestion
+    if (cause != RetransmissionCause::CORRUPTION &&
+        package_sending.package.getSequenceNumber() > 0)
+        for (auto &callback : this->package_lost_callbacks)
+            callback(package_sending.package);
+
+    // Check if the message has remaining attempts
+    if (package_sending.remaining_attempts > 0) {
+        package_sending.last_attempt_time = this->now();
+        package_sending.remaining_attempts--;
+
+        // Only an expired timeout means the estimate is too short
+        const auto &message = package_sending.package.getMessage();
+        auto timeout_it = this->retransmission_timeouts.find(
+            {message.getSourceEntityId(), message.getTargetEntityId()});
+        if (cause != RetransmissionCause::TIMEOUT)
+            this->fast_retransmissions_counter->increment();
+        else if (timeout_it != this->retransmission_timeouts.end())
+            package_sending.resend_timeout =
+                timeout_it->second.backOff(package_sending.resend_timeout);
+
+        this->armRetransmissionTimer(package_id, package_sending);
+
+        Package package = package_sending.package;
+        int attempt =
+            package_sending.max_attempts - package_sending.remaining_attempts;
+        package.setAttempt(attempt);
+
+        unconfirmed_packages_lock.unlock();
+        this->preprocessPackage(move(package), attempt);
+        unconfirmed_packages_lock.lock();
+    } else {
+        // Finished attempts to send the message
+        this->log(Logger::Level::WARNING, PrettyConsole::Color::RED,
+                  "Package [{}] has been removed from the network {}!",
+                  package_id, this->name);
+        this->expired_packages_counter->increment();
+        this->eraseUnconfirmedPackage(it);
     }
 }
 
+Configuration::ConnectionSettings Network::getFlowSettings(
+    const Package &package) {
+    const auto &message = package.getMessage();
+    Flow flow = {message.getSourceEntityId(), message.getTargetEntityId()};
+    lock_guard<mutex> lock(this->flow_settings_mutex);
+    auto it = this->flow_settings.find(flow);
+    if (it != this->flow_settings.end()) return it->second;
+
+    auto settings = this->configuration->getConnectionSettings(
+        package.getSourceEntity()->getName(),
+        package.getTargetEntity()->getName());
+    return this->flow_settings.insert({flow, settings}).first->second;
+}
+
+// Callers must hold unconfirmed_packages_mutex
+RetransmissionTimeout &Network::getRetransmissionTimeout(
+    Flow flow, const Configuration::ConnectionSettings &settings) {
+    auto it = this->retransmission_timeouts.find(flow);
+    if (it != this->retransmission_timeouts.end()) return it->second;
+
+    // Until the first sample, the configured timeout is used
+    RetransmissionTimeout retransmission_timeout(
+        settings.resend_timeout, this->configuration->getMinimumResendTimeout(),
+        this->configuration->getMaximumResendTimeout(),
+        this->configuration->getRetransmissionTimerTick());
+    return this->retransmission_timeouts.insert({flow, retransmission_timeout})
+        .first->second;
+}
+
+void Network::registerMetrics() {
+    Metrics::Labels labels = {{"network", this->name}};
+    this->received_packages_counter = &this->metrics->getCounter(
+        "network_received_packages_total",
+        "Packages handed to the network", labels);
+    this->transmissions_counter = &this->metrics->getCounter(
+        "network_transmissions_total",
+        "Attempts to send a package, retransmissions included", labels);
+    this->transmitted_bytes_counter = &this->metrics->getCounter(
+        "network_transmitted_bytes_total",
+        "Bytes of every attempt, encoded in the wire format", labels);
+    this->retransmissions_counter = &this->metrics->getCounter(
+        "network_retransmissions_total", "Attempts after the first one",
+        labels);
+    this->fast_retransmissions_counter = &this->metrics->getCounter(
+        "network_fast_retransmissions_total",
+        "Retransmissions sent before the resend timeout expired", labels);
+    this->lost_packages_counter = &this->metrics->getCounter(
+        "network_lost_packages_total", "Attempts lost in the network",
+        labels);
+    this->corrupted_packages_counter = &this->metrics->getCounter(
+        "network_corrupted_packages_total",
+        "Attempts corrupted in the network", labels);
+    this->expired_packages_counter = &this->metrics->getCounter(
+        "network_expired_packages_total",
+        "Packages removed after exhausting their attempts", labels);
+    this->coalesced_acknowledgements_counter = &this->metrics->getCounter(
+        "network_coalesced_acknowledgements_total",
+        "Acknowledgements replaced by a later one before being sent", labels);
+    this->piggybacked_acknowledgements_counter = &this->metrics->getCounter(
+        "network_piggybacked_acknowledgements_total",
+        "Acknowledgements carried by data going the other way", labels);
+    this->processing_queue_depth_gauge = &this->metrics->getGauge(
+        "network_processing_queue_depth",
+        "Packages waiting for a processing worker", labels);
+    this->unconfirmed_packages_gauge = &this->metrics->getGauge(
+        "network_unconfirmed_packages",
+        "Packages sent and not confirmed yet", labels);
+    this->round_trip_time_histogram = &this->metrics->getHistogram(
+        "network_round_trip_time_milliseconds",
+        "Time until a package sent only once is confirmed",
+        Metrics::getDurationBounds(), labels);
+}
+
+// Callers must hold unconfirmed_packages_mutex
+void Network::updateWindowOccupancy(const Package &package) {
+    const auto &message = package.getMessage();
+    Flow flow = {message.getSourceEntityId(), message.getTargetEntityId()};
+
+    auto gauge_it = this->window_occupancy_gauges.find(flow);
+    if (gauge_it == this->window_occupancy_gauges.end()) {
+        if (!package.hasResolvedEntities()) return;
+        Metrics::Gauge &gauge = this->metrics->getGauge(
+            "connection_window_occupancy",
+            "Sequenced packages in flight in a connection",
+            {{"network", this->name},
+             {"source", package.getSourceEntity()->getName()},
+             {"target", package.getTargetEntity()->getName()}});
+        gauge_it = this->window_occupancy_gauges.insert({flow, &gauge}).first;
+    }
+
+    auto flow_it = this->unconfirmed_sequence_numbers.find(flow);
+    gauge_it->second->set(flow_it != this->unconfirmed_sequence_numbers.end()
+                              ? flow_it->second.size()
+                              : 0);
+}
+
+// Callers must hold unconfirmed_packages_mutex
+chrono::time_point<chrono::steady_clock> Network::getRetransmissionDeadline(
+    const PackageSending &package_sending) const {
+    const auto &message = package_sending.package.getMessage();
+    auto it = this->confirmation_times.find(
+        {message.getSourceEntityId(), message.getTargetEntityId()});
+    auto start_time = package_sending.last_attempt_time;
+    if (it != this->confirmation_times.end())
+        start_time = max(start_time, it->second);
+    return start_time + package_sending.resend_timeout;
+}
+
+// Callers must hold unconfirmed_packages_mutex
+void Network::armRetransmissionTimer(
+    uuids::uuid package_id, const PackageSending &package_sending) {
+    auto deadline = this->getRetransmissionDeadline(package_sending);
+    this->retransmission_timers.arm(package_id, deadline);
+
+    if (this->simulator != nullptr) {
+        // Stale events find nothing to expire, so they need no cancelling
+        this->simulator->scheduleAt(deadline, [this]() {
+            unique_lock<mutex> lock(this->unconfirmed_packages_mutex);
+            this->expireRetransmissionTimers(lock);
+        });
+    } else {
+        this->package_sent_cv.notify_one();  // Notify the sending thread
+    }
+}
+
+void Network::expireRetransmissionTimers(
+    unique_lock<mutex> &unconfirmed_packages_lock) {
+    auto expired_packages_ids =
+        this->retransmission_timers.advance(this->now());
+
+    // A package may expire along with the window that already resent it
+    unordered_set<uuids::uuid> retransmitted_packages_ids;
+    for (auto expired_package_id : expired_packages_ids) {
+        if (retransmitted_packages_ids.contains(expired_package_id)) continue;
+
+        // Confirmations since the timer was armed push it back
+        auto it = this->unconfirmed_packages->find(expired_package_id);
+        if (it != this->unconfirmed_packages->end() &&
+            this->getRetransmissionDeadline(it->second) > this->now()) {
+            this->armRetransmissionTimer(expired_package_id, it->second);
+            continue;
+        }
+
+        for (auto package_id :
+             this->getPackagesToRetransmit(expired_package_id)) {
+            if (!retransmitted_packages_ids.insert(package_id).second)
+                continue;
+            this->retransmitPackage(package_id, unconfirmed_packages_lock);
+        }
+    }
+}
+
+vector<uuids::uuid> Network::getPackagesToRetransmit(
+    uuids::uuid expired_package_id) {
+    auto it = this->unconfirmed_packages->find(expired_package_id);
+    if (it == this->unconfirmed_packages->end()) return {};
+
+    const Package &package = it->second.package;
+    unsigned int sequence_number = package.getSequenceNumber();
+    if (sequence_number == 0) return {expired_package_id};
+
+    // The receiver drops everything after a missing package, so the rest of
+    // the window has to be sent again as well
+    const auto &message = package.getMessage();
+    auto connection = package.getSourceEntity()->findConnection(
+        message.getTargetEntityId());
+    if (connection == nullptr ||
+        connection->getArqStrategy() != Connection::ArqStrategy::GO_BACK_N)
+        return {expired_package_id};
+
+    auto flow_it = this->unconfirmed_sequence_numbers.find(
+        {message.getSourceEntityId(), message.getTargetEntityId()});
+    if (flow_it == this->unconfirmed_sequence_numbers.end())
+        return {expired_package_id};
+
+    vector<uuids::uuid> packages_ids;
+    for (auto sequence_it = flow_it->second.lower_bound(sequence_number);
+         sequence_it != flow_it->second.end(); sequence_it++)
+        packages_ids.push_back(sequence_it->second);
+    return packages_ids;
+}
+
+/* Acknowledgements */
+
+void Network::delayAcknowledgement(Package package) {
+    if (!this->resolveEntities(package)) return;
+    auto settings = this->getFlowSettings(package);
+    if (settings.acknowledgement_frequency <= 1) {
+        this->internalReceivePackage(move(package));
+        return;
+    }
+
+    const auto &message = package.getMessage();
+    Flow flow = {message.getSourceEntityId(), message.getTargetEntityId()};
+    optional<Package> due_package = nullopt;
+    {
+        lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+        auto it = this->pending_acknowledgements.find(flow);
+        if (it == this->pending_acknowledgements.end()) {
+            auto deadline = this->now() + settings.acknowledgement_delay;
+            it = this->pending_acknowledgements
+                     .insert({flow, {move(package), 1, deadline}})
+                     .first;
+            if (this->simulator != nullptr)
+                this->simulator->scheduleAt(
+                    deadline, [this]() { this->sendDueAcknowledgements(); });
+            else
+                this->package_sent_cv.notify_one();  // Notify the sending
+                                                     // thread
+        } else {
+            it->second.package = move(package);
+            it->second.count++;
+            this->coalesced_acknowledgements_counter->increment();
+        }
+
+        if (it->second.count >= settings.acknowledgement_frequency) {
+            due_package = move(it->second.package);
+            this->pending_acknowledgements.erase(it);
+        }
+    }
+
+    if (due_package.has_value())
+        this->internalReceivePackage(move(due_package.value()));
+}
+
+void Network::piggybackAcknowledgement(Package &package) {
+    const auto &message = package.getMessage();
+    auto it = this->pending_acknowledgements.find(
+        {message.getSourceEntityId(), message.getTargetEntityId()});
+    if (it == this->pending_acknowledgements.end()) return;
+
+    package.shareAcknowledgedRanges(it->second.package.getMessage());
+    this->pending_acknowledgements.erase(it);
+    this->piggybacked_acknowledgements_counter->increment();
+}
+
+vector<Package> Network::takeDueAcknowledgements(bool should_take_every_one) {
+    vector<Package> packages;
+    auto now = this->now();
+    for (auto it = this->pending_acknowledgements.begin();
+         it != this->pending_acknowledgements.end();) {
+        if (!should_take_every_one && it->second.deadline > now) {
+            it++;
+            continue;
+        }
+        packages.push_back(move(it->second.package));
+        it = this->pending_acknowledgements.erase(it);
+    }
+    return packages;
+}
+
+optional<chrono::time_point<chrono::steady_clock>>
+Network::getNextAcknowledgementDeadline() const {
+    optional<chrono::time_point<chrono::steady_clock>> next_deadline = nullopt;
+    for (const auto &[flow, pending_acknowledgement] :
+         this->pending_acknowledgements)
+        if (!next_deadline.has_value() ||
+            pending_acknowledgement.deadline < next_deadline.value())
+            next_deadline = pending_acknowledgement.deadline;
+    return next_deadline;
+}
+
+void Network::sendDueAcknowledgements(bool should_send_every_one) {
+    vector<Package> packages;
+    {
+        lock_guard<mutex> lock(this->unconfirmed_packages_mutex);
+        packages = this->takeDueAcknowledgements(should_send_every_one);
+    }
+    for (Package &package : packages)
+        this->internalReceivePackage(move(package));
+}
+
 /* Thread jobs */
 
 void Network::sendingThreadJob() {
+    unique_lock<mutex> lock(this->unconfirmed_packages_mutex);
     while (true) {
-        unique_lock<mutex> lock(this->unconfirmed_packages_mutex);
+        // Acknowledgements still held back are sent before stopping
+        if (!this->pending_acknowledgements.empty()) {
+            lock.unlock();
+            this->sendDueAcknowledgements(this->can_stop_sending_thread);
+            lock.lock();
+        }
 
         // Finish job if there are no packages to send
         if (this->can_stop_sending_thread && unconfirmed_packages->empty()) {
             break;
         }
 
-        for (auto it = this->unconfirmed_packages->begin();
-             it != this->unconfirmed_packages->end();) {
-            PackageSending &package_sending = it->second;
-
-            // Check if the timeout has expired
-            if (chrono::system_clock::now() -
-                    package_sending.last_attempt_time >
-                GenericProtocolConstants::resend_timeout) {
-                // Check if the message has remaining attempts
-                if (package_sending.remaining_attempts > 0) {
-                    package_sending.last_attempt_time =
-                        chrono::system_clock::now();
-                    package_sending.remaining_attempts--;
-                    lock.unlock();
-                    this->preprocessPackage(
-                        package_sending.package,
-                        GenericProtocolConstants::max_attempts_to_send_package -
-                            package_sending.remaining_attempts);
-                    lock.lock();
-                } else {
-                    // Finished attempts to send the message
-                    if (GenericProtocolConstants::debug_information) {
-                        this->printInformation(
-                            "Package [" +
-                                to_string(package_sending.package.getMessage()
-                                              .getId()) +
-                                "] has been removed from the network " +
-                                this->getName() + "!",
-                            cout, PrettyConsole::Color::RED);
-                    }
-                    it = this->unconfirmed_packages->erase(it);
-                }
-            } else {
-                it++;
-            }
-        }
-
-        // Wait for a message to send
-        lock.unlock();
-        this_thread::sleep_for(chrono::milliseconds(
-            GenericProtocolConstants::interval_to_check_unconfirmed_packages));
+        this->expireRetransmissionTimers(lock);
+
+        // Sleep until the next deadline or until a package is registered
+        auto next_deadline = this->retransmission_timers.getNextDeadline();
+        auto acknowledgement_deadline = this->getNextAcknowledgementDeadline();
+        if (acknowledgement_deadline.has_value() &&
+            (!next_deadline.has_value() ||
+             acknowledgement_deadline.value() < next_deadline.value()))
+            next_deadline = acknowledgement_deadline;
+        if (next_deadline.has_value())
+            this->package_sent_cv.wait_until(lock, next_deadline.value());
+        else if (!(this->can_stop_sending_thread &&
+                   unconfirmed_packages->empty()))
+            this->package_sent_cv.wait(lock);
     }
 }
 
-void Network::processingThreadJob() {
-    while (true) {
-        unique_lock<mutex> lock(this->packages_to_process_mutex);
+void Network::processingThreadJob(ProcessingWorker &worker) {
+    // Reused for every batch, so it only allocates while growing
+    vector<Package> packages;
+    packages.reserve(GenericProtocolConstants::processing_batch_size);
 
-        // Finish job if there are no messages to process
-        if (this->can_stop_processing_thread && packages_to_process->empty()) {
-            break;
+    while (true) {
+        // Read first, so packages pushed before closing are still taken
+        bool is_closed = worker.packages_to_process.isClosed();
+        size_t packages_count = worker.packages_to_process.pop(
+            packages, GenericProtocolConstants::processing_batch_size);
+
+        if (packages_count == 0) {
+            // Finish job if there are no messages to process
+            if (is_closed) break;
+            worker.packages_to_process.waitForValues();
+            continue;
         }
 
-        if (!this->packages_to_process->empty()) {
-            auto package = this->packages_to_process->front();
-            this->packages_to_process->pop();
-            lock.unlock();
-            this->processPackage(package);
-            lock.lock();
-        } else {
-            // Wait for a message to process
-            this->package_processed_cv.wait(lock);
-        }
+        this->processing_queue_depth_gauge->add(
+            -static_cast<int64_t>(packages_count));
+        for (Package &package : packages) this->processPackage(move(package));
+        packages.clear();
     }
 }
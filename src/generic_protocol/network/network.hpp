@@ -4,42 +4,144 @@
 #include <uuid.h>
 
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory_resource>
 #include <memory>
 #include <message.hpp>
 #include <mutex>
 #include <optional>
-#include <queue>
+#include <span>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "configuration.hpp"
 #include "entity.hpp"
 #include "generic_protocol_constants.hpp"
+#include "id_generator.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "mpsc_queue.hpp"
 #include "package.hpp"
+#include "pool_resource.hpp"
+#include "retransmission_timeout.hpp"
+#include "simulator.hpp"
+#include "timer_wheel.hpp"
+#include "wire_format.hpp"
 
 using namespace std;
 
 class Network {
+   public:
+    // Counted over every package sent through the network
+    struct Statistics {
+        uint64_t transmissions;
+        uint64_t transmitted_bytes;  // As encoded in the wire format
+        uint64_t retransmissions;
+        uint64_t fast_retransmissions;  // Included in the retransmissions
+        uint64_t lost_packages;
+        uint64_t corrupted_packages;
+    };
+
+    // Tell the sender what happened to its sequenced packages; they run while
+    // the network holds its lock, so they must not call it back
+    using PackageAcknowledgedCallback = function<void(
+        const Package &package,
+        optional<RetransmissionTimeout::Duration> round_trip_time)>;
+    using PackageLostCallback = function<void(const Package &package)>;
+
    private:
+    enum class RetransmissionCause {
+        TIMEOUT,
+        DUPLICATE_ACKNOWLEDGEMENTS,
+        CORRUPTION
+    };
+
     struct PackageSending {
         Package package;
+        int max_attempts;
         int remaining_attempts;
-        chrono::time_point<chrono::system_clock> last_attempt_time;
+        RetransmissionTimeout::Duration resend_timeout;
+        chrono::time_point<chrono::steady_clock> last_attempt_time;
 
-        PackageSending(Package package)
+        PackageSending(const Package &package,
+                       const Configuration::ConnectionSettings &settings,
+                       RetransmissionTimeout::Duration resend_timeout,
+                       chrono::time_point<chrono::steady_clock> now)
             : package(package),
-              last_attempt_time(chrono::system_clock::now()),
-              remaining_attempts(
-                  GenericProtocolConstants::max_attempts_to_send_package - 1) {
+              max_attempts(settings.max_attempts_to_send_package),
+              remaining_attempts(settings.max_attempts_to_send_package - 1),
+              resend_timeout(resend_timeout),
+              last_attempt_time(now) {
         }  // Subtract 1 because the first attempt is done instantly, so the
            // sendingThreadJob should not execute another attempt for it
     };
 
-    shared_ptr<uuids::uuid_random_generator> uuid_generator;
+    // Processes the packages of the flows assigned to it, in arrival order
+    struct ProcessingWorker {
+        // Closed when the worker must stop, once it is empty
+        MpscQueue<Package> packages_to_process;
+        thread processing_packages_thread;
+
+        // Virtual time when the last scheduled package leaves the worker
+        Simulator::TimePoint available_time;
+        mutex available_time_mutex;
+
+        ProcessingWorker()
+            : packages_to_process(
+                  GenericProtocolConstants::processing_queue_capacity),
+              available_time(Simulator::TimePoint()) {}
+    };
+
+    shared_ptr<IdGenerator> id_generator;
     string name;
-    function<shared_ptr<Entity>(uuids::uuid)> get_entity_by_id;
+    shared_ptr<EntitiesRegistry> entities;
+    shared_ptr<const Configuration> configuration;
+    shared_ptr<Metrics> metrics;
+    // When set, events run on the simulator's virtual clock and no thread is
+    // started
+    shared_ptr<Simulator> simulator;
+
+    using Flow = pair<uuids::uuid, uuids::uuid>;  // Source and target IDs
+
+    // Acknowledgement of data held back, standing for every one since the
+    // first held, as its ranges are cumulative
+    struct PendingAcknowledgement {
+        Package package;
+        unsigned int count;
+        chrono::time_point<chrono::steady_clock> deadline;
+    };
 
-    shared_ptr<map<uuids::uuid, PackageSending>> unconfirmed_packages;
+    // Acknowledgements in a row that did not move the cumulative point
+    struct DuplicateAcknowledgements {
+        unsigned int cumulative_sequence_number;
+        unsigned int count;
+    };
+
+    // Records of packages in flight, and their timers, are recycled here
+    PoolResource in_flight_pool;
+    shared_ptr<pmr::map<uuids::uuid, PackageSending>> unconfirmed_packages;
+    // Guarded by the same mutex
+    TimerWheel retransmission_timers;
+    pmr::map<Flow, pmr::map<unsigned int, uuids::uuid>>
+        unconfirmed_sequence_numbers;
+    map<Flow, Metrics::Gauge *> window_occupancy_gauges;
+    // Estimated for each flow, when the resend timeout is adaptive
+    map<Flow, RetransmissionTimeout> retransmission_timeouts;
+    // Last confirmation on each flow, which restarts the timers of the rest
+    // of its packages, as a single timer would be (RFC 6298, 5.3)
+    map<Flow, chrono::time_point<chrono::steady_clock>> confirmation_times;
+    // By the flow they travel on
+    map<Flow, PendingAcknowledgement> pending_acknowledgements;
+    // By the flow of the packages they acknowledge
+    map<Flow, DuplicateAcknowledgements> duplicate_acknowledgements;
+    // Resolved once for each flow, since entities keep their names
+    map<Flow, Configuration::ConnectionSettings> flow_settings;
+    mutex flow_settings_mutex;
+    vector<PackageAcknowledgedCallback> package_acknowledged_callbacks;
+    vector<PackageLostCallback> package_lost_callbacks;
     mutex unconfirmed_packages_mutex;
 
     thread package_sending_thread;
@@ -48,58 +150,132 @@ class Network {
                                          // package has been sent
     bool can_stop_sending_thread;
 
-    shared_ptr<queue<Package>> packages_to_process;
-    mutex packages_to_process_mutex;
+    vector<unique_ptr<ProcessingWorker>> processing_workers;
 
-    thread processing_packages_thread;
-    int processing_packages_count;
-    condition_variable
-        package_processed_cv;  // Condition variable to notify when a package
-                               // has been processed
-    bool can_stop_processing_thread;
+    // Owned by the metrics registry
+    Metrics::Counter *received_packages_counter;
+    Metrics::Counter *transmissions_counter;
+    Metrics::Counter *transmitted_bytes_counter;
+    Metrics::Counter *retransmissions_counter;
+    Metrics::Counter *fast_retransmissions_counter;
+    Metrics::Counter *lost_packages_counter;
+    Metrics::Counter *corrupted_packages_counter;
+    Metrics::Counter *expired_packages_counter;
+    Metrics::Counter *coalesced_acknowledgements_counter;
+    Metrics::Counter *piggybacked_acknowledgements_counter;
+    Metrics::Gauge *processing_queue_depth_gauge;
+    Metrics::Gauge *unconfirmed_packages_gauge;
+    Metrics::Histogram *round_trip_time_histogram;
 
     /* Methods */
-    shared_ptr<Entity> getEntityById(uuids::uuid entity_id);
-
+    chrono::time_point<chrono::steady_clock> now() const;
+    bool resolveEntities(Package &package);
     bool internalReceivePackage(Package package);
-    void registerPackage(Package package);
+    void registerPackage(const Package &package);
+    // Requires the lock on the unconfirmed packages
+    void registerUnconfirmedPackage(const Package &package);
 
     void sendingThreadJob();
+    chrono::time_point<chrono::steady_clock> getRetransmissionDeadline(
+        const PackageSending &package_sending) const;
+    void armRetransmissionTimer(uuids::uuid package_id,
+                                const PackageSending &package_sending);
+    void expireRetransmissionTimers(
+        unique_lock<mutex> &unconfirmed_packages_lock);
+    // Requires the lock on the unconfirmed packages; the expired package,
+    // followed by the rest of its window when its connection goes back N
+    vector<uuids::uuid> getPackagesToRetransmit(uuids::uuid expired_package_id);
     void joinSendingThread();
-    void tryToConfirmSomePackage(
-        optional<uuids::uuid> id_from_package_possibly_acknowledged);
+    // Confirms, once it arrives, what the package acknowledges, or resends
+    // what it reports as corrupted
+    void confirmAcknowledgedPackages(const Package &package);
+    // Requires the lock on the unconfirmed packages
+    void confirmAcknowledgedRanges(const Message &message);
+    // Requires the lock on the unconfirmed packages; returns the package to
+    // retransmit once the acknowledgements point at the same gap often enough
+    optional<uuids::uuid> countDuplicateAcknowledgement(const Message &message);
     void removePackageFromUnconfirmedPackages(uuids::uuid package_id);
+    void confirmPackage(uuids::uuid package_id,
+                        optional<unsigned int> delivered_attempt = nullopt);
+    void eraseUnconfirmedPackage(
+        pmr::map<uuids::uuid, PackageSending>::iterator package_iterator);
+    void retransmitPackage(
+        uuids::uuid package_id, unique_lock<mutex> &unconfirmed_packages_lock,
+        RetransmissionCause cause = RetransmissionCause::TIMEOUT);
+    // Once the connection delivers again, packages waiting on a backed off
+    // timeout are retried with the new one
+    void shortenRetransmissionTimers(
+        Flow flow, RetransmissionTimeout::Duration resend_timeout);
+    // The package must have its entities resolved
+    Configuration::ConnectionSettings getFlowSettings(const Package &package);
+    RetransmissionTimeout &getRetransmissionTimeout(
+        Flow flow, const Configuration::ConnectionSettings &settings);
+    void registerMetrics();
+
+    // Acknowledgements of data are held back, so a later one, or data going
+    // the other way, carries them instead
+    void delayAcknowledgement(Package package);
+    // Requires the lock on the unconfirmed packages
+    void piggybackAcknowledgement(Package &package);
+    // Requires the lock on the unconfirmed packages
+    vector<Package> takeDueAcknowledgements(bool should_take_every_one);
+    optional<chrono::time_point<chrono::steady_clock>>
+    getNextAcknowledgementDeadline() const;
+    void sendDueAcknowledgements(bool should_send_every_one = false);
+    void updateWindowOccupancy(const Package &package);
 
     bool preprocessPackage(Package package, int attempt = 1);
+    // Counts the transmission, returning false if the package is lost
+    bool transmitPackage(const Package &package, int attempt);
     bool hasPackageBeenLost(uuids::uuid message_id);
     bool insertPackageIntoProcessingQueue(Package package);
+    void enqueuePackage(ProcessingWorker &worker, Package package);
+    // Pushes the packages of one worker as a single batch
+    void enqueuePackages(ProcessingWorker &worker, span<Package> packages);
+    size_t getProcessingWorkerIndex(const Package &package) const;
+    ProcessingWorker &getProcessingWorker(const Package &package);
 
-    void processingThreadJob();
+    void processingThreadJob(ProcessingWorker &worker);
     void processPackage(Package package);
-    void simulateNetworkLatency();
+    void deliverPackage(Package package);
+    chrono::milliseconds getSimulatedLatency();
+    // Time the link takes to carry the encoded package
+    chrono::nanoseconds getTransmissionDelay(const Package &package) const;
+    void simulateNetworkLatency(const Package &package);
     void simulatePacketCorruption(Package &package);
-    void joinProcessingThread();
+    void joinProcessingThreads();
 
     void sendPackage(Package &package);
-    void finishPackageProcessing();
 
-    void printInformation(
-        string information, ostream &output_stream,
-        PrettyConsole::Color color = PrettyConsole::Color::DEFAULT) const;
+    template <typename... Arguments>
+    void log(Logger::Level level, PrettyConsole::Color color,
+             const char *format, const Arguments &...arguments) const {
+        Logger::getInstance().log(level, Logger::Category::NETWORK, this->name,
+                                  nullopt, color, format, arguments...);
+    }
 
    public:
     /* Construction */
-    Network(shared_ptr<uuids::uuid_random_generator> uuid_generator,
-            string name,
-            function<shared_ptr<Entity>(uuids::uuid)> get_entity_by_id);
+    Network(shared_ptr<IdGenerator> id_generator, string name,
+            shared_ptr<EntitiesRegistry> entities,
+            shared_ptr<const Configuration> configuration,
+            shared_ptr<Metrics> metrics,
+            shared_ptr<Simulator> simulator = nullptr);
     ~Network();
 
     /* Getters */
     string getName() const;
+    Statistics getStatistics() const;
+    PoolResource::Statistics getPoolStatistics() const;
 
     /* Methods */
     bool receivePackage(Package package);
+    // Takes the packages out of the span at once, under one lock on the
+    // unconfirmed packages, and returns whether each one has been accepted
+    vector<bool> receivePackages(span<Package> packages);
     void joinThreads();
+    void onPackageAcknowledged(PackageAcknowledgedCallback callback);
+    void onPackageLost(PackageLostCallback callback);
 };
 
 #endif  // NETWORK_HPP_
@@ -6,22 +6,65 @@ using namespace std;
 
 /* Getters */
 
-Message Package::getMessage() const { return this->message; }
+const Message &Package::getMessage() const { return this->message; }
 
 bool Package::isCorrupted() const { return this->is_corrupted; }
 
 bool Package::shouldBeConfirmed() const { return this->should_be_confirmed; }
 
+unsigned int Package::getSequenceNumber() const {
+    return this->sequence_number;
+}
+
+unsigned int Package::getAttempt() const { return this->attempt; }
+
+optional<unsigned int> Package::getAcknowledgedAttempt() const {
+    return this->acknowledged_attempt;
+}
+
+shared_ptr<Entity> Package::getSourceEntity() const {
+    return this->source_entity;
+}
+
+shared_ptr<Entity> Package::getTargetEntity() const {
+    return this->target_entity;
+}
+
+bool Package::hasResolvedEntities() const {
+    return this->source_entity != nullptr && this->target_entity != nullptr;
+}
+
 /* Setters */
 
 void Package::setCorrupted(bool is_corrupted) {
     this->is_corrupted = is_corrupted;
 }
 
+void Package::setAttempt(unsigned int attempt) { this->attempt = attempt; }
+
+void Package::setAcknowledgedAttempt(unsigned int acknowledged_attempt) {
+    this->acknowledged_attempt = acknowledged_attempt;
+}
+
+void Package::setEntities(shared_ptr<Entity> source_entity,
+                          shared_ptr<Entity> target_entity) {
+    this->source_entity = source_entity;
+    this->target_entity = target_entity;
+}
+
 void Package::setIdFromMessageBeingAcknowledged(uuids::uuid id_from_message) {
     this->message.setIdFromMessageBeingAcknowledged(id_from_message);
 }
 
+void Package::setAcknowledgedRanges(
+    vector<Message::SequenceRange> acknowledged_ranges) {
+    this->message.setAcknowledgedRanges(move(acknowledged_ranges));
+}
+
+void Package::shareAcknowledgedRanges(const Message &message) {
+    this->message.shareAcknowledgedRanges(message);
+}
+
 /* Methods */
 
 void Package::print(function<void(string)> print_information) const {
@@ -1,39 +1,69 @@
 #ifndef PACKAGE_HPP_
 #define PACKAGE_HPP_
 
+#include <memory>
+#include <optional>
+#include <utility>
+
 #include "message.hpp"
 
 using namespace std;
 
+class Entity;
+
 class Package {
    private:
     Message message;
     bool should_be_confirmed;
     unsigned int sequence_number;
     bool is_corrupted;
+    unsigned int attempt;  // Which transmission of the package this copy is
+    // Which transmission of the acknowledged package arrived, when known
+    optional<unsigned int> acknowledged_attempt;
+
+    // Resolved once when the package enters a network
+    shared_ptr<Entity> source_entity;
+    shared_ptr<Entity> target_entity;
 
    public:
     /* Construction */
     Package(Message message, bool should_be_confirmed,
             unsigned int sequence_number)
-        : message(message),
+        : message(move(message)),
           should_be_confirmed(should_be_confirmed),
           sequence_number(sequence_number),
-          is_corrupted(false) {}
+          is_corrupted(false),
+          attempt(1),
+          acknowledged_attempt(nullopt),
+          source_entity(nullptr),
+          target_entity(nullptr) {}
 
     Package(Message message, bool should_be_confirmed)
-        : Package(message, should_be_confirmed, 0) {}
+        : Package(move(message), should_be_confirmed, 0) {}
 
     ~Package() {}
 
     /* Getters */
-    Message getMessage() const;
+    const Message &getMessage() const;
     bool isCorrupted() const;
     bool shouldBeConfirmed() const;
+    unsigned int getSequenceNumber() const;
+    unsigned int getAttempt() const;
+    optional<unsigned int> getAcknowledgedAttempt() const;
+    shared_ptr<Entity> getSourceEntity() const;
+    shared_ptr<Entity> getTargetEntity() const;
+    bool hasResolvedEntities() const;
 
     /* Setters */
     void setCorrupted(bool is_corrupted);
+    void setAttempt(unsigned int attempt);
+    void setAcknowledgedAttempt(unsigned int acknowledged_attempt);
+    void setEntities(shared_ptr<Entity> source_entity,
+                     shared_ptr<Entity> target_entity);
     void setIdFromMessageBeingAcknowledged(uuids::uuid id_from_message);
+    void setAcknowledgedRanges(
+        vector<Message::SequenceRange> acknowledged_ranges);
+    void shareAcknowledgedRanges(const Message &message);
 
     /* Methods */
     void print(function<void(string)> print_information) const;
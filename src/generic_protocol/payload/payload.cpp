@@ -0,0 +1,35 @@
+#include "payload.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Construction */
+
+Payload::Payload(string content) : offset(0), size(content.size()) {
+    this->buffer = make_shared<const string>(move(content));
+}
+
+/* Getters */
+
+string_view Payload::getView() const {
+    if (this->buffer == nullptr) return string_view();
+    return string_view(*this->buffer).substr(this->offset, this->size);
+}
+
+size_t Payload::getSize() const { return this->size; }
+
+bool Payload::isEmpty() const { return this->size == 0; }
+
+long Payload::getReferencesCount() const { return this->buffer.use_count(); }
+
+/* Methods */
+
+Payload Payload::slice(size_t offset, size_t size) const {
+    Payload slice = *this;
+    slice.offset = this->offset + min(offset, this->size);
+    slice.size = min(size, this->size - (slice.offset - this->offset));
+    return slice;
+}
+
+string Payload::toString() const { return string(this->getView()); }
@@ -0,0 +1,41 @@
+#ifndef PAYLOAD_HPP_
+#define PAYLOAD_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/*
+ * Immutable bytes carried by a message.
+ * Copies and slices share one reference-counted buffer, so passing a payload
+ * along, retransmitting it or splitting it into segments never copies bytes.
+ */
+class Payload {
+   private:
+    shared_ptr<const string> buffer;
+    size_t offset;
+    size_t size;
+
+   public:
+    /* Construction */
+    Payload() : buffer(nullptr), offset(0), size(0) {}
+    // Takes over the content, which is never copied again
+    Payload(string content);
+
+    /* Getters */
+    string_view getView() const;
+    size_t getSize() const;
+    bool isEmpty() const;
+    // Payloads sharing the buffer, this one included
+    long getReferencesCount() const;
+
+    /* Methods */
+    // Shares the buffer; out of range bounds are clamped, as in substr
+    Payload slice(size_t offset, size_t size = string::npos) const;
+    string toString() const;
+};
+
+#endif  // PAYLOAD_HPP_
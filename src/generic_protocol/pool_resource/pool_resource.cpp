@@ -0,0 +1,113 @@
+#include "pool_resource.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Construction */
+
+PoolResource::PoolResource(pmr::memory_resource *upstream)
+    : upstream(upstream),
+      allocations(0),
+      reused_blocks(0),
+      upstream_allocations(0),
+      bytes_in_use(0),
+      peak_bytes_in_use(0),
+      reserved_bytes(0) {
+    this->free_lists.fill(nullptr);
+}
+
+PoolResource::~PoolResource() {
+    for (const Chunk &chunk : this->chunks)
+        this->upstream->deallocate(chunk.memory, chunk.size, block_alignment);
+}
+
+/* Getters */
+
+PoolResource::Statistics PoolResource::getStatistics() const {
+    return {this->allocations.load(memory_order_relaxed),
+            this->reused_blocks.load(memory_order_relaxed),
+            this->upstream_allocations.load(memory_order_relaxed),
+            this->bytes_in_use.load(memory_order_relaxed),
+            this->peak_bytes_in_use.load(memory_order_relaxed),
+            this->reserved_bytes.load(memory_order_relaxed)};
+}
+
+/* Memory resource */
+
+void *PoolResource::do_allocate(size_t bytes, size_t alignment) {
+    this->allocations.fetch_add(1, memory_order_relaxed);
+
+    if (bytes > maximum_block_size || alignment > block_alignment) {
+        void *pointer = this->upstream->allocate(bytes, alignment);
+        this->upstream_allocations.fetch_add(1, memory_order_relaxed);
+        this->reserved_bytes.fetch_add(bytes, memory_order_relaxed);
+        this->addBytesInUse(bytes);
+        return pointer;
+    }
+
+    size_t size_class = getSizeClass(bytes);
+    if (this->free_lists[size_class] == nullptr)
+        this->refill(size_class);
+    else
+        this->reused_blocks.fetch_add(1, memory_order_relaxed);
+
+    FreeBlock *block = this->free_lists[size_class];
+    this->free_lists[size_class] = block->next;
+    this->addBytesInUse((size_class + 1) * block_alignment);
+    return block;
+}
+
+void PoolResource::do_deallocate(void *pointer, size_t bytes,
+                                 size_t alignment) {
+    if (bytes > maximum_block_size || alignment > block_alignment) {
+        this->bytes_in_use.fetch_sub(bytes, memory_order_relaxed);
+        this->reserved_bytes.fetch_sub(bytes, memory_order_relaxed);
+        this->upstream->deallocate(pointer, bytes, alignment);
+        return;
+    }
+
+    size_t size_class = getSizeClass(bytes);
+    FreeBlock *block = static_cast<FreeBlock *>(pointer);
+    block->next = this->free_lists[size_class];
+    this->free_lists[size_class] = block;
+    this->bytes_in_use.fetch_sub((size_class + 1) * block_alignment,
+                                 memory_order_relaxed);
+}
+
+bool PoolResource::do_is_equal(
+    const pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+/* Auxiliary */
+
+size_t PoolResource::getSizeClass(size_t bytes) {
+    return (max<size_t>(bytes, 1) + block_alignment - 1) / block_alignment -
+           1;
+}
+
+void PoolResource::refill(size_t size_class) {
+    size_t block_size = (size_class + 1) * block_alignment;
+    size_t chunk_size = block_size * blocks_per_chunk;
+    char *memory = static_cast<char *>(
+        this->upstream->allocate(chunk_size, block_alignment));
+    this->chunks.push_back({memory, chunk_size});
+    this->upstream_allocations.fetch_add(1, memory_order_relaxed);
+    this->reserved_bytes.fetch_add(chunk_size, memory_order_relaxed);
+
+    // Thread the new blocks in front of the free list, which is empty
+    for (size_t i = blocks_per_chunk; i > 0; i--) {
+        FreeBlock *block =
+            reinterpret_cast<FreeBlock *>(memory + (i - 1) * block_size);
+        block->next = this->free_lists[size_class];
+        this->free_lists[size_class] = block;
+    }
+}
+
+void PoolResource::addBytesInUse(size_t bytes) {
+    uint64_t bytes_in_use =
+        this->bytes_in_use.fetch_add(bytes, memory_order_relaxed) + bytes;
+    if (bytes_in_use > this->peak_bytes_in_use.load(memory_order_relaxed))
+        this->peak_bytes_in_use.store(bytes_in_use, memory_order_relaxed);
+}
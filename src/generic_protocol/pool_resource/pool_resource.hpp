@@ -0,0 +1,85 @@
+#ifndef POOL_RESOURCE_HPP_
+#define POOL_RESOURCE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Memory resource for containers of in-flight records.
+ *
+ * Small blocks are carved from chunks, grouped by size class, and freed
+ * blocks are kept in a free list of their class to be handed out again.
+ * Once the containers have grown to their working size, allocating and
+ * freeing only move blocks between them and the free lists. Chunks go back to
+ * the upstream resource when the pool is destroyed.
+ * The pool is not synchronized, so each one must be used under a single lock;
+ * statistics can be read from any thread.
+ */
+class PoolResource : public pmr::memory_resource {
+   public:
+    struct Statistics {
+        uint64_t allocations;
+        uint64_t reused_blocks;  // Allocations served from a free list
+        uint64_t upstream_allocations;
+        uint64_t bytes_in_use;
+        uint64_t peak_bytes_in_use;
+        // Taken from upstream and not returned, larger blocks included, so
+        // it is never below the bytes in use
+        uint64_t reserved_bytes;
+    };
+
+    static constexpr size_t block_alignment = alignof(max_align_t);
+    static constexpr size_t size_classes_count = 32;
+    // Larger blocks bypass the pool
+    static constexpr size_t maximum_block_size =
+        block_alignment * size_classes_count;
+    static constexpr size_t blocks_per_chunk = 32;
+
+   private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct Chunk {
+        void *memory;
+        size_t size;
+    };
+
+    pmr::memory_resource *upstream;
+    array<FreeBlock *, size_classes_count> free_lists;
+    vector<Chunk> chunks;
+
+    atomic<uint64_t> allocations;
+    atomic<uint64_t> reused_blocks;
+    atomic<uint64_t> upstream_allocations;
+    atomic<uint64_t> bytes_in_use;
+    atomic<uint64_t> peak_bytes_in_use;
+    atomic<uint64_t> reserved_bytes;
+
+    static size_t getSizeClass(size_t bytes);
+    void refill(size_t size_class);
+    void addBytesInUse(size_t bytes);
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const pmr::memory_resource &other) const noexcept override;
+
+   public:
+    /* Construction */
+    explicit PoolResource(
+        pmr::memory_resource *upstream = pmr::new_delete_resource());
+    ~PoolResource();
+    PoolResource(const PoolResource &) = delete;
+    PoolResource &operator=(const PoolResource &) = delete;
+
+    /* Getters */
+    Statistics getStatistics() const;
+};
+
+#endif  // POOL_RESOURCE_HPP_
@@ -1,6 +1,10 @@
 #include "protocol.hpp"
 
+#include <algorithm>
+
 #include "entity.hpp"
+#include "file_storage.hpp"
+#include "logger.hpp"
 #include "message.hpp"
 #include "package.hpp"
 
@@ -8,122 +12,104 @@ using namespace std;
 
 /* Construction */
 
-Protocol::Protocol(shared_ptr<uuids::uuid_random_generator> uuid_generator,
-                   string network_name) {
-    this->uuid_generator = uuid_generator;
-    this->entities = make_shared<EntitiesList>();
-    this->connections = make_shared<ConnectionsMap>();
-    this->network = make_unique<Network>(
-        this->uuid_generator, network_name, [this](uuids::uuid entity_id) {
-            return this->getEntityById(entity_id);
+Protocol::Protocol(shared_ptr<IdGenerator> id_generator, string network_name,
+                   shared_ptr<const Configuration> configuration,
+                   shared_ptr<Simulator> simulator) {
+    this->id_generator = id_generator;
+    this->configuration = configuration;
+    this->simulator = simulator;
+    this->entities = make_shared<EntitiesRegistry>();
+    this->metrics = make_shared<Metrics>();
+    this->handshake_duration_histogram = &this->metrics->getHistogram(
+        "connection_handshake_duration_milliseconds",
+        "Time until a connection is established",
+        Metrics::getDurationBounds(), {{"network", network_name}});
+
+    // Connections are tuned by the names of the entities they link
+    this->connections = make_shared<ConnectionsMap>(
+        [this](uuids::uuid first_entity_id, uuids::uuid second_entity_id) {
+            auto first_entity = this->entities->find(first_entity_id);
+            auto second_entity = this->entities->find(second_entity_id);
+            auto settings = this->configuration->getConnectionSettings(
+                first_entity != nullptr ? first_entity->getName() : "",
+                second_entity != nullptr ? second_entity->getName() : "");
+            return Connection::Settings{settings.buffer_size,
+                                        settings.arq_strategy,
+                                        settings.congestion_control,
+                                        settings.maximum_congestion_window};
+        });
+
+    this->network =
+        make_unique<Network>(this->id_generator, network_name, this->entities,
+                             this->configuration, this->metrics,
+                             this->simulator);
+
+    // Senders size their congestion windows from what the network sees
+    this->network->onPackageAcknowledged(
+        [this](const Package &package,
+               optional<RetransmissionTimeout::Duration> round_trip_time) {
+            const auto &message = package.getMessage();
+            auto connection = this->connections->find(
+                message.getSourceEntityId(), message.getTargetEntityId());
+            if (connection != nullptr)
+                connection->onPackageAcknowledged(round_trip_time);
         });
+    this->network->onPackageLost([this](const Package &package) {
+        const auto &message = package.getMessage();
+        auto connection = this->connections->find(message.getSourceEntityId(),
+                                                  message.getTargetEntityId());
+        if (connection != nullptr)
+            connection->onPackageLost(package.getSequenceNumber());
+    });
+
+    if (!this->configuration->getMetricsFile().empty())
+        this->metrics->startPeriodicExport(
+            this->configuration->getMetricsFile(),
+            this->configuration->getMetricsFormat(),
+            this->configuration->getMetricsExportInterval());
+
+    Logger::getInstance().setMinimumLevel(
+        this->configuration->isDebugInformation() ? Logger::Level::DEBUG
+                                                  : Logger::Level::WARNING);
 }
 
 Protocol::~Protocol() {
+    // Pending events point to the network, so they must not outlive it
+    if (this->simulator != nullptr) this->simulator->clear();
     this->entities->clear();
     this->connections->clear();
     this->network->joinThreads();
+    // Also writes the last snapshot
+    this->metrics->stopPeriodicExport();
 }
 
 /* Getters */
 
 shared_ptr<Entity> Protocol::getEntityById(uuids::uuid entity_id) {
     if (this->entities == nullptr) return nullptr;
-    for (auto entity : *this->entities) {
-        if (entity->getId() == entity_id) {
-            return entity;
-        }
-    }
-    return nullptr;
+    return this->entities->find(entity_id);
 }
 
 /* Methods */
 
 uuids::uuid Protocol::createEntity(string name, ostringstream &output_stream) {
-    uuids::uuid entity_id = this->uuid_generator->operator()();
-
-    auto connect_lambda = [this](uuids::uuid source_entity_id,
-                                 uuids::uuid target_entity_id,
-                                 uuids::uuid message_id, ConnectionStep step) {
-        Connection::connect(
-            this->connections,
-            {source_entity_id, target_entity_id, message_id, step});
-    };
-    ConnectFunction connect_function = make_shared<
-        function<void(ConnectFunctionParameters connect_function_parameters)>>(
-        [connect_lambda](ConnectFunctionParameters params) {
-            apply(connect_lambda, params);
-        });
-
-    auto remove_connection_lambda = [this](uuids::uuid source_entity_id,
-                                           uuids::uuid target_entity_id) {
-        Connection::removeConnection(this->connections,
-                                     {source_entity_id, target_entity_id});
-    };
-    RemoveConnectionFunction remove_connection_function =
-        make_shared<function<void(RemoveConnectionFunctionParameters
-                                      remove_connection_function_parameters)>>(
-            [remove_connection_lambda](
-                RemoveConnectionFunctionParameters params) {
-                apply(remove_connection_lambda, params);
-            });
-
-    auto is_connected_at_step_lambda = [this](uuids::uuid source_entity_id,
-                                              uuids::uuid target_entity_id,
-                                              ConnectionStep step) {
-        return Connection::isConnectedAtStep(
-            this->connections, {source_entity_id, target_entity_id, step});
-    };
-    IsConnectedAtStepFunction is_connected_at_step_function = make_shared<
-        function<bool(IsConnectedAtStepFunctionParameters
-                          is_connected_at_step_function_parameters)>>(
-        [is_connected_at_step_lambda](
-            IsConnectedAtStepFunctionParameters params) {
-            return apply(is_connected_at_step_lambda, params);
-        });
-
-    auto can_send_package_lambda = [this](uuids::uuid source_entity_id,
-                                          uuids::uuid target_entity_id) {
-        return Connection::canSendPackage(this->connections,
-                                          {source_entity_id, target_entity_id});
-    };
-    CanSendPackageFunction can_send_package_function =
-        make_shared<function<bool(CanSendPackageFunctionParameters
-                                      can_send_package_function_parameters)>>(
-            [can_send_package_lambda](CanSendPackageFunctionParameters params) {
-                return apply(can_send_package_lambda, params);
-            });
-
-    auto can_store_data_lambda = [this](uuids::uuid source_entity_id,
-                                        uuids::uuid target_entity_id,
-                                        uuids::uuid message_id) {
-        return Connection::canStoreData(
-            this->connections,
-            {source_entity_id, target_entity_id, message_id});
-    };
-    CanStoreDataFunction can_store_data_function = make_shared<function<bool(
-        CanStoreDataFunctionParameters can_store_data_function_parameters)>>(
-        [can_store_data_lambda](CanStoreDataFunctionParameters params) {
-            return apply(can_store_data_lambda, params);
-        });
-
-    auto dequeue_package_lambda = [this](uuids::uuid source_entity_id,
-                                         uuids::uuid target_entity_id,
-                                         uuids::uuid message_id) {
-        Connection::dequeuePackage(
-            this->connections,
-            {source_entity_id, target_entity_id, message_id});
-    };
-    DequeuePackageFunction dequeue_package_function = make_shared<function<void(
-        DequeuePackageFunctionParameters dequeue_package_function_parameters)>>(
-        [dequeue_package_lambda](DequeuePackageFunctionParameters params) {
-            apply(dequeue_package_lambda, params);
-        });
+    uuids::uuid entity_id = this->id_generator->generate();
+
+    unique_ptr<Storage> storage;
+    string storage_directory = this->configuration->getStorageDirectory();
+    if (!storage_directory.empty()) {
+        string storage_path =
+            storage_directory + "/" + to_string(entity_id) + ".storage";
+        storage = FileStorage::open(storage_path,
+                                    this->configuration->getStorageSettings());
+        if (storage == nullptr)
+            printInformation("Could not open " + storage_path +
+                                 ", so data is kept in memory",
+                             output_stream);
+    }
 
     shared_ptr<Entity> entity = make_shared<Entity>(
-        entity_id, name, connect_function, remove_connection_function,
-        is_connected_at_step_function, can_send_package_function,
-        can_store_data_function, dequeue_package_function);
+        entity_id, name, this->connections, move(storage));
 
     printInformation(
         entity->getName() + " [" + to_string(entity->getId()) + "]",
@@ -133,7 +119,7 @@ uuids::uuid Protocol::createEntity(string name, ostringstream &output_stream) {
         this->printInformation(PrettyConsole::tab + message, output_stream);
     }});
 
-    this->entities->push_back(entity);
+    this->entities->insert(entity);
 
     return entity_id;
 }
@@ -150,101 +136,234 @@ shared_ptr<Connection> Protocol::connectEntities(
         return nullptr;
     }
 
-    auto connection_it = this->connections->find(
-        {source_entity->getId(), target_entity->getId()});
-    shared_ptr<Connection> connection = nullptr;
+    // Created up front, so the handshake can be awaited on it
+    shared_ptr<Connection> connection = this->connections->findOrCreate(
+        source_entity->getId(), target_entity->getId());
 
-    if (connection_it != this->connections->end()) {
-        connection = connection_it->second;
-        if (connection->isConnectedAtStep(ConnectionStep::ACK_ACK_SYN)) {
-            printInformation("Connection already exists", output_stream);
-            return connection;
-        }
+    if (connection->isConnectedAtStep(ConnectionStep::ACK_ACK_SYN)) {
+        printInformation("Connection already exists", output_stream);
+        return connection;
     }
 
-    Message syn_message(this->uuid_generator, source_entity->getId(),
+    Message syn_message(this->id_generator, source_entity->getId(),
                         target_entity->getId(), Message::Code::SYN, nullopt,
-                        nullopt, "");
+                        nullopt, Payload());
     Package syn_package(syn_message, true, 0);
 
+    auto handshake_start = this->now();
     this->network->receivePackage(syn_package);
 
-    unsigned int attempts = 0;
-    while (attempts < GenericProtocolConstants::max_attempts_to_connect) {
-        auto connection_it = this->connections->find(
-            {source_entity->getId(), target_entity->getId()});
-        if (connection_it != this->connections->end()) {
-            connection = connection_it->second;
-            if (connection->isConnectedAtStep(ConnectionStep::ACK_ACK_SYN)) {
-                printInformation("Entities connected", output_stream);
-                return connection;
-            }
-        }
-        this_thread::sleep_for(
-            GenericProtocolConstants::interval_to_check_connections);
-        attempts++;
+    if (this->waitUntil(
+            [connection]() {
+                return connection->isConnectedAtStep(
+                    ConnectionStep::ACK_ACK_SYN);
+            },
+            this->configuration->getConnectionTimeout(),
+            [connection](Connection::Timeout timeout) {
+                return connection->waitUntilEstablished(timeout);
+            })) {
+        this->handshake_duration_histogram->observe(
+            chrono::duration<double, milli>(this->now() - handshake_start)
+                .count());
+        printInformation("Entities connected", output_stream);
+        return connection;
     }
 
     printInformation("Connection failed!", output_stream);
     return nullptr;
 }
 
-void Protocol::sendData(uuids::uuid source_entity_id,
+bool Protocol::sendData(uuids::uuid source_entity_id,
                         uuids::uuid target_entity_id, deque<string> contents,
                         ostringstream &output_stream) {
+    return this->sendMessages(
+        source_entity_id, target_entity_id, contents.size(),
+        [&](size_t index) {
+            return Message(this->id_generator, source_entity_id,
+                           target_entity_id, Message::Code::DATA, nullopt,
+                           nullopt, move(contents[index]));
+        },
+        output_stream);
+}
+
+bool Protocol::sendPayload(uuids::uuid source_entity_id,
+                           uuids::uuid target_entity_id, string payload,
+                           ostringstream &output_stream) {
+    auto source_entity = this->getEntityById(source_entity_id);
+    auto target_entity = this->getEntityById(target_entity_id);
+    size_t segment_size =
+        this->configuration
+            ->getConnectionSettings(
+                source_entity != nullptr ? source_entity->getName() : "",
+                target_entity != nullptr ? target_entity->getName() : "")
+            .segment_size;
+
+    // Even an empty payload takes one segment
+    size_t segments_count =
+        max<size_t>(1, (payload.size() + segment_size - 1) / segment_size);
+    uuids::uuid payload_id = this->id_generator->generate();
+    // Segments are slices of the same buffer
+    Payload buffer(move(payload));
+
+    return this->sendMessages(
+        source_entity_id, target_entity_id, segments_count,
+        [&](size_t index) {
+            size_t offset = index * segment_size;
+            Message message(this->id_generator, source_entity_id,
+                            target_entity_id, Message::Code::DATA, nullopt,
+                            nullopt, buffer.slice(offset, segment_size));
+            message.setSegment({payload_id, offset, buffer.getSize()});
+            return message;
+        },
+        output_stream);
+}
+
+bool Protocol::sendMessages(uuids::uuid source_entity_id,
+                            uuids::uuid target_entity_id,
+                            size_t messages_count,
+                            function<Message(size_t index)> create_message,
+                            ostringstream &output_stream) {
     shared_ptr<Entity> source_entity = this->getEntityById(source_entity_id);
     if (source_entity == nullptr) {
         printInformation("Source entity not found", output_stream);
-        return;
+        return false;
     }
     shared_ptr<Entity> target_entity = this->getEntityById(target_entity_id);
     if (target_entity == nullptr) {
         printInformation("Target entity not found", output_stream);
-        return;
+        return false;
     }
 
     shared_ptr<Connection> connection =
         this->connectEntities(source_entity, target_entity, output_stream);
     if (connection == nullptr) {
         this->printInformation("Could not send data!", output_stream);
+        return false;
     }
+    this->observeDeliveries(connection);
+
+    vector<Package> packages;
+    for (size_t i = 0; i < messages_count;) {
+        if (!this->waitUntil(
+                [connection]() {
+                    return connection->hasWindowSpaceAvailable();
+                },
+                this->configuration->getSendDataTimeout(),
+                [connection](Connection::Timeout timeout) {
+                    return connection->waitForWindowSpace(timeout);
+                })) {
+            printInformation("Could not send data!", output_stream);
+            return false;
+        }
 
-    unsigned int sequence_number = 0;
-    for (auto content : contents) {
-        unsigned int attempts = 0;
-        connection->lockQueue();
-        while (!connection->canSendPackage() &&
-               attempts < GenericProtocolConstants::max_attempts_to_send_data) {
-            this_thread::sleep_for(
-                GenericProtocolConstants::interval_to_send_data);
+        // Every package the window takes now is sent as one batch
+        packages.clear();
+        while (i < messages_count && connection->hasWindowSpaceAvailable()) {
+            Message message = create_message(i++);
+            unsigned int sequence_number =
+                connection->enqueuePackage(message.getId());
+            packages.emplace_back(move(message), true, sequence_number);
         }
-        if (attempts == GenericProtocolConstants::max_attempts_to_send_data) {
-            printInformation("Could not send data!", output_stream);
-            return;
+
+        {
+            lock_guard<mutex> lock(this->deliveries_mutex);
+            if (!this->message_delivered_callbacks.empty())
+                for (const Package &package : packages)
+                    this->sending_times.insert(
+                        {package.getMessage().getId(), this->now()});
         }
 
-        sequence_number++;
-        Message message =
-            Message(this->uuid_generator, source_entity_id, target_entity_id,
-                    Message::Code::DATA, nullopt, nullopt, content);
-        Package package(message, true, sequence_number);
+        // Printed before the network takes the packages
+        if (this->configuration->isDebugInformation()) {
+            for (const Package &package : packages) {
+                package.print({[this, &output_stream](string information) {
+                    this->printInformation(PrettyConsole::tab + information,
+                                           output_stream);
+                }});
+                output_stream << endl;
+            }
+            cout << output_stream.str();
+            output_stream.str("");
+        }
+        this->network->receivePackages(packages);
+    }
 
-        connection->enqueuePackage(message.getId());
-        this->network->receivePackage(package);
+    if (!this->waitUntil(
+            [connection]() {
+                return connection->getUnconfirmedPackagesCount() == 0;
+            },
+            this->configuration->getSendDataTimeout(),
+            [connection](Connection::Timeout timeout) {
+                return connection->waitUntilAllConfirmed(timeout);
+            })) {
+        printInformation("Could not confirm every message!", output_stream);
+        return false;
+    }
+    printInformation("Messages sent", output_stream);
+    return true;
+}
 
-        connection->unlockQueue();
+bool Protocol::setArqStrategy(uuids::uuid first_entity_id,
+                              uuids::uuid second_entity_id,
+                              Connection::ArqStrategy arq_strategy) {
+    auto connection =
+        this->connections->findOrCreate(first_entity_id, second_entity_id);
+    return connection->setArqStrategy(arq_strategy);
+}
 
-        package.print({[this, &output_stream](string information) {
-            this->printInformation(PrettyConsole::tab + information,
-                                   output_stream);
-        }});
-        output_stream << endl;
-        cout << output_stream.str();
-        output_stream.str("");
+bool Protocol::waitUntil(function<bool()> condition,
+                         Connection::Timeout timeout,
+                         function<bool(Connection::Timeout)> wait) {
+    if (this->simulator == nullptr) return wait(timeout);
+    return this->simulator->runUntil(condition,
+                                     this->simulator->now() + timeout);
+}
+
+void Protocol::onMessageDelivered(MessageDeliveredCallback callback) {
+    lock_guard<mutex> lock(this->deliveries_mutex);
+    this->message_delivered_callbacks.push_back(callback);
+}
+
+Network::Statistics Protocol::getNetworkStatistics() const {
+    return this->network->getStatistics();
+}
+
+PoolResource::Statistics Protocol::getNetworkPoolStatistics() const {
+    return this->network->getPoolStatistics();
+}
+
+shared_ptr<Metrics> Protocol::getMetrics() const { return this->metrics; }
+
+/* Auxiliary */
+
+chrono::steady_clock::time_point Protocol::now() const {
+    if (this->simulator != nullptr) return this->simulator->now();
+    return chrono::steady_clock::now();
+}
+
+void Protocol::observeDeliveries(shared_ptr<Connection> connection) {
+    {
+        lock_guard<mutex> lock(this->deliveries_mutex);
+        if (find(this->observed_connections.begin(),
+                 this->observed_connections.end(),
+                 connection) != this->observed_connections.end())
+            return;
+        this->observed_connections.push_back(connection);
     }
 
-    this->network->joinThreads();
-    printInformation("Messages sent", output_stream);
+    connection->onMessageConfirmed([this](uuids::uuid message_id) {
+        vector<MessageDeliveredCallback> callbacks;
+        Connection::Timeout latency;
+        {
+            lock_guard<mutex> lock(this->deliveries_mutex);
+            auto it = this->sending_times.find(message_id);
+            if (it == this->sending_times.end()) return;
+            latency = this->now() - it->second;
+            this->sending_times.erase(it);
+            callbacks = this->message_delivered_callbacks;
+        }
+        for (auto &callback : callbacks) callback(message_id, latency);
+    });
 }
 
 /* Static methods */
@@ -256,11 +375,11 @@ void Protocol::printInformation(string information,
 void Protocol::printEntitiesStorage(ostringstream &output_stream) {
     output_stream << "Entities' storage" << endl;
 
-    for (auto entity : *this->entities) {
+    this->entities->forEach([this, &output_stream](shared_ptr<Entity> entity) {
         output_stream << entity->getName() << " [" << entity->getId() << "]"
                       << endl;
         entity->printStorage({[this, &output_stream](string message) {
             this->printInformation(PrettyConsole::tab + message, output_stream);
         }});
-    }
+    });
 }
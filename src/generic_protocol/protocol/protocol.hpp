@@ -1,28 +1,64 @@
 #ifndef PROTOCOL_HPP_
 #define PROTOCOL_HPP_
 
+#include <chrono>
 #include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
+#include "configuration.hpp"
 #include "connection.hpp"
 #include "entity.hpp"
+#include "id_generator.hpp"
+#include "metrics.hpp"
 #include "network.hpp"
+#include "simulator.hpp"
 #include "uuid.h"
 
 using namespace std;
 
 class Protocol {
+   public:
+    // Receives the time between handing a message to the network and its
+    // delivery, on the thread that confirms it
+    using MessageDeliveredCallback =
+        function<void(uuids::uuid message_id, Connection::Timeout latency)>;
+
    private:
-    shared_ptr<uuids::uuid_random_generator> uuid_generator;
-    shared_ptr<EntitiesList> entities;
+    shared_ptr<IdGenerator> id_generator;
+    shared_ptr<const Configuration> configuration;
+    shared_ptr<EntitiesRegistry> entities;
     shared_ptr<ConnectionsMap> connections;
     unique_ptr<Network> network;
+    shared_ptr<Simulator> simulator;
+    shared_ptr<Metrics> metrics;
+    Metrics::Histogram *handshake_duration_histogram;
+
+    mutex deliveries_mutex;
+    unordered_map<uuids::uuid, chrono::steady_clock::time_point> sending_times;
+    vector<MessageDeliveredCallback> message_delivered_callbacks;
+    vector<shared_ptr<Connection>> observed_connections;
 
+    chrono::steady_clock::time_point now() const;
+    void observeDeliveries(shared_ptr<Connection> connection);
     shared_ptr<Entity> getEntityById(uuids::uuid entity_id);
     shared_ptr<Connection> connectEntities(shared_ptr<Entity> source_entity,
                                            shared_ptr<Entity> target_entity,
                                            ostringstream &output_stream);
+    // Sends one DATA message for each index, as the window allows, and waits
+    // until every one is confirmed
+    bool sendMessages(uuids::uuid source_entity_id,
+                      uuids::uuid target_entity_id, size_t messages_count,
+                      function<Message(size_t index)> create_message,
+                      ostringstream &output_stream);
+    // Runs the simulator until the condition holds, or blocks on the wait
+    // when there is no simulator
+    bool waitUntil(function<bool()> condition, Connection::Timeout timeout,
+                   function<bool(Connection::Timeout)> wait);
 
     /* Static methods */
     static void printInformation(string information,
@@ -30,14 +66,28 @@ class Protocol {
 
    public:
     /* Construction */
-    Protocol(shared_ptr<uuids::uuid_random_generator> uuid_generator,
-             string network_name);
+    Protocol(shared_ptr<IdGenerator> id_generator, string network_name,
+             shared_ptr<const Configuration> configuration,
+             shared_ptr<Simulator> simulator = nullptr);
     ~Protocol();
 
     /* Methods */
     uuids::uuid createEntity(string name, ostringstream &output_stream);
-    void sendData(uuids::uuid source_entity_id, uuids::uuid target_entity_id,
+    // Returns whether every content has been delivered
+    bool sendData(uuids::uuid source_entity_id, uuids::uuid target_entity_id,
                   deque<string> contents, ostringstream &output_stream);
+    // Splits the payload into segments of the configured size, which the
+    // target entity stores as a whole once it has all of them
+    bool sendPayload(uuids::uuid source_entity_id,
+                     uuids::uuid target_entity_id, string payload,
+                     ostringstream &output_stream);
+    bool setArqStrategy(uuids::uuid first_entity_id,
+                        uuids::uuid second_entity_id,
+                        Connection::ArqStrategy arq_strategy);
+    void onMessageDelivered(MessageDeliveredCallback callback);
+    Network::Statistics getNetworkStatistics() const;
+    PoolResource::Statistics getNetworkPoolStatistics() const;
+    shared_ptr<Metrics> getMetrics() const;
 
     /* Static methods */
     void printEntitiesStorage(ostringstream &output_stream);
@@ -0,0 +1,89 @@
+#include "retransmission_timeout.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Construction */
+
+RetransmissionTimeout::RetransmissionTimeout(Duration initial_timeout,
+                                             Duration minimum_timeout,
+                                             Duration maximum_timeout,
+                                             Duration clock_granularity)
+    : round_trip_time_variation(Duration::zero()),
+      backoffs_count(0),
+      minimum_timeout(minimum_timeout),
+      maximum_timeout(max(minimum_timeout, maximum_timeout)),
+      clock_granularity(clock_granularity) {
+    this->estimated_timeout = this->clampTimeout(initial_timeout);
+}
+
+/* Getters */
+
+RetransmissionTimeout::Duration RetransmissionTimeout::getTimeout() const {
+    Duration timeout = this->estimated_timeout;
+    for (unsigned int i = 0;
+         i < this->backoffs_count && timeout < this->maximum_timeout; i++)
+        timeout *= 2;
+    return this->clampTimeout(timeout);
+}
+
+optional<RetransmissionTimeout::Duration>
+RetransmissionTimeout::getSmoothedRoundTripTime() const {
+    return this->smoothed_round_trip_time;
+}
+
+RetransmissionTimeout::Duration
+RetransmissionTimeout::getRoundTripTimeVariation() const {
+    return this->round_trip_time_variation;
+}
+
+unsigned int RetransmissionTimeout::getBackoffsCount() const {
+    return this->backoffs_count;
+}
+
+/* Methods */
+
+void RetransmissionTimeout::addSample(Duration round_trip_time) {
+    round_trip_time = max(round_trip_time, Duration::zero());
+
+    if (!this->smoothed_round_trip_time.has_value()) {
+        this->smoothed_round_trip_time = round_trip_time;
+        this->round_trip_time_variation = round_trip_time / 2;
+    } else {
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R
+        Duration smoothed_round_trip_time =
+            this->smoothed_round_trip_time.value();
+        Duration deviation = smoothed_round_trip_time - round_trip_time;
+        if (deviation < Duration::zero()) deviation = -deviation;
+        this->round_trip_time_variation =
+            (3 * this->round_trip_time_variation + deviation) / 4;
+        this->smoothed_round_trip_time =
+            (7 * smoothed_round_trip_time + round_trip_time) / 8;
+    }
+
+    // A new sample also discards any backoff
+    this->backoffs_count = 0;
+    this->estimated_timeout = this->clampTimeout(
+        this->smoothed_round_trip_time.value() +
+        max(this->clock_granularity, 4 * this->round_trip_time_variation));
+}
+
+void RetransmissionTimeout::resetBackoff() { this->backoffs_count = 0; }
+
+RetransmissionTimeout::Duration RetransmissionTimeout::backOff(
+    Duration expired_timeout) {
+    Duration timeout = this->getTimeout();
+    if (expired_timeout >= timeout && timeout < this->maximum_timeout) {
+        this->backoffs_count++;
+        timeout = this->getTimeout();
+    }
+    return timeout;
+}
+
+/* Auxiliary */
+
+RetransmissionTimeout::Duration RetransmissionTimeout::clampTimeout(
+    Duration timeout) const {
+    return clamp(timeout, this->minimum_timeout, this->maximum_timeout);
+}
@@ -0,0 +1,55 @@
+#ifndef RETRANSMISSION_TIMEOUT_HPP_
+#define RETRANSMISSION_TIMEOUT_HPP_
+
+#include <chrono>
+#include <optional>
+
+using namespace std;
+
+/*
+ * Retransmission timeout of a connection, estimated from round-trip time
+ * samples as in RFC 6298.
+ * Samples of retransmitted packages must not be added, since it is unknown
+ * which attempt was acknowledged (Karn's rule).
+ * Expirations back the timeout off exponentially until a package is delivered
+ * again.
+ * Every package of a connection uses the same timeout, as if the connection
+ * had a single timer.
+ */
+class RetransmissionTimeout {
+   public:
+    using Duration = chrono::steady_clock::duration;
+
+   private:
+    optional<Duration> smoothed_round_trip_time;
+    Duration round_trip_time_variation;
+    Duration estimated_timeout;
+    unsigned int backoffs_count;
+    Duration minimum_timeout;
+    Duration maximum_timeout;
+    Duration clock_granularity;
+
+    Duration clampTimeout(Duration timeout) const;
+
+   public:
+    /* Construction */
+    RetransmissionTimeout(Duration initial_timeout, Duration minimum_timeout,
+                          Duration maximum_timeout,
+                          Duration clock_granularity);
+
+    /* Getters */
+    Duration getTimeout() const;
+    optional<Duration> getSmoothedRoundTripTime() const;
+    Duration getRoundTripTimeVariation() const;
+    unsigned int getBackoffsCount() const;
+
+    /* Methods */
+    void addSample(Duration round_trip_time);
+    // Keeps the estimate, for deliveries that cannot be timed
+    void resetBackoff();
+    // Doubles the timeout, unless the expired one is older than it, as when a
+    // whole window expires at once, and returns the new timeout
+    Duration backOff(Duration expired_timeout);
+};
+
+#endif  // RETRANSMISSION_TIMEOUT_HPP_
@@ -0,0 +1,73 @@
+#include "simulator.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Getters */
+
+Simulator::TimePoint Simulator::now() const {
+    lock_guard<mutex> lock(this->events_mutex);
+    return this->current_time;
+}
+
+size_t Simulator::getPendingEventsCount() const {
+    lock_guard<mutex> lock(this->events_mutex);
+    return this->events.size();
+}
+
+uint64_t Simulator::getProcessedEventsCount() const {
+    lock_guard<mutex> lock(this->events_mutex);
+    return this->processed_events_count;
+}
+
+/* Methods */
+
+void Simulator::schedule(Duration delay, function<void()> action) {
+    lock_guard<mutex> lock(this->events_mutex);
+    this->events.push(
+        {this->current_time + max(delay, Duration::zero()), this->next_order++,
+         action});
+}
+
+void Simulator::scheduleAt(TimePoint time, function<void()> action) {
+    lock_guard<mutex> lock(this->events_mutex);
+    this->events.push(
+        {max(time, this->current_time), this->next_order++, action});
+}
+
+bool Simulator::step() {
+    function<void()> action;
+    {
+        lock_guard<mutex> lock(this->events_mutex);
+        if (this->events.empty()) return false;
+
+        Event event = this->events.top();
+        this->events.pop();
+        this->current_time = event.time;
+        this->processed_events_count++;
+        action = event.action;
+    }
+    // Actions run unlocked, since they usually schedule further events
+    action();
+    return true;
+}
+
+bool Simulator::runUntil(function<bool()> condition, TimePoint deadline) {
+    while (!condition()) {
+        {
+            lock_guard<mutex> lock(this->events_mutex);
+            if (this->events.empty() || this->events.top().time > deadline) {
+                this->current_time = max(this->current_time, deadline);
+                return false;
+            }
+        }
+        this->step();
+    }
+    return true;
+}
+
+void Simulator::clear() {
+    lock_guard<mutex> lock(this->events_mutex);
+    this->events = {};
+}
@@ -0,0 +1,67 @@
+#ifndef SIMULATOR_HPP_
+#define SIMULATOR_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Discrete-event simulator with a virtual clock.
+ * Events run on the thread that drives the simulator, and time jumps
+ * straight to the next event instead of being waited for.
+ */
+class Simulator {
+   public:
+    using Clock = chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    using Duration = Clock::duration;
+
+   private:
+    struct Event {
+        TimePoint time;
+        uint64_t order;  // Keeps events scheduled at the same time in order
+        function<void()> action;
+    };
+
+    struct EventComparator {
+        bool operator()(const Event &lhs, const Event &rhs) const {
+            if (lhs.time != rhs.time) return lhs.time > rhs.time;
+            return lhs.order > rhs.order;
+        }
+    };
+
+    mutable mutex events_mutex;
+    TimePoint current_time;
+    uint64_t next_order;
+    uint64_t processed_events_count;
+    priority_queue<Event, vector<Event>, EventComparator> events;
+
+   public:
+    /* Construction */
+    Simulator()
+        : current_time(TimePoint()),
+          next_order(0),
+          processed_events_count(0) {}
+    ~Simulator() {}
+
+    /* Getters */
+    TimePoint now() const;
+    size_t getPendingEventsCount() const;
+    uint64_t getProcessedEventsCount() const;
+
+    /* Methods */
+    void schedule(Duration delay, function<void()> action);
+    void scheduleAt(TimePoint time, function<void()> action);
+    // Runs the next event, returning false if there is none
+    bool step();
+    // Runs events until the condition holds or the deadline is reached
+    bool runUntil(function<bool()> condition, TimePoint deadline);
+    void clear();
+};
+
+#endif  // SIMULATOR_HPP_
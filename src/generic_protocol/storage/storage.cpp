@@ -0,0 +1,16 @@
+#include "storage.hpp"
+
+using namespace std;
+
+/* Construction */
+
+Storage::~Storage() {}
+
+/* Methods */
+
+bool Storage::append(string_view fragment) {
+    return this->beginFragment(fragment.size()) &&
+           this->appendToFragment(fragment);
+}
+
+bool Storage::flush() { return true; }
@@ -0,0 +1,42 @@
+#ifndef STORAGE_HPP_
+#define STORAGE_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+using namespace std;
+
+/*
+ * Where an entity keeps the fragments it receives, in order.
+ * Callers synchronize access, so backends do not lock.
+ */
+class Storage {
+   public:
+    /* Construction */
+    virtual ~Storage();
+
+    /* Getters */
+    virtual size_t getSize() const = 0;  // In bytes, over every fragment
+    virtual size_t getFragmentsCount() const = 0;
+
+    /* Methods */
+    // Each one returns false if the fragment could not be stored
+    virtual bool append(string_view fragment);
+    // A fragment whose size is known can also be written in parts, so it
+    // does not have to be gathered first; it only counts once complete
+    virtual bool beginFragment(size_t fragment_size) = 0;
+    virtual bool appendToFragment(string_view part) = 0;
+    // Drops the fragment being written, if any, as if it was never begun
+    virtual void discardFragment() = 0;
+    // Fragments larger than the backend holds in memory at once are visited
+    // in consecutive parts, the last of which ends the fragment. Each view is
+    // only valid during its visit
+    virtual void forEach(
+        function<void(string_view part, bool is_fragment_end)> visit)
+        const = 0;
+    // Makes what has been appended durable, when the backend can
+    virtual bool flush();
+};
+
+#endif  // STORAGE_HPP_
@@ -0,0 +1,96 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Auxiliary */
+
+uint64_t TimerWheel::getTick(TimePoint time_point) const {
+    if (time_point <= this->origin) return 0;
+    return (time_point - this->origin) / this->tick;
+}
+
+void TimerWheel::releaseTick(uint64_t tick) {
+    auto it = this->armed_ticks.find(tick);
+    if (--it->second == 0) this->armed_ticks.erase(it);
+}
+
+/* Getters */
+
+bool TimerWheel::isArmed(uuids::uuid key) const {
+    return this->timers.find(key) != this->timers.end();
+}
+
+optional<TimerWheel::TimePoint> TimerWheel::getNextDeadline() const {
+    if (this->armed_ticks.empty()) return nullopt;
+
+    // Only the earliest tick with timers needs to be looked at
+    uint64_t tick = this->armed_ticks.begin()->first;
+    optional<TimePoint> next_deadline = nullopt;
+    for (const Timer &timer : this->slots[tick % this->slots.size()]) {
+        // Skip timers that belong to another turn of the wheel
+        if (timer.tick != tick) continue;
+        if (!next_deadline.has_value() ||
+            timer.deadline < next_deadline.value())
+            next_deadline = timer.deadline;
+    }
+    return next_deadline;
+}
+
+bool TimerWheel::empty() const { return this->timers.empty(); }
+
+size_t TimerWheel::size() const { return this->timers.size(); }
+
+/* Methods */
+
+void TimerWheel::arm(uuids::uuid key, TimePoint deadline) {
+    this->cancel(key);
+
+    uint64_t tick = max(this->getTick(deadline), this->current_tick);
+    size_t slot_index = tick % this->slots.size();
+    Slot &slot = this->slots[slot_index];
+
+    slot.push_back({key, deadline, tick});
+    this->timers.insert({key, {slot_index, prev(slot.end())}});
+    this->armed_ticks[tick]++;
+}
+
+bool TimerWheel::cancel(uuids::uuid key) {
+    auto it = this->timers.find(key);
+    if (it == this->timers.end()) return false;
+
+    this->releaseTick(it->second.iterator->tick);
+    this->slots[it->second.slot_index].erase(it->second.iterator);
+    this->timers.erase(it);
+    return true;
+}
+
+vector<uuids::uuid> TimerWheel::advance(TimePoint now) {
+    vector<uuids::uuid> expired;
+
+    uint64_t target_tick = max(this->getTick(now), this->current_tick);
+
+    // The current tick is visited again, since part of it may be in the future
+    auto tick_it = this->armed_ticks.begin();
+    while (tick_it != this->armed_ticks.end() &&
+           tick_it->first <= target_tick) {
+        uint64_t tick = tick_it->first;
+        tick_it++;  // The visited tick is released once it has no timers
+
+        Slot &slot = this->slots[tick % this->slots.size()];
+        for (auto it = slot.begin(); it != slot.end();) {
+            if (it->tick == tick && it->deadline <= now) {
+                expired.push_back(it->key);
+                this->timers.erase(it->key);
+                this->releaseTick(tick);
+                it = slot.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    this->current_tick = target_tick;
+    return expired;
+}
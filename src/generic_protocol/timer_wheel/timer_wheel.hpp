@@ -0,0 +1,81 @@
+#ifndef TIMER_WHEEL_HPP_
+#define TIMER_WHEEL_HPP_
+
+#include <uuid.h>
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Hashed timing wheel keyed by message ID.
+ * Each slot covers one tick; deadlines further away than a full turn stay in
+ * their slot until the wheel reaches them again. The ticks that hold timers
+ * are also kept in order, with how many timers each one holds, so finding the
+ * next deadline and expiring only visit those ticks. Arming and cancelling
+ * are logarithmic in the number of such ticks.
+ * Timers are allocated from the given memory resource.
+ */
+class TimerWheel {
+   public:
+    using Clock = chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    using Duration = Clock::duration;
+
+   private:
+    struct Timer {
+        uuids::uuid key;
+        TimePoint deadline;
+        uint64_t tick;  // Where it was armed, which tells the turn apart
+    };
+
+    using Slot = pmr::list<Timer>;
+
+    struct TimerPosition {
+        size_t slot_index;
+        Slot::iterator iterator;
+    };
+
+    Duration tick;
+    TimePoint origin;
+    uint64_t current_tick;
+    pmr::vector<Slot> slots;
+    pmr::unordered_map<uuids::uuid, TimerPosition> timers;
+    pmr::map<uint64_t, size_t> armed_ticks;  // Timers in each tick
+
+    uint64_t getTick(TimePoint time_point) const;
+    void releaseTick(uint64_t tick);
+
+   public:
+    /* Construction */
+    TimerWheel(Duration tick, size_t slots_count, TimePoint now = Clock::now(),
+               pmr::memory_resource *memory_resource =
+                   pmr::get_default_resource())
+        : tick(tick),
+          origin(now),
+          current_tick(0),
+          slots(slots_count, memory_resource),
+          timers(memory_resource),
+          armed_ticks(memory_resource) {}
+    ~TimerWheel() {}
+
+    /* Getters */
+    bool isArmed(uuids::uuid key) const;
+    optional<TimePoint> getNextDeadline() const;
+    bool empty() const;
+    size_t size() const;
+
+    /* Methods */
+    void arm(uuids::uuid key, TimePoint deadline);
+    bool cancel(uuids::uuid key);
+    vector<uuids::uuid> advance(TimePoint now);
+};
+
+#endif  // TIMER_WHEEL_HPP_
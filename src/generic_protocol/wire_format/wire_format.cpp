@@ -0,0 +1,257 @@
+#include "wire_format.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+    constexpr uint8_t last_code = static_cast<uint8_t>(Message::Code::DATA);
+    constexpr uint8_t last_code_variant =
+        static_cast<uint8_t>(Message::CodeVariant::NACK_CORRUPTED);
+
+    void putByte(span<byte> buffer, size_t offset, uint8_t value) {
+        buffer[offset] = static_cast<byte>(value);
+    }
+
+    void putShort(span<byte> buffer, size_t offset, uint16_t value) {
+        buffer[offset] = static_cast<byte>(value >> 8);
+        buffer[offset + 1] = static_cast<byte>(value);
+    }
+
+    void putUnsigned(span<byte> buffer, size_t offset, uint32_t value) {
+        for (size_t i = 0; i < 4; i++)
+            buffer[offset + i] = static_cast<byte>(value >> (24 - 8 * i));
+    }
+
+    void putUuid(span<byte> buffer, size_t offset, const uuids::uuid &id) {
+        auto bytes = id.as_bytes();
+        copy(bytes.begin(), bytes.end(), buffer.begin() + offset);
+    }
+}  // namespace
+
+/* Package view */
+
+uint8_t WireFormat::PackageView::getByte(size_t offset) const {
+    return static_cast<uint8_t>(this->buffer[offset]);
+}
+
+uint16_t WireFormat::PackageView::getShort(size_t offset) const {
+    return (static_cast<uint8_t>(this->buffer[offset]) << 8) |
+           static_cast<uint8_t>(this->buffer[offset + 1]);
+}
+
+uint32_t WireFormat::PackageView::getUnsigned(size_t offset) const {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++)
+        value = (value << 8) | static_cast<uint8_t>(this->buffer[offset + i]);
+    return value;
+}
+
+uuids::uuid WireFormat::PackageView::getUuid(size_t offset) const {
+    auto first =
+        reinterpret_cast<const uint8_t *>(this->buffer.data()) + offset;
+    return uuids::uuid(first, first + 16);
+}
+
+size_t WireFormat::PackageView::getSegmentOffset() const {
+    return header_size +
+           this->getAcknowledgedRangesCount() * acknowledged_range_size;
+}
+
+size_t WireFormat::PackageView::getContentOffset() const {
+    bool has_segment = this->getByte(Offset::flags) & Flag::HAS_SEGMENT;
+    return this->getSegmentOffset() + (has_segment ? segment_field_size : 0);
+}
+
+uint8_t WireFormat::PackageView::getVersion() const {
+    return this->getByte(Offset::version);
+}
+
+Message::Code WireFormat::PackageView::getCode() const {
+    return static_cast<Message::Code>(this->getByte(Offset::code));
+}
+
+optional<Message::CodeVariant> WireFormat::PackageView::getCodeVariant()
+    const {
+    if (!(this->getByte(Offset::flags) & Flag::HAS_CODE_VARIANT))
+        return nullopt;
+    return static_cast<Message::CodeVariant>(
+        this->getByte(Offset::code_variant));
+}
+
+bool WireFormat::PackageView::shouldBeConfirmed() const {
+    return this->getByte(Offset::flags) & Flag::SHOULD_BE_CONFIRMED;
+}
+
+bool WireFormat::PackageView::isCorrupted() const {
+    return this->getByte(Offset::flags) & Flag::CORRUPTED;
+}
+
+unsigned int WireFormat::PackageView::getSequenceNumber() const {
+    return this->getUnsigned(Offset::sequence_number);
+}
+
+uuids::uuid WireFormat::PackageView::getId() const {
+    return this->getUuid(Offset::id);
+}
+
+uuids::uuid WireFormat::PackageView::getSourceEntityId() const {
+    return this->getUuid(Offset::source_entity_id);
+}
+
+uuids::uuid WireFormat::PackageView::getTargetEntityId() const {
+    return this->getUuid(Offset::target_entity_id);
+}
+
+optional<uuids::uuid>
+WireFormat::PackageView::getIdFromMessageBeingAcknowledged() const {
+    if (!(this->getByte(Offset::flags) & Flag::HAS_ACKNOWLEDGED_ID))
+        return nullopt;
+    return this->getUuid(Offset::id_from_message_being_acknowledged);
+}
+
+size_t WireFormat::PackageView::getAcknowledgedRangesCount() const {
+    return this->getShort(Offset::acknowledged_ranges_count);
+}
+
+Message::SequenceRange WireFormat::PackageView::getAcknowledgedRange(
+    size_t index) const {
+    size_t offset =
+        Offset::acknowledged_ranges + index * acknowledged_range_size;
+    return {this->getUnsigned(offset), this->getUnsigned(offset + 4)};
+}
+
+optional<Message::Segment> WireFormat::PackageView::getSegment() const {
+    if (!(this->getByte(Offset::flags) & Flag::HAS_SEGMENT)) return nullopt;
+    size_t offset = this->getSegmentOffset();
+    return Message::Segment{this->getUuid(offset),
+                            this->getUnsigned(offset + 16),
+                            this->getUnsigned(offset + 20)};
+}
+
+string_view WireFormat::PackageView::getContent() const {
+    return string_view(reinterpret_cast<const char *>(this->buffer.data()) +
+                           this->getContentOffset(),
+                       this->getUnsigned(Offset::content_length));
+}
+
+size_t WireFormat::PackageView::getSize() const {
+    return this->getContentOffset() +
+           this->getUnsigned(Offset::content_length);
+}
+
+/* Encoding */
+
+size_t WireFormat::getEncodedSize(const Package &package) {
+    const auto &message = package.getMessage();
+    return header_size +
+           message.getAcknowledgedRanges().size() * acknowledged_range_size +
+           (message.getSegment().has_value() ? segment_field_size : 0) +
+           message.getContent().size();
+}
+
+size_t WireFormat::encode(const Package &package, span<byte> buffer) {
+    const auto &message = package.getMessage();
+    auto content = message.getContent();
+    const auto &acknowledged_ranges = message.getAcknowledgedRanges();
+    auto segment = message.getSegment();
+    size_t segment_offset =
+        header_size + acknowledged_ranges.size() * acknowledged_range_size;
+    size_t content_offset =
+        segment_offset + (segment.has_value() ? segment_field_size : 0);
+    size_t size = content_offset + content.size();
+    if (buffer.size() < size) return 0;
+    if (content.size() > UINT32_MAX) return 0;
+    if (acknowledged_ranges.size() > UINT16_MAX) return 0;
+    if (segment.has_value() && (segment->offset > UINT32_MAX ||
+                                segment->payload_size > UINT32_MAX))
+        return 0;
+
+    auto code_variant = message.getCodeVariant();
+    auto acknowledged_id = message.getIdFromMessageBeingAcknowledged();
+
+    uint8_t flags = 0;
+    if (package.shouldBeConfirmed()) flags |= Flag::SHOULD_BE_CONFIRMED;
+    if (package.isCorrupted()) flags |= Flag::CORRUPTED;
+    if (code_variant.has_value()) flags |= Flag::HAS_CODE_VARIANT;
+    if (acknowledged_id.has_value()) flags |= Flag::HAS_ACKNOWLEDGED_ID;
+    if (segment.has_value()) flags |= Flag::HAS_SEGMENT;
+
+    putByte(buffer, Offset::version, version);
+    putByte(buffer, Offset::code, static_cast<uint8_t>(message.getCode()));
+    putByte(buffer, Offset::code_variant,
+            code_variant.has_value()
+                ? static_cast<uint8_t>(code_variant.value())
+                : 0);
+    putByte(buffer, Offset::flags, flags);
+    putUnsigned(buffer, Offset::sequence_number, package.getSequenceNumber());
+    putUnsigned(buffer, Offset::content_length, content.size());
+    putUuid(buffer, Offset::id, message.getId());
+    putUuid(buffer, Offset::source_entity_id, message.getSourceEntityId());
+    putUuid(buffer, Offset::target_entity_id, message.getTargetEntityId());
+    putUuid(buffer, Offset::id_from_message_being_acknowledged,
+            acknowledged_id.value_or(uuids::uuid()));
+    putShort(buffer, Offset::acknowledged_ranges_count,
+             acknowledged_ranges.size());
+
+    size_t range_offset = Offset::acknowledged_ranges;
+    for (const auto &range : acknowledged_ranges) {
+        putUnsigned(buffer, range_offset, range.first);
+        putUnsigned(buffer, range_offset + 4, range.last);
+        range_offset += acknowledged_range_size;
+    }
+
+    if (segment.has_value()) {
+        putUuid(buffer, segment_offset, segment->payload_id);
+        putUnsigned(buffer, segment_offset + 16, segment->offset);
+        putUnsigned(buffer, segment_offset + 20, segment->payload_size);
+    }
+
+    auto content_bytes = as_bytes(span(content.data(), content.size()));
+    copy(content_bytes.begin(), content_bytes.end(),
+         buffer.begin() + content_offset);
+
+    return size;
+}
+
+vector<byte> WireFormat::encode(const Package &package) {
+    vector<byte> buffer(getEncodedSize(package));
+    buffer.resize(encode(package, buffer));
+    return buffer;
+}
+
+/* Decoding */
+
+optional<WireFormat::PackageView> WireFormat::parse(span<const byte> buffer) {
+    if (buffer.size() < header_size) return nullopt;
+
+    PackageView view(buffer);
+    if (view.getVersion() != version) return nullopt;
+    if (static_cast<uint8_t>(buffer[Offset::code]) > last_code)
+        return nullopt;
+    if (view.getCodeVariant().has_value() &&
+        static_cast<uint8_t>(buffer[Offset::code_variant]) > last_code_variant)
+        return nullopt;
+    if (buffer.size() < view.getSize()) return nullopt;
+
+    return PackageView(buffer.first(view.getSize()));
+}
+
+Package WireFormat::decode(const PackageView &view) {
+    Message message(view.getId(), view.getSourceEntityId(),
+                    view.getTargetEntityId(), view.getCode(),
+                    view.getCodeVariant(),
+                    view.getIdFromMessageBeingAcknowledged(),
+                    string(view.getContent()));
+
+    vector<Message::SequenceRange> acknowledged_ranges;
+    for (size_t i = 0; i < view.getAcknowledgedRangesCount(); i++)
+        acknowledged_ranges.push_back(view.getAcknowledgedRange(i));
+    message.setAcknowledgedRanges(move(acknowledged_ranges));
+    if (auto segment = view.getSegment()) message.setSegment(segment.value());
+
+    Package package(message, view.shouldBeConfirmed(),
+                    view.getSequenceNumber());
+    package.setCorrupted(view.isCorrupted());
+    return package;
+}
@@ -0,0 +1,123 @@
+#ifndef WIRE_FORMAT_HPP_
+#define WIRE_FORMAT_HPP_
+
+#include <uuid.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "message.hpp"
+#include "package.hpp"
+
+using namespace std;
+
+/*
+ * Binary encoding of a Package.
+ *
+ * Every package starts with a fixed header, followed by the acknowledged
+ * ranges, the segment, if any, and then the content bytes:
+ *
+ *   offset  size  field
+ *        0     1  version
+ *        1     1  code
+ *        2     1  code variant (only meaningful with HAS_CODE_VARIANT)
+ *        3     1  flags
+ *        4     4  sequence number (big-endian)
+ *        8     4  content length (big-endian)
+ *       12    16  message ID
+ *       28    16  source entity ID
+ *       44    16  target entity ID
+ *       60    16  ID from message being acknowledged (zero if absent)
+ *       76     2  acknowledged ranges count (big-endian)
+ *       78     -  acknowledged ranges, 8 bytes each (first, last)
+ *        -    24  segment (only with HAS_SEGMENT): payload ID, offset and
+ *                 payload size (big-endian)
+ *        -     -  content
+ */
+namespace WireFormat {
+    constexpr uint8_t version = 3;
+
+    enum Flag : uint8_t {
+        SHOULD_BE_CONFIRMED = 1 << 0,
+        CORRUPTED = 1 << 1,
+        HAS_CODE_VARIANT = 1 << 2,
+        HAS_ACKNOWLEDGED_ID = 1 << 3,
+        HAS_SEGMENT = 1 << 4,
+    };
+
+    namespace Offset {
+        constexpr size_t version = 0;
+        constexpr size_t code = 1;
+        constexpr size_t code_variant = 2;
+        constexpr size_t flags = 3;
+        constexpr size_t sequence_number = 4;
+        constexpr size_t content_length = 8;
+        constexpr size_t id = 12;
+        constexpr size_t source_entity_id = 28;
+        constexpr size_t target_entity_id = 44;
+        constexpr size_t id_from_message_being_acknowledged = 60;
+        constexpr size_t acknowledged_ranges_count = 76;
+        constexpr size_t acknowledged_ranges = 78;
+    }  // namespace Offset
+
+    constexpr size_t header_size = Offset::acknowledged_ranges;
+    constexpr size_t acknowledged_range_size = 8;
+    constexpr size_t segment_field_size = 24;
+
+    /*
+     * Read-only view over an encoded package.
+     * It does not own the buffer, which must outlive the view.
+     */
+    class PackageView {
+       private:
+        span<const byte> buffer;
+
+        uint8_t getByte(size_t offset) const;
+        uint16_t getShort(size_t offset) const;
+        uint32_t getUnsigned(size_t offset) const;
+        size_t getSegmentOffset() const;
+        size_t getContentOffset() const;
+        uuids::uuid getUuid(size_t offset) const;
+
+       public:
+        /* Construction */
+        explicit PackageView(span<const byte> buffer) : buffer(buffer) {}
+
+        /* Getters */
+        uint8_t getVersion() const;
+        Message::Code getCode() const;
+        optional<Message::CodeVariant> getCodeVariant() const;
+        bool shouldBeConfirmed() const;
+        bool isCorrupted() const;
+        unsigned int getSequenceNumber() const;
+        uuids::uuid getId() const;
+        uuids::uuid getSourceEntityId() const;
+        uuids::uuid getTargetEntityId() const;
+        optional<uuids::uuid> getIdFromMessageBeingAcknowledged() const;
+        size_t getAcknowledgedRangesCount() const;
+        Message::SequenceRange getAcknowledgedRange(size_t index) const;
+        optional<Message::Segment> getSegment() const;
+        string_view getContent() const;
+        size_t getSize() const;
+    };
+
+    size_t getEncodedSize(const Package &package);
+
+    // Returns the amount of bytes written, or 0 if the buffer is too small or
+    // a field does not fit its width in the format
+    size_t encode(const Package &package, span<byte> buffer);
+    // Empty if the package cannot be encoded
+    vector<byte> encode(const Package &package);
+
+    // Validates the header and returns a view over the first package found in
+    // the buffer. Its size tells where the next package begins.
+    optional<PackageView> parse(span<const byte> buffer);
+
+    Package decode(const PackageView &view);
+}  // namespace WireFormat
+
+#endif  // WIRE_FORMAT_HPP_
@@ -1,25 +1,39 @@
-#include <uuid.h>
-
 #include <iostream>
 #include <memory>
+#include <string>
 
 #include "./generic_protocol/generic_protocol.hpp"
+#include "configuration.hpp"
+#include "id_generator.hpp"
+#include "util.hpp"
 
 using namespace std;
 
 int main(int argc, char *argv[]) {
     cout << "DCC042 - Computer Networks" << endl << endl;
 
-    // Random UUID generator
-    std::random_device rd;
-    auto seed_data = std::array<int, std::mt19937::state_size>{};
-    std::generate(std::begin(seed_data), std::end(seed_data), std::ref(rd));
-    std::seed_seq seq(std::begin(seed_data), std::end(seed_data));
-    std::mt19937 generator(seq);
-    auto uuid_generator =
-        std::make_shared<uuids::uuid_random_generator>(generator);
+    // Settings from "--configuration=<path>" files and "--key=value" options
+    auto configuration = make_shared<Configuration>();
+    if (!configuration->loadArguments(argc, argv)) {
+        string errors;
+        for (const auto &error : configuration->getErrors())
+            errors += error + "\n";
+        Util::printInformation(
+            "Invalid configuration", errors, cerr,
+            {PrettyConsole::Color::WHITE, PrettyConsole::Color::RED,
+             PrettyConsole::Format::BOLD},
+            PrettyConsole::Decoration(PrettyConsole::Color::RED));
+        return 1;
+    }
+
+    // Time-ordered message ID generator, safe to share between threads
+    auto id_generator = make_shared<IdGenerator>();
+
+    bool simulate = false;
+    for (int i = 1; i < argc; i++)
+        if (string(argv[i]) == "--simulation") simulate = true;
 
-    GenericProtocol::run(uuid_generator);
+    GenericProtocol::run(id_generator, configuration, simulate);
 
     return 0;
 }
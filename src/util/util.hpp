@@ -2,6 +2,7 @@
 #define UTIL_HPP_
 
 #include <iostream>
+#include <optional>
 #include <pretty_console.hpp>
 
 using namespace std;
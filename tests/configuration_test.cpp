@@ -0,0 +1,55 @@
+#include "configuration.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    void testConnectionOverride() {
+        Configuration configuration;
+        Test::check(configuration.set("connection.b.a.segment_size", "7"),
+                    "an override is accepted");
+        Test::check(configuration.getConnectionSettings("a", "b")
+                            .segment_size == 7,
+                    "the override applies in either order");
+        Test::check(configuration.getConnectionSettings("a", "c")
+                            .segment_size != 7,
+                    "the override applies only to its names");
+    }
+
+    void testQuotedNames() {
+        Configuration configuration;
+        Test::check(configuration.set(
+                        "connection.\"a.1\".\"b.2\".segment_size", "7"),
+                    "names with dots are accepted in quotes");
+        Test::check(configuration.getConnectionSettings("b.2", "a.1")
+                            .segment_size == 7,
+                    "the override applies to the quoted names");
+        Test::check(configuration.set("connection.a.\"b.2\".segment_size",
+                                      "9"),
+                    "quoted and plain names can be mixed");
+        Test::check(configuration.getConnectionSettings("a", "b.2")
+                            .segment_size == 9,
+                    "the mixed override applies to its names");
+    }
+
+    void testInvalidKeys() {
+        Configuration configuration;
+        Test::check(!configuration.set("connection.a.segment_size", "7"),
+                    "a key with one name is rejected");
+        Test::check(
+            !configuration.set("connection.\"a.b.segment_size", "7"),
+            "an unterminated quote is rejected");
+        Test::check(
+            !configuration.set("connection.\"a\"b.c.segment_size", "7"),
+            "text after a quote is rejected");
+        Test::check(!configuration.set("connection.a.b.unknown", "7"),
+                    "an unknown key is rejected");
+    }
+}  // namespace
+
+int main() {
+    testConnectionOverride();
+    testQuotedNames();
+    testInvalidKeys();
+    return Test::finish();
+}
@@ -0,0 +1,102 @@
+#include <chrono>
+
+#include "congestion_control.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    using Algorithm = CongestionControl::Algorithm;
+
+    void acknowledge(CongestionControl &congestion_control, unsigned int count,
+                     optional<CongestionControl::Duration> round_trip_time =
+                         nullopt) {
+        for (unsigned int i = 0; i < count; i++)
+            congestion_control.onAcknowledged(round_trip_time);
+    }
+
+    void testSlowStart() {
+        CongestionControl congestion_control(Algorithm::AIMD, 1, 8);
+        acknowledge(congestion_control, 4);
+        Test::check(congestion_control.getWindow() == 5 &&
+                        congestion_control.isInSlowStart(),
+                    "slow start grows the window by one per acknowledgement");
+        acknowledge(congestion_control, 3);
+        Test::check(congestion_control.getWindow() == 8 &&
+                        !congestion_control.isInSlowStart(),
+                    "slow start ends at the threshold");
+        acknowledge(congestion_control, 20);
+        Test::check(congestion_control.getWindow() == 8,
+                    "the window never grows past its maximum");
+
+        CongestionControl fixed(Algorithm::FIXED, 4, 64);
+        acknowledge(fixed, 20);
+        fixed.onLost(1, 5);
+        Test::check(fixed.getWindow() == 4,
+                    "a fixed window ignores acknowledgements and losses");
+    }
+
+    void testAdditiveIncrease() {
+        CongestionControl congestion_control(Algorithm::AIMD, 16, 64);
+        congestion_control.onLost(1, 17);
+        Test::check(congestion_control.getWindow() == 8 &&
+                        !congestion_control.isInSlowStart(),
+                    "a loss sets the threshold to half of the window");
+        acknowledge(congestion_control, 8);
+        Test::check(congestion_control.getWindow() == 8,
+                    "the window grows by less than one within a window");
+        acknowledge(congestion_control, 1);
+        Test::check(congestion_control.getWindow() == 9,
+                    "the window grows by one per window of acknowledgements");
+    }
+
+    void testOneDecreasePerWindow() {
+        CongestionControl congestion_control(Algorithm::AIMD, 16, 64);
+        congestion_control.onLost(3, 20);
+        Test::check(congestion_control.getWindow() == 8,
+                    "a loss halves the window");
+        congestion_control.onLost(10, 24);
+        congestion_control.onLost(19, 24);
+        Test::check(congestion_control.getWindow() == 8,
+                    "losses of packages sent before the decrease are ignored");
+        congestion_control.onLost(20, 30);
+        Test::check(congestion_control.getWindow() == 4,
+                    "a loss of a package sent after the decrease halves again");
+        congestion_control.onLost(30, 40);
+        congestion_control.onLost(40, 50);
+        Test::check(congestion_control.getWindow() == 2,
+                    "the window is never halved below two packages");
+    }
+
+    void testDelayBased() {
+        CongestionControl congestion_control(Algorithm::DELAY_BASED, 10, 64);
+        acknowledge(congestion_control, 1, chrono::milliseconds(100));
+        Test::check(congestion_control.getWindow() == 11 &&
+                        congestion_control.isInSlowStart(),
+                    "slow start goes on while the round-trip time is lowest");
+        acknowledge(congestion_control, 1, chrono::milliseconds(200));
+        Test::check(congestion_control.getWindow() == 11 &&
+                        !congestion_control.isInSlowStart(),
+                    "a rising round-trip time ends slow start");
+
+        acknowledge(congestion_control, 12, chrono::milliseconds(105));
+        unsigned int grown_window = congestion_control.getWindow();
+        Test::check(grown_window == 12,
+                    "the window grows while few packages are queued");
+        acknowledge(congestion_control, 12, chrono::milliseconds(140));
+        Test::check(congestion_control.getWindow() == grown_window,
+                    "the window holds between the queueing bounds");
+        acknowledge(congestion_control, 24, chrono::milliseconds(200));
+        Test::check(congestion_control.getWindow() < grown_window,
+                    "the window shrinks while many packages are queued, "
+                    "before any is lost");
+    }
+}  // namespace
+
+int main() {
+    testSlowStart();
+    testAdditiveIncrease();
+    testOneDecreasePerWindow();
+    testDelayBased();
+    return Test::finish();
+}
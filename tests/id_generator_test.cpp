@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "id_generator.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    constexpr size_t ids_per_thread = 50000;
+    constexpr size_t threads_count = 4;
+
+    bool isIncreasing(const vector<uuids::uuid> &ids) {
+        return adjacent_find(ids.begin(), ids.end(),
+                             [](const uuids::uuid &previous,
+                                const uuids::uuid &next) {
+                                 return !(previous < next);
+                             }) == ids.end();
+    }
+
+    void testLayout() {
+        IdGenerator id_generator;
+        auto bytes = id_generator.generate().as_bytes();
+        Test::check((static_cast<uint8_t>(bytes[6]) >> 4) == 7,
+                    "the version is 7");
+        Test::check((static_cast<uint8_t>(bytes[8]) >> 6) == 0b10,
+                    "the variant is RFC 9562");
+    }
+
+    void testOrderInThread() {
+        IdGenerator id_generator;
+        vector<uuids::uuid> ids;
+        // Far more than one millisecond and one block of sequence numbers
+        for (size_t i = 0; i < ids_per_thread; i++)
+            ids.push_back(id_generator.generate());
+        Test::check(isIncreasing(ids),
+                    "IDs of a thread increase, within a millisecond too");
+    }
+
+    void testUniquenessAcrossThreads() {
+        IdGenerator id_generator;
+        vector<vector<uuids::uuid>> ids(threads_count);
+        vector<thread> threads;
+        for (size_t i = 0; i < threads_count; i++)
+            threads.emplace_back([&id_generator, &thread_ids = ids[i]]() {
+                for (size_t j = 0; j < ids_per_thread; j++)
+                    thread_ids.push_back(id_generator.generate());
+            });
+        for (thread &thread : threads) thread.join();
+
+        vector<uuids::uuid> all_ids;
+        for (const auto &thread_ids : ids) {
+            Test::check(isIncreasing(thread_ids),
+                        "IDs of each thread increase");
+            all_ids.insert(all_ids.end(), thread_ids.begin(),
+                           thread_ids.end());
+        }
+        sort(all_ids.begin(), all_ids.end());
+        Test::check(adjacent_find(all_ids.begin(), all_ids.end()) ==
+                        all_ids.end(),
+                    "IDs of different threads never collide");
+    }
+}  // namespace
+
+int main() {
+    testLayout();
+    testOrderInThread();
+    testUniquenessAcrossThreads();
+    return Test::finish();
+}
@@ -0,0 +1,111 @@
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "metrics.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    constexpr size_t registered_series_count = 2000;
+
+    bool contains(const string &text, const string &part) {
+        return text.find(part) != string::npos;
+    }
+
+    void testFormats() {
+        Metrics metrics("test");
+        metrics.getCounter("sent_total", "Sent packages", {{"kind", "data"}})
+            .increment(3);
+        metrics.getGauge("window", "Window size").set(-2);
+        auto &histogram =
+            metrics.getHistogram("delay", "Delay", {1, 10}, {{"a", "\"b\""}});
+        histogram.observe(0.5);
+        histogram.observe(5);
+        histogram.observe(50);
+
+        string prometheus = metrics.toPrometheus();
+        Test::check(contains(prometheus, "# TYPE test_sent_total counter\n"),
+                    "Prometheus output declares the type of every family");
+        Test::check(contains(prometheus, "test_sent_total{kind=\"data\"} 3\n"),
+                    "Prometheus output has the value of a counter");
+        Test::check(contains(prometheus, "test_window -2\n"),
+                    "a series without labels has no braces");
+        // The label value is a quoted word, which has to be escaped
+        string labels = "{a=\"\\\"b\\\"\"";
+        Test::check(
+            contains(prometheus,
+                     "test_delay_bucket" + labels + ",le=\"10\"} 2\n") &&
+                contains(prometheus,
+                         "test_delay_bucket" + labels + ",le=\"+Inf\"} 3\n"),
+            "histogram buckets are cumulative and label values escaped");
+        Test::check(
+            contains(prometheus, "test_delay_sum" + labels + "} 55.5\n") &&
+                contains(prometheus, "test_delay_count" + labels + "} 3\n"),
+            "histograms export their sum and count");
+
+        string json = metrics.toJson();
+        Test::check(contains(json, "{\"labels\": {\"kind\": \"data\"}, "
+                                   "\"value\": 3}"),
+                    "JSON output has the value of a counter");
+        Test::check(contains(json, "{\"le\": 10, \"count\": 1}, "
+                                   "{\"le\": \"+Inf\", \"count\": 1}"),
+                    "JSON buckets are not cumulative");
+
+        Test::check(&metrics.getGauge("window", "Window size") ==
+                        &metrics.getGauge("window", "Window size"),
+                    "a series is registered once");
+        bool is_rejected = false;
+        try {
+            metrics.getCounter("window", "Window size");
+        } catch (const invalid_argument &) {
+            is_rejected = true;
+        }
+        Test::check(is_rejected,
+                    "a name keeps the type it was registered with");
+    }
+
+    // Series registered while snapshots are taken are always complete
+    void testRegisteringWhileExporting() {
+        Metrics metrics("test");
+        atomic<bool> is_registering(true);
+        thread exporter([&]() {
+            while (is_registering.load()) {
+                metrics.toPrometheus();
+                metrics.toJson();
+            }
+        });
+
+        thread other_registrant([&]() {
+            for (size_t i = 0; i < registered_series_count; i++)
+                metrics.getGauge("occupancy", "Occupancy",
+                                 {{"connection", to_string(i)}});
+        });
+        bool is_shared = true;
+        for (size_t i = 0; i < registered_series_count; i++) {
+            Metrics::Gauge &gauge = metrics.getGauge(
+                "occupancy", "Occupancy", {{"connection", to_string(i)}});
+            gauge.add(1);
+            is_shared &= &gauge == &metrics.getGauge(
+                                       "occupancy", "Occupancy",
+                                       {{"connection", to_string(i)}});
+        }
+        other_registrant.join();
+        is_registering = false;
+        exporter.join();
+
+        Test::check(is_shared,
+                    "threads registering the same series share its gauge");
+        Test::check(contains(metrics.toPrometheus(),
+                             "test_occupancy{connection=\"1999\"} 1\n"),
+                    "updates through a registered series are exported");
+    }
+}  // namespace
+
+int main() {
+    testFormats();
+    testRegisteringWhileExporting();
+    return Test::finish();
+}
@@ -0,0 +1,160 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    using Value = pair<size_t, size_t>;  // Producer and its index
+
+    constexpr size_t producers_count = 4;
+    constexpr size_t values_per_producer = 100000;
+
+    // Pushing well past the capacity before popping spills into the
+    // overflow, and later pushes follow it until it is drained
+    void testSpillAndDrain(size_t capacity) {
+        string name = "ring of " + to_string(capacity) + ": ";
+        MpscQueue<size_t> queue(capacity);
+        size_t pushed_count = 0;
+        vector<size_t> values;
+
+        for (size_t i = 0; i < queue.getCapacity() * 3; i++)
+            queue.push(pushed_count++);
+        // Partly drained, so the ring has room while the overflow is not
+        // empty yet
+        queue.pop(values, queue.getCapacity() + 1);
+        for (size_t i = 0; i < queue.getCapacity(); i++)
+            queue.push(pushed_count++);
+        while (queue.pop(values, 3) > 0) {
+        }
+
+        bool is_in_order = values.size() == pushed_count;
+        for (size_t i = 0; is_in_order && i < values.size(); i++)
+            is_in_order = values[i] == i;
+        Test::check(is_in_order,
+                    name + "values spilled into the overflow keep their order");
+    }
+
+    // Producers race each other and the consumer, so the small rings are
+    // full most of the time; batches can be split between the ring and the
+    // overflow
+    void testProducersOrder(size_t capacity, bool is_batched) {
+        string name = "ring of " + to_string(capacity) +
+                      (is_batched ? ", batches: " : ": ");
+        MpscQueue<Value> queue(capacity);
+
+        vector<thread> producers;
+        for (size_t producer = 0; producer < producers_count; producer++)
+            producers.emplace_back([&queue, producer, is_batched]() {
+                vector<Value> batch;
+                for (size_t i = 0; i < values_per_producer; i++) {
+                    if (!is_batched) {
+                        queue.push({producer, i});
+                        continue;
+                    }
+                    batch.push_back({producer, i});
+                    // Batches of 1, 5, 9 and 13 values
+                    if (batch.size() == producer * 4 + 1 ||
+                        i + 1 == values_per_producer) {
+                        queue.push(batch);
+                        batch.clear();
+                    }
+                }
+            });
+
+        vector<size_t> next_indexes(producers_count, 0);
+        bool is_in_order = true;
+        size_t popped_count = 0;
+        thread consumer([&]() {
+            vector<Value> values;
+            while (true) {
+                // Every push happens before the queue is closed, so nothing
+                // is left once it is closed and empty
+                bool is_closed = queue.isClosed();
+                values.clear();
+                // Varying batches leave the ring partly drained
+                size_t count = queue.pop(values, popped_count % 7 + 1);
+                for (const auto &[producer, index] : values)
+                    is_in_order &= index == next_indexes[producer]++;
+                popped_count += count;
+                if (count > 0) continue;
+                if (is_closed) break;
+                queue.waitForValues();
+            }
+        });
+
+        for (auto &producer : producers) producer.join();
+        queue.close();
+        consumer.join();
+
+        Test::check(popped_count == producers_count * values_per_producer,
+                    name + "every value is popped once");
+        Test::check(is_in_order,
+                    name + "values of each producer keep their order");
+    }
+
+    // Moving a held value into its cell blocks until it is released, which
+    // keeps the cell claimed but not published
+    atomic<bool> is_cell_claimed(false);
+    atomic<bool> is_cell_released(false);
+
+    struct HeldValue {
+        Value value;
+        bool is_held;
+
+        HeldValue(Value value, bool is_held = false)
+            : value(value), is_held(is_held) {}
+
+        HeldValue(HeldValue &&other) : value(other.value), is_held(false) {
+            if (!other.is_held) return;
+            is_cell_claimed = true;
+            while (!is_cell_released) this_thread::yield();
+        }
+    };
+
+    // A producer holds the first cell while another one fills the ring and
+    // spills into the overflow; nothing behind the held cell can be popped
+    void testUnpublishedCell() {
+        MpscQueue<HeldValue> queue(2);
+        thread holder([&queue]() {
+            queue.push(HeldValue({0, 0}, true));
+            queue.push(HeldValue({0, 1}));
+        });
+        while (!is_cell_claimed) this_thread::yield();
+
+        queue.push(HeldValue({1, 0}));
+        queue.push(HeldValue({1, 1}));  // Spilled, the ring is full
+        vector<HeldValue> values;
+        Test::check(queue.pop(values, 4) == 0,
+                    "nothing is popped past an unpublished cell");
+
+        is_cell_released = true;
+        holder.join();
+        while (queue.pop(values, 4) > 0) {
+        }
+
+        vector<size_t> next_indexes(2, 0);
+        bool is_in_order = values.size() == 4;
+        for (const auto &held_value : values) {
+            auto [producer, index] = held_value.value;
+            is_in_order &= index == next_indexes[producer]++;
+        }
+        Test::check(is_in_order,
+                    "a held cell keeps the order of both producers");
+    }
+}  // namespace
+
+int main() {
+    testUnpublishedCell();
+    for (size_t capacity : {2, 8, 1024}) {
+        testSpillAndDrain(capacity);
+        testProducersOrder(capacity, false);
+        testProducersOrder(capacity, true);
+    }
+    return Test::finish();
+}
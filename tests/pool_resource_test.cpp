@@ -0,0 +1,48 @@
+#include "pool_resource.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    void testBlocksAreReused() {
+        PoolResource pool;
+        void *block = pool.allocate(24);
+        pool.deallocate(block, 24);
+        void *reused_block = pool.allocate(24);
+        Test::check(reused_block == block, "a freed block is handed out again");
+        pool.deallocate(reused_block, 24);
+
+        auto statistics = pool.getStatistics();
+        Test::check(statistics.allocations == 2 &&
+                        statistics.reused_blocks == 1 &&
+                        statistics.upstream_allocations == 1,
+                    "only the first allocation takes a chunk");
+        Test::check(statistics.bytes_in_use == 0,
+                    "freed blocks are not in use");
+    }
+
+    void testLargerBlocksAreReserved() {
+        PoolResource pool;
+        size_t large_size = PoolResource::maximum_block_size * 4;
+        void *small_block = pool.allocate(24);
+        void *large_block = pool.allocate(large_size);
+
+        auto statistics = pool.getStatistics();
+        Test::check(statistics.reserved_bytes >= statistics.bytes_in_use,
+                    "blocks bypassing the pool count as reserved");
+        Test::check(statistics.peak_bytes_in_use <= statistics.reserved_bytes,
+                    "the peak in use never exceeds what is reserved");
+
+        pool.deallocate(large_block, large_size);
+        Test::check(pool.getStatistics().reserved_bytes ==
+                        statistics.reserved_bytes - large_size,
+                    "a larger block is no longer reserved once freed");
+        pool.deallocate(small_block, 24);
+    }
+}  // namespace
+
+int main() {
+    testBlocksAreReused();
+    testLargerBlocksAreReserved();
+    return Test::finish();
+}
@@ -0,0 +1,207 @@
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "configuration.hpp"
+#include "file_storage.hpp"
+#include "id_generator.hpp"
+#include "logger.hpp"
+#include "protocol.hpp"
+#include "simulator.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    constexpr size_t fragment_count = 200;
+
+    vector<string> readStoredFragments(const string &path) {
+        vector<string> fragments;
+        bool is_fragment_ended = true;
+        FileStorage::read(path, [&](string_view part, bool is_fragment_end) {
+            if (is_fragment_ended) fragments.emplace_back();
+            fragments.back() += part;
+            is_fragment_ended = is_fragment_end;
+        });
+        return fragments;
+    }
+
+    shared_ptr<Configuration> makeLosslessConfiguration(
+        unsigned int window_size) {
+        auto configuration = make_shared<Configuration>();
+        configuration->set("debug_information", "false");
+        configuration->set("packet_loss_probability", "0");
+        configuration->set("packet_corruption_probability", "0");
+        configuration->set("send_data_timeout", "3600s");
+        configuration->set("connection_buffer_size", to_string(window_size));
+        // Packages queue behind each other, as in the benchmark
+        configuration->set("network_bandwidth", "125000");
+        // Round trips take anywhere up to twice the latency, which a few
+        // early samples cannot tell
+        configuration->set("minimum_resend_timeout", "1s");
+        return configuration;
+    }
+
+    // Sends on the simulator, returning the statistics of the network
+    Network::Statistics sendLossless(unsigned int window_size,
+                                     bool is_segmented) {
+        srand(1);
+        auto simulator = make_shared<Simulator>();
+        Protocol protocol(make_shared<IdGenerator>(), "Test",
+                          makeLosslessConfiguration(window_size), simulator);
+
+        ostringstream output_stream;
+        uuids::uuid source = protocol.createEntity("Source", output_stream);
+        uuids::uuid target = protocol.createEntity("Target", output_stream);
+        bool is_completed =
+            is_segmented
+                ? protocol.sendPayload(source, target,
+                                       string(fragment_count * 1024, 'x'),
+                                       output_stream)
+                : protocol.sendData(
+                      source, target,
+                      deque<string>(fragment_count, string(1024, 'x')),
+                      output_stream);
+        Test::check(is_completed, "a lossless run completes");
+        return protocol.getNetworkStatistics();
+    }
+
+    void testNoRetransmissionsWhenLossless() {
+        for (unsigned int window_size : {1, 8, 32})
+            for (bool is_segmented : {false, true}) {
+                auto statistics = sendLossless(window_size, is_segmented);
+                Test::check(statistics.retransmissions == 0,
+                            "a lossless run with a window of " +
+                                to_string(window_size) +
+                                " makes no retransmission, not " +
+                                to_string(statistics.retransmissions));
+                Test::check(statistics.lost_packages == 0,
+                            "a lossless run loses no package");
+            }
+    }
+
+    // A lost package is resent once the packages after it are acknowledged,
+    // long before its resend timeout could expire
+    void testFastRetransmit() {
+        srand(1);
+        auto configuration = makeLosslessConfiguration(16);
+        configuration->set("packet_loss_probability", "0.01");
+        configuration->set("resend_timeout", "60s");
+        configuration->set("minimum_resend_timeout", "60s");
+        auto simulator = make_shared<Simulator>();
+        Protocol protocol(make_shared<IdGenerator>(), "Test", configuration,
+                          simulator);
+
+        ostringstream output_stream;
+        uuids::uuid source = protocol.createEntity("Source", output_stream);
+        uuids::uuid target = protocol.createEntity("Target", output_stream);
+        Test::check(protocol.sendData(
+                        source, target,
+                        deque<string>(fragment_count, string(1024, 'x')),
+                        output_stream),
+                    "a run with losses completes");
+
+        auto statistics = protocol.getNetworkStatistics();
+        Test::check(statistics.lost_packages > 0 &&
+                        statistics.fast_retransmissions > 0,
+                    "lost packages are retransmitted fast");
+        Test::check(statistics.retransmissions ==
+                            statistics.fast_retransmissions &&
+                        simulator->now() - Simulator::TimePoint() <
+                            chrono::seconds(60),
+                    "the run completes before any resend timeout expires, "
+                    "after " +
+                        to_string(chrono::duration_cast<chrono::seconds>(
+                                      simulator->now() - Simulator::TimePoint())
+                                      .count()) +
+                        "s");
+    }
+
+    // Segments are written to the storage as they arrive, so the stored
+    // payload is checked byte for byte, after losses too
+    void testPayloadIsStoredWhole() {
+        string storage_directory = "protocol_test_storage";
+        filesystem::create_directory(storage_directory);
+
+        string payload;
+        for (size_t i = 0; i < fragment_count * 100; i++)
+            payload += static_cast<char>('a' + i % 26);
+
+        srand(1);
+        auto configuration = makeLosslessConfiguration(8);
+        configuration->set("packet_loss_probability", "0.05");
+        configuration->set("segment_size", "100");
+        configuration->set("storage_directory", storage_directory);
+        uuids::uuid target;
+        {
+            Protocol protocol(make_shared<IdGenerator>(), "Test",
+                              configuration, make_shared<Simulator>());
+            ostringstream output_stream;
+            uuids::uuid source = protocol.createEntity("Source", output_stream);
+            target = protocol.createEntity("Target", output_stream);
+            Test::check(
+                protocol.sendPayload(source, target, payload, output_stream),
+                "a segmented payload is delivered");
+        }
+
+        vector<string> fragments = readStoredFragments(
+            storage_directory + "/" + uuids::to_string(target) + ".storage");
+        Test::check(fragments == vector<string>{payload},
+                    "the payload is stored as one fragment, as it was sent");
+        filesystem::remove_all(storage_directory);
+    }
+
+    // A payload the sender gives up on does not hold back what follows it
+    void testAbandonedPayloadIsDiscarded() {
+        string storage_directory = "protocol_test_abandoned_storage";
+        filesystem::create_directory(storage_directory);
+
+        srand(1);
+        auto configuration = makeLosslessConfiguration(1);
+        configuration->set("segment_size", "100");
+        configuration->set("storage_directory", storage_directory);
+        uuids::uuid target;
+        {
+            Protocol protocol(make_shared<IdGenerator>(), "Test",
+                              configuration, make_shared<Simulator>());
+            ostringstream output_stream;
+            uuids::uuid source = protocol.createEntity("Source", output_stream);
+            uuids::uuid other_source =
+                protocol.createEntity("Other source", output_stream);
+            target = protocol.createEntity("Target", output_stream);
+
+            configuration->set("send_data_timeout", "1ms");
+            Test::check(!protocol.sendPayload(source, target,
+                                              string(fragment_count * 100, 'x'),
+                                              output_stream),
+                        "a payload is given up on before it is sent");
+            configuration->set("send_data_timeout", "3600s");
+            Test::check(protocol.sendData(other_source, target, {"other"},
+                                          output_stream) &&
+                            protocol.sendData(source, target, {"next"},
+                                              output_stream),
+                        "data sent after it is delivered");
+        }
+
+        vector<string> fragments = readStoredFragments(
+            storage_directory + "/" + uuids::to_string(target) + ".storage");
+        Test::check(fragments == vector<string>{"other", "next"},
+                    "the abandoned payload is not stored, and the data after "
+                    "it is");
+        filesystem::remove_all(storage_directory);
+    }
+}  // namespace
+
+int main() {
+    Logger::getInstance().setMinimumLevel(Logger::Level::ERROR);
+    testNoRetransmissionsWhenLossless();
+    testFastRetransmit();
+    testPayloadIsStoredWhole();
+    testAbandonedPayloadIsDiscarded();
+    return Test::finish();
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+
+#include "retransmission_timeout.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    using Duration = RetransmissionTimeout::Duration;
+
+    RetransmissionTimeout makeRetransmissionTimeout() {
+        return RetransmissionTimeout(chrono::seconds(1),
+                                     chrono::milliseconds(200),
+                                     chrono::seconds(60),
+                                     chrono::milliseconds(1));
+    }
+
+    void testSamples() {
+        auto retransmission_timeout = makeRetransmissionTimeout();
+        Test::check(retransmission_timeout.getTimeout() == chrono::seconds(1) &&
+                        !retransmission_timeout.getSmoothedRoundTripTime()
+                             .has_value(),
+                    "the initial timeout is used until the first sample");
+
+        // SRTT = R, RTTVAR = R / 2
+        retransmission_timeout.addSample(chrono::milliseconds(100));
+        Test::check(retransmission_timeout.getSmoothedRoundTripTime() ==
+                            Duration(chrono::milliseconds(100)) &&
+                        retransmission_timeout.getRoundTripTimeVariation() ==
+                            chrono::milliseconds(50),
+                    "the first sample sets the estimate");
+        Test::check(
+            retransmission_timeout.getTimeout() == chrono::milliseconds(300),
+            "the timeout is SRTT + 4 RTTVAR");
+
+        // RTTVAR = 3/4 * 50 + 1/4 * 100, SRTT = 7/8 * 100 + 1/8 * 200
+        retransmission_timeout.addSample(chrono::milliseconds(200));
+        Test::check(retransmission_timeout.getSmoothedRoundTripTime() ==
+                            Duration(chrono::microseconds(112500)) &&
+                        retransmission_timeout.getRoundTripTimeVariation() ==
+                            chrono::microseconds(62500),
+                    "later samples are smoothed");
+        Test::check(
+            retransmission_timeout.getTimeout() == chrono::microseconds(362500),
+            "the timeout follows the smoothed estimate");
+    }
+
+    void testBackoff() {
+        auto retransmission_timeout = makeRetransmissionTimeout();
+        retransmission_timeout.addSample(chrono::milliseconds(100));
+
+        Test::check(retransmission_timeout.backOff(chrono::milliseconds(300)) ==
+                        chrono::milliseconds(600),
+                    "an expired timeout is doubled");
+        Test::check(retransmission_timeout.backOff(chrono::milliseconds(300)) ==
+                        chrono::milliseconds(600),
+                    "a timeout older than the current one is not doubled");
+        Test::check(retransmission_timeout.getBackoffsCount() == 1,
+                    "only the current timeout is backed off");
+
+        retransmission_timeout.addSample(chrono::milliseconds(100));
+        Test::check(retransmission_timeout.getBackoffsCount() == 0 &&
+                        retransmission_timeout.getTimeout() <
+                            chrono::milliseconds(300),
+                    "a new sample resets the backoff");
+
+        retransmission_timeout.backOff(retransmission_timeout.getTimeout());
+        auto smoothed_round_trip_time =
+            retransmission_timeout.getSmoothedRoundTripTime();
+        retransmission_timeout.resetBackoff();
+        Test::check(retransmission_timeout.getBackoffsCount() == 0 &&
+                        retransmission_timeout.getSmoothedRoundTripTime() ==
+                            smoothed_round_trip_time,
+                    "a delivery without a sample only resets the backoff");
+    }
+
+    void testClamping() {
+        auto retransmission_timeout = makeRetransmissionTimeout();
+        retransmission_timeout.addSample(chrono::milliseconds(10));
+        Test::check(
+            retransmission_timeout.getTimeout() == chrono::milliseconds(200),
+            "the timeout is never below the minimum");
+
+        for (int i = 0; i < 20; i++)
+            retransmission_timeout.backOff(retransmission_timeout.getTimeout());
+        Test::check(retransmission_timeout.getTimeout() == chrono::seconds(60),
+                    "backing off stops at the maximum");
+
+        retransmission_timeout.addSample(chrono::seconds(100));
+        Test::check(retransmission_timeout.getTimeout() == chrono::seconds(60),
+                    "the timeout is never above the maximum");
+    }
+}  // namespace
+
+int main() {
+    testSamples();
+    testBackoff();
+    testClamping();
+    return Test::finish();
+}
@@ -0,0 +1,156 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chunked_storage.hpp"
+#include "file_storage.hpp"
+#include "test.hpp"
+
+using namespace std;
+
+namespace {
+    // Gathers the visited parts back into fragments
+    auto makeGatherer(vector<string> &fragments) {
+        return [&fragments, is_fragment_ended = true](
+                   string_view part, bool is_fragment_end) mutable {
+            if (is_fragment_ended) fragments.emplace_back();
+            fragments.back() += part;
+            is_fragment_ended = is_fragment_end;
+        };
+    }
+
+    vector<string> readFragments(const Storage &storage) {
+        vector<string> fragments;
+        storage.forEach(makeGatherer(fragments));
+        return fragments;
+    }
+
+    vector<string> readFragments(const string &path, size_t part_size) {
+        vector<string> fragments;
+        FileStorage::read(path, makeGatherer(fragments), part_size);
+        return fragments;
+    }
+
+    void testFragmentInParts(Storage &storage, const string &name) {
+        Test::check(storage.append("first"), name + ": appends a fragment");
+        Test::check(storage.beginFragment(6), name + ": begins a fragment");
+        Test::check(storage.appendToFragment("sec"),
+                    name + ": appends a part");
+        Test::check(!storage.beginFragment(1),
+                    name + ": does not begin a fragment inside another");
+        Test::check(readFragments(storage) == vector<string>{"first"},
+                    name + ": does not visit a partial fragment");
+        Test::check(!storage.appendToFragment("ond!"),
+                    name + ": rejects a part past the fragment size");
+        Test::check(storage.appendToFragment("ond"),
+                    name + ": appends the last part");
+        Test::check(storage.beginFragment(5) &&
+                        storage.appendToFragment("lost"),
+                    name + ": begins a fragment to discard");
+        storage.discardFragment();
+        Test::check(readFragments(storage) == vector<string>{"first", "second"},
+                    name + ": drops a discarded fragment");
+        Test::check(storage.beginFragment(0) && storage.append("third"),
+                    name + ": appends an empty fragment and another one");
+        Test::check(readFragments(storage) ==
+                        vector<string>{"first", "second", "", "third"},
+                    name + ": visits every complete fragment in order");
+        Test::check(storage.getFragmentsCount() == 4 &&
+                        storage.getSize() == 16,
+                    name + ": counts complete fragments");
+    }
+
+    void testChunkedStorage() {
+        ChunkedStorage storage(4);
+        testFragmentInParts(storage, "chunked storage");
+    }
+
+    void testFileStorage() {
+        string path = "storage_test.bin";
+        {
+            auto storage = FileStorage::open(
+                path, {FileStorage::Durability::NONE, 1, 1});
+            Test::check(storage != nullptr, "the file storage opens");
+            if (storage == nullptr) return;
+            testFragmentInParts(*storage, "file storage");
+            Test::check(storage->beginFragment(8) &&
+                            storage->appendToFragment("cut"),
+                        "file storage: begins a fragment left partial");
+        }
+
+        Test::check(readFragments(path, 1024) ==
+                        vector<string>{"first", "second", "", "third"},
+                    "file storage: cuts off a partial fragment when closed");
+        Test::check(readFragments(path, 2) ==
+                        vector<string>{"first", "second", "", "third"},
+                    "file storage: reads fragments back in parts");
+        remove(path.c_str());
+    }
+
+    // A fragment discarded after spanning several windows is written over
+    void testFileStorageDiscard() {
+        string path = "storage_discard_test.bin";
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        {
+            auto storage = FileStorage::open(
+                path, {FileStorage::Durability::BATCH, 1, 1});
+            Test::check(storage != nullptr, "the file storage opens again");
+            if (storage == nullptr) return;
+            Test::check(storage->append("first") &&
+                            storage->beginFragment(3 * page_size) &&
+                            storage->appendToFragment(
+                                string(2 * page_size, 'x')),
+                        "file storage: writes a fragment over windows");
+            storage->discardFragment();
+            Test::check(storage->append("second") &&
+                            storage->getFragmentsCount() == 2 &&
+                            storage->getSize() == 11,
+                        "file storage: appends after a discarded fragment");
+        }
+
+        Test::check(readFragments(path, page_size) ==
+                        vector<string>{"first", "second"},
+                    "file storage: writes over a discarded fragment");
+        remove(path.c_str());
+    }
+
+    // A fragment larger than a window is never visited whole
+    void testFileStorageParts() {
+        string path = "storage_parts_test.bin";
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        string fragment;
+        for (size_t i = 0; i < 3 * page_size + 1; i++)
+            fragment += static_cast<char>('a' + i % 26);
+
+        auto storage =
+            FileStorage::open(path, {FileStorage::Durability::NONE, 1, 1});
+        Test::check(storage != nullptr, "the file storage opens for parts");
+        if (storage == nullptr) return;
+        storage->append(fragment);
+
+        size_t largest_part_size = 0;
+        size_t parts_count = 0;
+        storage->forEach([&](string_view part, bool) {
+            largest_part_size = max(largest_part_size, part.size());
+            parts_count++;
+        });
+        Test::check(largest_part_size == page_size && parts_count == 4,
+                    "file storage: visits a fragment a window at a time");
+        Test::check(readFragments(*storage) == vector<string>{fragment},
+                    "file storage: parts make up the whole fragment");
+        storage.reset();
+        remove(path.c_str());
+    }
+}  // namespace
+
+int main() {
+    testChunkedStorage();
+    testFileStorage();
+    testFileStorageDiscard();
+    testFileStorageParts();
+    return Test::finish();
+}
@@ -0,0 +1,33 @@
+#ifndef TEST_HPP_
+#define TEST_HPP_
+
+#include <iostream>
+#include <source_location>
+#include <string>
+
+using namespace std;
+
+/*
+ * Minimal checks for the test executables.
+ * A failed check is reported and the test goes on, so one run shows every
+ * failure; finish() turns them into the exit code.
+ */
+namespace Test {
+    inline int failures_count = 0;
+
+    inline void check(bool condition, const string &description,
+                      source_location location = source_location::current()) {
+        if (condition) return;
+        failures_count++;
+        cerr << location.file_name() << ":" << location.line()
+             << ": check failed: " << description << endl;
+    }
+
+    inline int finish() {
+        if (failures_count == 0) return 0;
+        cerr << failures_count << " check(s) failed" << endl;
+        return 1;
+    }
+}  // namespace Test
+
+#endif  // TEST_HPP_
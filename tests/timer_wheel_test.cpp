@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "id_generator.hpp"
+#include "test.hpp"
+#include "timer_wheel.hpp"
+
+using namespace std;
+
+namespace {
+    using Milliseconds = chrono::milliseconds;
+
+    shared_ptr<IdGenerator> id_generator = make_shared<IdGenerator>();
+    TimerWheel::TimePoint origin = TimerWheel::Clock::now();
+
+    void testNextDeadline() {
+        TimerWheel wheel(Milliseconds(1), 16, origin);
+        Test::check(!wheel.getNextDeadline().has_value(),
+                    "an empty wheel has no deadline");
+
+        auto first = id_generator->generate();
+        auto second = id_generator->generate();
+        auto far = id_generator->generate();
+        wheel.arm(second, origin + Milliseconds(9));
+        wheel.arm(first, origin + Milliseconds(5));
+        // More than a full turn away, in the same slot as the first one
+        wheel.arm(far, origin + Milliseconds(21));
+
+        Test::check(wheel.getNextDeadline() == origin + Milliseconds(5),
+                    "the earliest deadline is the next one");
+        wheel.cancel(first);
+        Test::check(wheel.getNextDeadline() == origin + Milliseconds(9),
+                    "cancelling the earliest timer moves the next deadline");
+        wheel.cancel(second);
+        Test::check(wheel.getNextDeadline() == origin + Milliseconds(21),
+                    "a timer on a later turn is still found");
+        wheel.cancel(far);
+        Test::check(!wheel.getNextDeadline().has_value() && wheel.empty(),
+                    "nothing is left after cancelling every timer");
+    }
+
+    void testAdvance() {
+        TimerWheel wheel(Milliseconds(1), 16, origin);
+        vector<uuids::uuid> keys;
+        for (int i = 0; i < 40; i++) {
+            keys.push_back(id_generator->generate());
+            wheel.arm(keys.back(), origin + Milliseconds(i + 1));
+        }
+
+        auto expired = wheel.advance(origin + Milliseconds(10));
+        Test::check(expired.size() == 10, "ten timers expire at 10 ms");
+        Test::check(none_of(keys.begin(), keys.begin() + 10,
+                            [&](uuids::uuid key) {
+                                return wheel.isArmed(key);
+                            }),
+                    "the expired timers are the earliest ones");
+        Test::check(wheel.getNextDeadline() == origin + Milliseconds(11),
+                    "the next deadline follows the expired ones");
+
+        // Jumping over more than a full turn expires every timer once
+        expired = wheel.advance(origin + Milliseconds(100));
+        Test::check(expired.size() == 30 && wheel.empty(),
+                    "every remaining timer expires at 100 ms");
+        Test::check(!wheel.getNextDeadline().has_value(),
+                    "no deadline is left");
+    }
+
+    void testRearm() {
+        TimerWheel wheel(Milliseconds(1), 16, origin);
+        auto key = id_generator->generate();
+        wheel.arm(key, origin + Milliseconds(3));
+        wheel.arm(key, origin + Milliseconds(30));
+        Test::check(wheel.size() == 1, "arming again replaces the timer");
+        Test::check(wheel.advance(origin + Milliseconds(5)).empty(),
+                    "the replaced deadline does not expire");
+        Test::check(wheel.getNextDeadline() == origin + Milliseconds(30),
+                    "the new deadline is the next one");
+
+        // A deadline already in the past expires on the next advance
+        wheel.arm(key, origin + Milliseconds(1));
+        Test::check(wheel.advance(origin + Milliseconds(5)).size() == 1,
+                    "a timer armed in the past expires");
+    }
+}  // namespace
+
+int main() {
+    testNextDeadline();
+    testAdvance();
+    testRearm();
+    return Test::finish();
+}
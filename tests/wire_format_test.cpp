@@ -0,0 +1,176 @@
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "id_generator.hpp"
+#include "message.hpp"
+#include "package.hpp"
+#include "test.hpp"
+#include "wire_format.hpp"
+
+using namespace std;
+
+namespace {
+    shared_ptr<IdGenerator> id_generator = make_shared<IdGenerator>();
+
+    Package createDataPackage(string content) {
+        Message message(id_generator, id_generator->generate(),
+                        id_generator->generate(), Message::Code::DATA,
+                        nullopt, nullopt, Payload(move(content)));
+        return Package(message, true, 7);
+    }
+
+    Package createFullPackage() {
+        Message message(id_generator, id_generator->generate(),
+                        id_generator->generate(), Message::Code::ACK,
+                        Message::CodeVariant::ACK_SYN,
+                        id_generator->generate(), Payload("content"));
+        message.setAcknowledgedRanges({{1, 4}, {6, 6}, {9, 12}});
+        message.setSegment({id_generator->generate(), 1024, 4096});
+        Package package(message, false, 42);
+        package.setCorrupted(true);
+        return package;
+    }
+
+    void checkRoundTrip(const Package &package) {
+        vector<byte> buffer = WireFormat::encode(package);
+        Test::check(buffer.size() == WireFormat::getEncodedSize(package),
+                    "the encoded size is the predicted one");
+
+        auto view = WireFormat::parse(buffer);
+        Test::check(view.has_value(), "an encoded package is parsed");
+        if (!view.has_value()) return;
+        Test::check(view->getSize() == buffer.size(),
+                    "the view covers the whole package");
+
+        Package decoded = WireFormat::decode(view.value());
+        const Message &expected = package.getMessage();
+        const Message &message = decoded.getMessage();
+        Test::check(message.getId() == expected.getId(), "ID");
+        Test::check(message.getSourceEntityId() == expected.getSourceEntityId(),
+                    "source entity ID");
+        Test::check(message.getTargetEntityId() == expected.getTargetEntityId(),
+                    "target entity ID");
+        Test::check(message.getCode() == expected.getCode(), "code");
+        Test::check(message.getCodeVariant() == expected.getCodeVariant(),
+                    "code variant");
+        Test::check(message.getIdFromMessageBeingAcknowledged() ==
+                        expected.getIdFromMessageBeingAcknowledged(),
+                    "ID from message being acknowledged");
+        Test::check(message.getContent() == expected.getContent(), "content");
+        Test::check(decoded.shouldBeConfirmed() == package.shouldBeConfirmed(),
+                    "should be confirmed");
+        Test::check(decoded.isCorrupted() == package.isCorrupted(),
+                    "corrupted");
+        Test::check(
+            decoded.getSequenceNumber() == package.getSequenceNumber(),
+            "sequence number");
+
+        const auto &ranges = message.getAcknowledgedRanges();
+        const auto &expected_ranges = expected.getAcknowledgedRanges();
+        bool are_ranges_equal = ranges.size() == expected_ranges.size();
+        for (size_t i = 0; are_ranges_equal && i < ranges.size(); i++)
+            are_ranges_equal = ranges[i].first == expected_ranges[i].first &&
+                               ranges[i].last == expected_ranges[i].last;
+        Test::check(are_ranges_equal, "acknowledged ranges");
+
+        auto segment = message.getSegment();
+        auto expected_segment = expected.getSegment();
+        Test::check(segment.has_value() == expected_segment.has_value(),
+                    "segment presence");
+        if (segment.has_value() && expected_segment.has_value())
+            Test::check(
+                segment->payload_id == expected_segment->payload_id &&
+                    segment->offset == expected_segment->offset &&
+                    segment->payload_size == expected_segment->payload_size,
+                "segment");
+    }
+
+    void testRoundTrip() {
+        checkRoundTrip(createDataPackage(""));
+        checkRoundTrip(createDataPackage("Fragment 1"));
+        checkRoundTrip(createDataPackage(string(70000, 'x')));
+        checkRoundTrip(createFullPackage());
+    }
+
+    void testTruncatedInput() {
+        for (const Package &package :
+             {createDataPackage("Fragment 1"), createFullPackage()}) {
+            vector<byte> buffer = WireFormat::encode(package);
+            bool is_any_prefix_parsed = false;
+            for (size_t size = 0; size < buffer.size(); size++)
+                if (WireFormat::parse(span(buffer).first(size)).has_value())
+                    is_any_prefix_parsed = true;
+            Test::check(!is_any_prefix_parsed,
+                        "no truncated package is parsed");
+        }
+    }
+
+    void testInvalidHeader() {
+        vector<byte> buffer = WireFormat::encode(createFullPackage());
+
+        vector<byte> wrong_version = buffer;
+        wrong_version[WireFormat::Offset::version] =
+            static_cast<byte>(WireFormat::version + 1);
+        Test::check(!WireFormat::parse(wrong_version).has_value(),
+                    "another version is rejected");
+
+        vector<byte> wrong_code = buffer;
+        wrong_code[WireFormat::Offset::code] = static_cast<byte>(0xff);
+        Test::check(!WireFormat::parse(wrong_code).has_value(),
+                    "an unknown code is rejected");
+
+        vector<byte> wrong_variant = buffer;
+        wrong_variant[WireFormat::Offset::code_variant] =
+            static_cast<byte>(0xff);
+        Test::check(!WireFormat::parse(wrong_variant).has_value(),
+                    "an unknown code variant is rejected");
+    }
+
+    void testConsecutivePackages() {
+        Package first = createFullPackage();
+        Package second = createDataPackage("Fragment 2");
+        vector<byte> buffer = WireFormat::encode(first);
+        vector<byte> second_buffer = WireFormat::encode(second);
+        buffer.insert(buffer.end(), second_buffer.begin(), second_buffer.end());
+
+        auto first_view = WireFormat::parse(buffer);
+        Test::check(first_view.has_value() &&
+                        first_view->getId() == first.getMessage().getId(),
+                    "the first package is parsed");
+        if (!first_view.has_value()) return;
+
+        auto second_view =
+            WireFormat::parse(span(buffer).subspan(first_view->getSize()));
+        Test::check(second_view.has_value() &&
+                        second_view->getId() == second.getMessage().getId() &&
+                        second_view->getContent() == "Fragment 2",
+                    "the second package starts where the first one ends");
+    }
+
+    void testFieldsTooWide() {
+        Message message = createDataPackage("").getMessage();
+        message.setAcknowledgedRanges(vector<Message::SequenceRange>(
+            static_cast<size_t>(UINT16_MAX) + 1, {1, 1}));
+        Package package(message, true, 1);
+        Test::check(WireFormat::encode(package).empty(),
+                    "more ranges than the count field holds are rejected");
+
+        Message segmented_message = createDataPackage("").getMessage();
+        segmented_message.setSegment(
+            {id_generator->generate(), 0, static_cast<size_t>(UINT32_MAX) + 1});
+        Test::check(
+            WireFormat::encode(Package(segmented_message, true, 1)).empty(),
+            "a payload larger than the size field holds is rejected");
+    }
+}  // namespace
+
+int main() {
+    testRoundTrip();
+    testTruncatedInput();
+    testInvalidHeader();
+    testConsecutivePackages();
+    testFieldsTooWide();
+    return Test::finish();
+}